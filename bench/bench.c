@@ -0,0 +1,470 @@
+//
+//  bench.c
+//  regen
+//  Times parsing, each path of the generator and whole runs, and compares the results with a baseline (make bench).
+//
+
+#include "../src/regen.h"
+#include "../src/rdparser.h"
+#include "../src/arena.h"
+#include <fcntl.h>
+#include <stdarg.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/*
+ Every pattern of the corpus (see corpus.txt) is timed being parsed, and being parsed and compiled by regen_compile.
+ A micro pattern keeps the generator on one path, and is timed in ns per byte generated by one thread.  A macro
+ pattern is run through regen_write_lines into /dev/null at 1, 2, 4 ... and -j threads, in lines per second, in a
+ process of its own so that its peak RSS is its own.
+
+ Each figure is the best of BENCH_ROUNDS tries, which is steadier than the mean on a busy machine, and each try runs
+ long enough for the clock not to matter.  The results are written as JSON, one figure per line under "metrics", and
+ compared with the same figures of a baseline: one more than the tolerance worse than its baseline is a regression,
+ and any regression makes the run fail.  Figures the baseline doesn't have, such as those of a new pattern or of more
+ threads, are only reported.
+ */
+
+#ifndef BENCH_ROUNDS
+#define BENCH_ROUNDS 3
+#endif
+
+//Shortest time, in seconds, a try of parsing or generating is timed over.
+#ifndef BENCH_MIN_TIME
+#define BENCH_MIN_TIME 0.05
+#endif
+
+//About how long, in seconds, each try of a macro pattern at one thread count runs.
+#ifndef BENCH_RUN_TIME
+#define BENCH_RUN_TIME 0.25
+#endif
+
+#ifndef BENCH_DEFAULT_TOLERANCE
+#define BENCH_DEFAULT_TOLERANCE 0.20
+#endif
+
+#define BENCH_P .9
+#define BENCH_NAME_SIZE 128
+
+struct metric {
+    char name[BENCH_NAME_SIZE];
+    double value;
+    int higher_is_better;
+};
+
+struct metrics {
+    struct metric * list;
+    size_t length;
+    size_t size;
+};
+
+static void add_metric(struct metrics * m, int higher_is_better, double value, const char * format, ...) {
+    va_list args;
+    if (m->length == m->size) {
+        m->size = m->size ? m->size * 2 : 64;
+        m->list = (struct metric *)realloc(m->list, m->size * sizeof(struct metric));
+        if (m->list == NULL) { printf("realloc failure.\n"); exit(1); }
+    }
+    va_start(args, format);
+    vsnprintf(m->list[m->length].name, BENCH_NAME_SIZE, format, args);
+    va_end(args);
+    m->list[m->length].value = value;
+    m->list[m->length].higher_is_better = higher_is_better;
+    m->length++;
+}
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* ---------- The corpus ---------- */
+
+struct entry {
+    int macro;
+    char name[BENCH_NAME_SIZE];
+    char * pattern;
+};
+
+//@return the words of the file at path, one per line, as the branches of one |: (w1)|(w2)|...
+static char * dictionary(const char * path) {
+    FILE * f = fopen(path, "r");
+    char * pattern = NULL;
+    size_t length = 0;
+    char word[256];
+    if (f == NULL) {
+        printf("Unable to open file \"%s\".\n", path);
+        exit(2);
+    }
+    while (fgets(word, sizeof(word), f)) {
+        size_t n = strcspn(word, "\r\n");
+        if (n == 0) {
+            continue;
+        }
+        pattern = (char *)realloc(pattern, length + n + 4);
+        if (pattern == NULL) { printf("realloc failure.\n"); exit(1); }
+        length += sprintf(pattern + length, "%s(%.*s)", length ? "|" : "", (int)n, word);
+    }
+    fclose(f);
+    if (pattern == NULL) {
+        printf("No words in \"%s\".\n", path);
+        exit(2);
+    }
+    return pattern;
+}
+
+static struct entry * read_corpus(const char * path, size_t * count) {
+    FILE * f = fopen(path, "r");
+    struct entry * entries = NULL;
+    char * line = NULL;
+    size_t size = 0;
+    ssize_t n;
+    if (f == NULL) {
+        printf("Unable to open file \"%s\".\n", path);
+        exit(2);
+    }
+    *count = 0;
+    while ((n = getline(&line, &size, f)) >= 0) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') {
+            continue;
+        }
+        char * name = strchr(line, ' ');
+        char * pattern = name ? strchr(name + 1, ' ') : NULL;
+        if (pattern == NULL || (strncmp(line, "micro ", 6) && strncmp(line, "macro ", 6))) {
+            printf("Invalid corpus line \"%s\".\nLines are: micro|macro name pattern\n", line);
+            exit(2);
+        }
+        entries = (struct entry *)realloc(entries, (*count + 1) * sizeof(struct entry));
+        if (entries == NULL) { printf("realloc failure.\n"); exit(1); }
+        struct entry * e = &entries[(*count)++];
+        e->macro = line[1] == 'a';
+        snprintf(e->name, BENCH_NAME_SIZE, "%.*s", (int)(pattern - name - 1), name + 1);
+        pattern++;
+        if (pattern[0] == '@') {
+            //Relative to the corpus.
+            const char * slash = strrchr(path, '/');
+            char file[4096];
+            snprintf(file, sizeof(file), "%.*s%s", slash ? (int)(slash - path + 1) : 0, path, pattern + 1);
+            e->pattern = dictionary(file);
+        } else {
+            e->pattern = strdup(pattern);
+            if (e->pattern == NULL) { printf("malloc failure.\n"); exit(1); }
+        }
+    }
+    free(line);
+    fclose(f);
+    return entries;
+}
+
+/* ---------- Timing ---------- */
+
+static void parse_once(const char * regex, size_t length) {
+    struct parser ps;
+    ps.arena = arena_create();
+    if (parse_pattern(&ps, regex, length) == NULL) {
+        printf("Syntax error in \"%s\": %s\n", regex, ps.message);
+        exit(4);
+    }
+    arena_destroy(ps.arena);
+}
+
+static void compile_once(const char * regex, size_t length) {
+    regen_pattern * pattern;
+    struct regen_error error;
+    if (regen_compile(&pattern, regex, length, &error) != REGEN_OK) {
+        printf("Unable to compile \"%s\": %s\n", regex, error.message);
+        exit(4);
+    }
+    regen_pattern_free(pattern);
+}
+
+//@return the best time, in ns, that work took on regex, over enough calls at a time to take BENCH_MIN_TIME.
+static double time_calls(void (*work)(const char *, size_t), const char * regex) {
+    size_t length = strlen(regex);
+    unsigned long calls = 1;
+    double best = 0;
+    int round = 0;
+    for (; round < BENCH_ROUNDS; round++) {
+        double took;
+        unsigned long i;
+        for (;;) {
+            double began = now();
+            for (i = 0; i < calls; i++) {
+                work(regex, length);
+            }
+            took = now() - began;
+            if (took >= BENCH_MIN_TIME) {
+                break;
+            }
+            calls *= 2;
+        }
+        if (round == 0 || took / calls < best) {
+            best = took / calls;
+        }
+    }
+    return best * 1e9;
+}
+
+//@return the best ns per byte of generating strings from pattern on one thread.
+static double time_generate(const regen_pattern * pattern) {
+    regen_state * state;
+    double best = 0;
+    int round = 0;
+    if (regen_state_create(&state, BENCH_P, REGEN_DEFAULT_SEED) != REGEN_OK) {
+        printf("Invalid BENCH_P.\n");
+        exit(2);
+    }
+    for (; round < BENCH_ROUNDS; round++) {
+        uint64_t bytes = 0;
+        double began = now();
+        double took;
+        do {
+            int i = 0;
+            for (; i < 1024; i++) {
+                size_t length;
+                regen_generate(pattern, state, &length);
+                bytes += length;
+            }
+            took = now() - began;
+        } while (took < 4 * BENCH_MIN_TIME);
+        if (round == 0 || took / bytes < best) {
+            best = took / bytes;
+        }
+    }
+    regen_state_free(state);
+    return best * 1e9;
+}
+
+//@return how long, in seconds, writing count lines of pattern on threads threads into fd took.
+static double time_run(const regen_pattern * pattern, unsigned long count, int threads, int fd) {
+    struct regen_lines lines;
+    unsigned long written;
+    memset(&lines, 0, sizeof(lines));
+    lines.p = BENCH_P;
+    lines.seed = REGEN_DEFAULT_SEED;
+    lines.count = count;
+    lines.threads = threads;
+    lines.ordered = 1;
+    lines.budget_policy = REGEN_BUDGET_RESAMPLE;
+    double began = now();
+    int status = regen_write_lines(pattern, &lines, fd, &written);
+    if (status != REGEN_OK) {
+        printf("Run failed: %s\n", regen_strerror(status));
+        exit(1);
+    }
+    return now() - began;
+}
+
+/*
+ Runs pattern at each of nthreads thread counts, in a child process, and fills in rates with the best lines per second
+ of each.
+ @return the child's peak RSS, in kilobytes.
+ */
+static long run_macro(const regen_pattern * pattern, const int * threads, int nthreads, double * rates) {
+    int fds[2];
+    struct rusage usage;
+    int status;
+    if (pipe(fds) < 0) {
+        printf("Unable to make a pipe.\n");
+        exit(1);
+    }
+    fflush(stdout);
+    pid_t child = fork();
+    if (child < 0) {
+        printf("Unable to start a process.\n");
+        exit(1);
+    }
+    if (child == 0) {
+        int out = open("/dev/null", O_WRONLY);
+        int t = 0;
+        close(fds[0]);
+        for (; t < nthreads; t++) {
+            //Grow the run until it takes a tenth of BENCH_RUN_TIME, then size the timed ones from that.
+            unsigned long count = 1000;
+            double took;
+            while ((took = time_run(pattern, count, threads[t], out)) < BENCH_RUN_TIME / 10) {
+                count *= 4;
+            }
+            count = (unsigned long)(count * (BENCH_RUN_TIME / took)) + 1;
+            int round = 0;
+            rates[t] = 0;
+            for (; round < BENCH_ROUNDS; round++) {
+                double rate = count / time_run(pattern, count, threads[t], out);
+                if (rate > rates[t]) {
+                    rates[t] = rate;
+                }
+            }
+        }
+        if (write(fds[1], rates, nthreads * sizeof(double)) != (ssize_t)(nthreads * sizeof(double))) {
+            _exit(1);
+        }
+        _exit(0);
+    }
+    close(fds[1]);
+    ssize_t got = read(fds[0], rates, nthreads * sizeof(double));
+    close(fds[0]);
+    if (wait4(child, &status, 0, &usage) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0
+        || got != (ssize_t)(nthreads * sizeof(double))) {
+        printf("A benchmark process failed.\n");
+        exit(1);
+    }
+    return usage.ru_maxrss;
+}
+
+/* ---------- Results ---------- */
+
+static void write_results(const char * path, const struct metrics * m, int threads) {
+    FILE * f = fopen(path, "w");
+    size_t i = 0;
+    if (f == NULL) {
+        printf("Unable to open file \"%s\".\n", path);
+        exit(1);
+    }
+    fprintf(f, "{\n  \"rounds\": %d,\n  \"threads\": %d,\n  \"metrics\": {\n", BENCH_ROUNDS, threads);
+    for (; i < m->length; i++) {
+        fprintf(f, "    \"%s\": %.6g%s\n", m->list[i].name, m->list[i].value, i + 1 < m->length ? "," : "");
+    }
+    fprintf(f, "  }\n}\n");
+    if (fclose(f) != 0) {
+        printf("Unable to write file \"%s\".\n", path);
+        exit(1);
+    }
+}
+
+/*
+ Compares m with the figures in the baseline at path, which was written by write_results.
+ @return the number of regressions, or -1 if there is no baseline.
+ */
+static int compare(const char * path, const struct metrics * m, double tolerance) {
+    FILE * f = fopen(path, "r");
+    char line[BENCH_NAME_SIZE + 64];
+    int regressions = 0;
+    int compared = 0;
+    if (f == NULL) {
+        return -1;
+    }
+    printf("\nCompared with %s (tolerance %.0f%%):\n", path, tolerance * 100);
+    while (fgets(line, sizeof(line), f)) {
+        char name[BENCH_NAME_SIZE];
+        double base;
+        size_t i = 0;
+        if (sscanf(line, " \"%127[^\"]\": %lf", name, &base) != 2 || strchr(name, '/') == NULL) {
+            continue;
+        }
+        for (; i < m->length && strcmp(m->list[i].name, name); i++);
+        if (i == m->length || base <= 0 || m->list[i].value <= 0) {
+            continue;
+        }
+        const struct metric * current = &m->list[i];
+        double worse = current->higher_is_better ? base / current->value - 1 : current->value / base - 1;
+        compared++;
+        if (worse > tolerance) {
+            printf("  REGRESSION %-50s %12.6g -> %12.6g  (%.1f%% worse)\n", name, base, current->value, worse * 100);
+            regressions++;
+        }
+    }
+    fclose(f);
+    printf("  %d figures compared, %d regressions.\n", compared, regressions);
+    return regressions;
+}
+
+int main(int argc, const char * argv[]) {
+    const char * baseline = NULL;
+    double tolerance = BENCH_DEFAULT_TOLERANCE;
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int maxthreads = ncpus > 0 ? (int)ncpus : 1;
+    int threads[32];
+    int nthreads = 0;
+    struct metrics m = {NULL, 0, 0};
+    size_t count;
+    size_t e;
+    int i = 1;
+
+    for (; i < argc - 2; i++) {
+        if (!strcmp(argv[i], "-j") && i + 1 < argc - 2) {
+            maxthreads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-b") && i + 1 < argc - 2) {
+            baseline = argv[++i];
+        } else if (!strcmp(argv[i], "-t") && i + 1 < argc - 2) {
+            tolerance = atof(argv[++i]);
+        } else {
+            break;
+        }
+    }
+    if (i != argc - 2 || maxthreads < 1 || maxthreads > REGEN_MAX_THREADS || tolerance < 0) {
+        printf("Usage: bench [-j threads] [-b baseline.json] [-t tolerance] corpus results.json\n");
+        exit(2);
+    }
+    for (i = 1; i < maxthreads; i *= 2) {
+        threads[nthreads++] = i;
+    }
+    threads[nthreads++] = maxthreads;
+
+    struct entry * entries = read_corpus(argv[argc - 2], &count);
+    double * rates = (double *)malloc(nthreads * sizeof(double));
+    if (rates == NULL) { printf("malloc failure.\n"); exit(1); }
+
+    printf("%-20s %12s %12s %12s\n", "pattern", "parse ns", "compile ns", "ns/byte");
+    for (e = 0; e < count; e++) {
+        const struct entry * en = &entries[e];
+        double parse_ns = time_calls(parse_once, en->pattern);
+        double compile_ns = time_calls(compile_once, en->pattern);
+        add_metric(&m, 0, parse_ns, "parse_ns/%s", en->name);
+        add_metric(&m, 0, compile_ns, "compile_ns/%s", en->name);
+        if (en->macro) {
+            printf("%-20s %12.0f %12.0f %12s\n", en->name, parse_ns, compile_ns, "");
+            continue;
+        }
+        regen_pattern * pattern;
+        regen_compile(&pattern, en->pattern, strlen(en->pattern), NULL);
+        double per_byte = time_generate(pattern);
+        regen_pattern_free(pattern);
+        add_metric(&m, 0, per_byte, "ns_per_byte/%s", en->name);
+        printf("%-20s %12.0f %12.0f %12.3f\n", en->name, parse_ns, compile_ns, per_byte);
+    }
+
+    printf("\n%-20s", "lines/s at threads");
+    for (i = 0; i < nthreads; i++) {
+        printf(" %12d", threads[i]);
+    }
+    printf(" %12s\n", "peak RSS KB");
+    for (e = 0; e < count; e++) {
+        const struct entry * en = &entries[e];
+        regen_pattern * pattern;
+        if (!en->macro) {
+            continue;
+        }
+        regen_compile(&pattern, en->pattern, strlen(en->pattern), NULL);
+        long rss = run_macro(pattern, threads, nthreads, rates);
+        regen_pattern_free(pattern);
+        printf("%-20s", en->name);
+        for (i = 0; i < nthreads; i++) {
+            add_metric(&m, 1, rates[i], "lines_per_sec/%s/%d", en->name, threads[i]);
+            printf(" %12.0f", rates[i]);
+        }
+        add_metric(&m, 0, (double)rss, "peak_rss_kb/%s", en->name);
+        printf(" %12ld\n", rss);
+    }
+
+    write_results(argv[argc - 1], &m, maxthreads);
+    printf("\nWrote %s.\n", argv[argc - 1]);
+    int regressions = baseline ? compare(baseline, &m, tolerance) : -1;
+    if (baseline && regressions < 0) {
+        printf("No baseline at %s yet; make bench-baseline keeps these results as one.\n", baseline);
+    }
+
+    for (e = 0; e < count; e++) {
+        free(entries[e].pattern);
+    }
+    free(entries);
+    free(rates);
+    free(m.list);
+    if (regressions > 0) {
+        printf("\nFAILED: %d figure%s regressed by more than %.0f%%.\n", regressions, regressions == 1 ? "" : "s",
+               tolerance * 100);
+        return 3;
+    }
+    return 0;
+}
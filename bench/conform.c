@@ -0,0 +1,528 @@
+//
+//  conform.c
+//  regen
+//  Checks the strings regen generates against the C library's regcomp/regexec and regen's own matcher, and times
+//  generating and checking them (make conform).
+//
+
+#include "../src/regen.h"
+#include "../src/global.h"
+#include <regex.h>
+#include <stdint.h>
+
+/*
+ Each pattern of the corpus is translated into a POSIX extended regex by hand, without regen's parser, so that a
+ mistake in the parser, the generator or the matcher shows up as a disagreement instead of being repeated on both
+ sides.  The translation follows regen's dialect (see rdparser.c and Usage.md):
+ - | joins the single elements on either side of it, so a|bc is (a|b)c;
+ - {n:m} is {n,m};
+ - . and [^...] take their characters from NOT_BASE_CHARACTER_SET, not from every byte, and \s is a space or a tab;
+ - \n and \t are a newline and a tab, and \ before anything else makes it plain.
+ Character classes are written out member by member, so the C library's locale and collation can't change them.
+
+ For every pattern, SAMPLES strings are generated and each is checked three ways: regen made it, so it should match;
+ regexec says whether the translation matches it; regen_match says whether regen's matcher does.  Each string is then
+ changed in one place (a character replaced, removed or added) and both matchers are asked again, where they should
+ agree.  A string they disagree on is cut down, a piece at a time, to the shortest one they still disagree on.
+ */
+
+//Strings shown for each pattern that has mismatches.
+#ifndef CONFORM_EXAMPLES
+#define CONFORM_EXAMPLES 3
+#endif
+
+#ifndef CONFORM_DEFAULT_SAMPLES
+#define CONFORM_DEFAULT_SAMPLES 10000
+#endif
+
+//The chance that * and + repeat once more, as regen uses without -p.
+#ifndef CONFORM_P
+#define CONFORM_P .9
+#endif
+
+struct text {
+    char * data;
+    size_t length;
+    size_t size;
+};
+
+static void append(struct text * t, const char * s, size_t length) {
+    if (t->length + length + 1 > t->size) {
+        t->size = (t->length + length + 1) * 2;
+        t->data = (char *)realloc(t->data, t->size);
+        if (t->data == NULL) { printf("realloc failure.\n"); exit(1); }
+    }
+    memcpy(t->data + t->length, s, length);
+    t->length += length;
+    t->data[t->length] = '\0';
+}
+
+static void append_char(struct text * t, char c) {
+    append(t, &c, 1);
+}
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static uint64_t next_random(uint64_t * x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/* ---------- Translating regen's dialect into POSIX extended regexes ---------- */
+
+static void set_universe(unsigned char * set) {
+    const char * c = NOT_BASE_CHARACTER_SET;
+    memset(set, 0, 256);
+    for (; *c; c++) {
+        set[(unsigned char)*c] = 1;
+    }
+}
+
+//Adds the class \c to set.  @return 0 if \c isn't a class.
+static int set_escape(unsigned char * set, char c) {
+    unsigned char class[256];
+    int i = 0;
+    memset(class, 0, 256);
+    switch (c) {
+        case 'd': case 'D':
+            for (i = '0'; i <= '9'; i++) { class[i] = 1; }
+            break;
+        case 'w': case 'W':
+            for (i = 0; i < 256; i++) {
+                class[i] = (i >= 'a' && i <= 'z') || (i >= 'A' && i <= 'Z') || (i >= '0' && i <= '9') || i == '_';
+            }
+            break;
+        case 's': case 'S':
+            class[' '] = 1;
+            class['\t'] = 1;
+            break;
+        default:
+            return 0;
+    }
+    if (c == 'D' || c == 'W' || c == 'S') {
+        unsigned char universe[256];
+        set_universe(universe);
+        for (i = 0; i < 256; i++) {
+            class[i] = universe[i] && !class[i];
+        }
+    }
+    for (i = 0; i < 256; i++) {
+        set[i] |= class[i];
+    }
+    return 1;
+}
+
+//Reads one character, which may be escaped.
+static char plain(const char * regex, size_t length, size_t * i) {
+    if (regex[*i] == '\\' && *i + 1 < length) {
+        *i += 2;
+        return regex[*i - 1] == 'n' ? '\n' : regex[*i - 1] == 't' ? '\t' : regex[*i - 1];
+    }
+    return regex[(*i)++];
+}
+
+static void write_char(struct text * out, unsigned char c) {
+    if (strchr(".[\\()*+?{|^$", c) && c != '\0') {
+        append_char(out, '\\');
+    }
+    append_char(out, (char)c);
+}
+
+/*
+ Writes set as one character or a bracket expression.  ] goes first and - last, where they are plain, and [ goes
+ just before the -, so it can't start [. [= or [:.
+ */
+static void write_set(struct text * out, const unsigned char * set) {
+    int count = 0;
+    int c = 0;
+    for (; c < 256; c++) {
+        count += set[c];
+    }
+    if (count == 1) {
+        for (c = 0; !set[c]; c++);
+        write_char(out, (unsigned char)c);
+        return;
+    }
+    append_char(out, '[');
+    if (set[']']) { append_char(out, ']'); }
+    for (c = 1; c < 256; c++) {
+        if (set[c] && c != ']' && c != '^' && c != '[' && c != '-') {
+            append_char(out, (char)c);
+        }
+    }
+    if (set['^']) { append_char(out, '^'); }
+    if (set['[']) { append_char(out, '['); }
+    if (set['-']) { append_char(out, '-'); }
+    append_char(out, ']');
+}
+
+static void translate_sequence(const char * regex, size_t length, size_t * i, struct text * out);
+
+//Translates one element: a group, a class, . or one character.
+static void translate_element(const char * regex, size_t length, size_t * i, struct text * out) {
+    unsigned char set[256];
+    memset(set, 0, 256);
+
+    if (regex[*i] == '(') {
+        *i += 1;
+        append_char(out, '(');
+        translate_sequence(regex, length, i, out);
+        append_char(out, ')');
+        *i += 1;
+        return;
+    }
+    if (regex[*i] == '.') {
+        *i += 1;
+        set_universe(set);
+    } else if (regex[*i] == '\\' && *i + 1 < length && set_escape(set, regex[*i + 1])) {
+        *i += 2;
+    } else if (regex[*i] == '[') {
+        int negated = regex[*i + 1] == '^';
+        *i += negated ? 2 : 1;
+        while (*i < length && regex[*i] != ']') {
+            if (regex[*i] == '\\' && *i + 1 < length && set_escape(set, regex[*i + 1])) {
+                *i += 2;
+                continue;
+            }
+            unsigned char low = (unsigned char)plain(regex, length, i);
+            if (regex[*i] == '-' && *i + 1 < length && regex[*i + 1] != ']') {
+                *i += 1;
+                int high = (unsigned char)plain(regex, length, i);
+                int c = low;
+                for (; c <= high; c++) {
+                    set[c] = 1;
+                }
+            } else {
+                set[low] = 1;
+            }
+        }
+        *i += 1;
+        if (negated) {
+            unsigned char universe[256];
+            int c = 0;
+            set_universe(universe);
+            for (; c < 256; c++) {
+                set[c] = universe[c] && !set[c];
+            }
+        }
+    } else {
+        write_char(out, (unsigned char)plain(regex, length, i));
+        return;
+    }
+    write_set(out, set);
+}
+
+//Translates elements and their operators up to the end of the regex or a ).
+static void translate_sequence(const char * regex, size_t length, size_t * i, struct text * out) {
+    while (*i < length && regex[*i] != ')') {
+        struct text element = {NULL, 0, 0};
+        translate_element(regex, length, i, &element);
+
+        if (*i < length && (regex[*i] == '*' || regex[*i] == '+' || regex[*i] == '?')) {
+            append(out, element.data, element.length);
+            append_char(out, regex[(*i)++]);
+        } else if (*i < length && regex[*i] == '{') {
+            append(out, element.data, element.length);
+            for (; regex[*i] != '}'; (*i)++) {
+                append_char(out, regex[*i] == ':' ? ',' : regex[*i]);
+            }
+            append_char(out, '}');
+            *i += 1;
+        } else if (*i < length && regex[*i] == '|') {
+            append_char(out, '(');
+            append(out, element.data, element.length);
+            while (*i < length && regex[*i] == '|') {
+                *i += 1;
+                append_char(out, '|');
+                translate_element(regex, length, i, out);
+            }
+            append_char(out, ')');
+        } else {
+            append(out, element.data, element.length);
+        }
+        free(element.data);
+    }
+}
+
+//@return the POSIX extended regex for the whole of a regen regex, anchored at both ends.  Free it with free.
+static char * translate(const char * regex, size_t length) {
+    struct text out = {NULL, 0, 0};
+    size_t i = 0;
+    append(&out, "^(", 2);
+    translate_sequence(regex, length, &i, &out);
+    append(&out, ")$", 2);
+    return out.data;
+}
+
+/* ---------- Checking ---------- */
+
+struct checkers {
+    regex_t posix;
+    regen_matcher * matcher;
+};
+
+static int posix_match(const struct checkers * k, const char * s) {
+    return regexec(&k->posix, s, 0, NULL, 0) == 0;
+}
+
+static int regen_matches(const struct checkers * k, const char * s) {
+    return regen_match(k->matcher, s, strlen(s));
+}
+
+static int disagree(const struct checkers * k, const char * s) {
+    return posix_match(k, s) != regen_matches(k, s);
+}
+
+/*
+ Cuts s down while the matchers still disagree on it: first by removing pieces of half its length, then of a quarter,
+ and so on down to single characters, trying each place in turn.  s is changed in place.
+ */
+static void shrink(const struct checkers * k, char * s) {
+    size_t length = strlen(s);
+    size_t piece = length / 2 ? length / 2 : 1;
+    char * trial = (char *)malloc(length + 1);
+    if (trial == NULL) { printf("malloc failure.\n"); exit(1); }
+
+    while (piece > 0 && length > 0) {
+        size_t at = 0;
+        int cut = 0;
+        while (at + piece <= length) {
+            memcpy(trial, s, at);
+            memcpy(trial + at, s + at + piece, length - at - piece + 1);
+            if (disagree(k, trial)) {
+                memcpy(s, trial, length - piece + 1);
+                length -= piece;
+                cut = 1;
+            } else {
+                at++;
+            }
+        }
+        if (!cut) {
+            piece /= 2;
+        }
+    }
+    free(trial);
+}
+
+//Writes s in double quotes, with anything unprintable escaped.
+static void print_quoted(const char * s) {
+    putchar('"');
+    for (; *s; s++) {
+        if (*s == '\n') { printf("\\n"); }
+        else if (*s == '\t') { printf("\\t"); }
+        else if (*s == '"' || *s == '\\') { printf("\\%c", *s); }
+        else if ((unsigned char)*s < 32 || (unsigned char)*s > 126) { printf("\\x%02x", (unsigned char)*s); }
+        else { putchar(*s); }
+    }
+    putchar('"');
+}
+
+static void report(const struct checkers * k, const char * what, char * s) {
+    if (disagree(k, s)) {
+        shrink(k, s);
+    }
+    printf("    %s: ", what);
+    print_quoted(s);
+    printf(" (regexec %s, regen_match %s)\n", posix_match(k, s) ? "matches" : "doesn't match",
+           regen_matches(k, s) ? "matches" : "doesn't match");
+}
+
+//Changes s, of length characters with room for one more, in one place.  @return its new length.
+static size_t mutate(char * s, size_t length, uint64_t * x) {
+    static const char pool[] = NOT_BASE_CHARACTER_SET " \t";
+    char c = pool[next_random(x) % (sizeof(pool) - 1)];
+    size_t at = length ? next_random(x) % (length + 1) : 0;
+    int how = length ? (int)(next_random(x) % 3) : 2;
+
+    if (how == 0 && at < length) {
+        s[at] = c;
+    } else if (how == 1 && at < length) {
+        memmove(s + at, s + at + 1, length - at);
+        return length - 1;
+    } else {
+        memmove(s + at + 1, s + at, length - at + 1);
+        s[at] = c;
+        return length + 1;
+    }
+    return length;
+}
+
+struct totals {
+    unsigned long patterns;
+    unsigned long skipped;
+    unsigned long failed;
+    unsigned long strings;
+    unsigned long mismatches;
+};
+
+/*
+ Generates samples strings from regex, checks them, and prints a line of results and any mismatches.
+ */
+static void conform(const char * regex, unsigned long samples, uint64_t seed, struct totals * totals) {
+    size_t length = strlen(regex);
+    struct regen_error error;
+    regen_pattern * pattern;
+    regen_state * state;
+    struct checkers k;
+    char * ere;
+    int status;
+
+    totals->patterns++;
+    if ((status = regen_compile(&pattern, regex, length, &error)) != REGEN_OK) {
+        printf("%-40s  skipped: %s\n", regex, status == REGEN_ESYNTAX ? error.message : regen_strerror(status));
+        totals->skipped++;
+        return;
+    }
+    if ((status = regen_matcher_create(&k.matcher, regex, length, &error)) != REGEN_OK) {
+        printf("%-40s  skipped: matcher: %s\n", regex, regen_strerror(status));
+        regen_pattern_free(pattern);
+        totals->skipped++;
+        return;
+    }
+    ere = translate(regex, length);
+    if ((status = regcomp(&k.posix, ere, REG_EXTENDED | REG_NOSUB)) != 0) {
+        char message[256];
+        regerror(status, &k.posix, message, sizeof(message));
+        printf("%-40s  skipped: regcomp: %s\n", regex, message);
+        regen_matcher_free(k.matcher);
+        regen_pattern_free(pattern);
+        free(ere);
+        totals->skipped++;
+        return;
+    }
+    if (regen_state_create(&state, CONFORM_P, seed) != REGEN_OK) {
+        printf("Invalid CONFORM_P.\n");
+        exit(2);
+    }
+
+    //Generate every sample first, so each phase is timed on its own.
+    struct text strings = {NULL, 0, 0};
+    size_t * starts = (size_t *)malloc((samples + 1) * sizeof(size_t));
+    if (starts == NULL) { printf("malloc failure.\n"); exit(1); }
+    unsigned long i = 0;
+    double began = now();
+    for (; i < samples; i++) {
+        size_t n;
+        const char * s = regen_generate(pattern, state, &n);
+        starts[i] = strings.length;
+        append(&strings, s, n);
+        append_char(&strings, '\0');
+    }
+    starts[samples] = strings.length;
+    double generating = now() - began;
+    size_t bytes = strings.length - samples;
+
+    unsigned long posix_rejected = 0;
+    unsigned long regen_rejected = 0;
+    began = now();
+    for (i = 0; i < samples; i++) {
+        posix_rejected += !posix_match(&k, strings.data + starts[i]);
+    }
+    double posix_time = now() - began;
+    began = now();
+    for (i = 0; i < samples; i++) {
+        const char * s = strings.data + starts[i];
+        regen_rejected += !regen_match(k.matcher, s, starts[i + 1] - starts[i] - 1);
+    }
+    double regen_time = now() - began;
+
+    //Strings changed in one place, which the two matchers should agree on.
+    unsigned long disagreements = 0;
+    uint64_t x = seed;
+    char * mutant = (char *)malloc(strings.size + 2);
+    if (mutant == NULL) { printf("malloc failure.\n"); exit(1); }
+    for (i = 0; i < samples; i++) {
+        size_t n = starts[i + 1] - starts[i] - 1;
+        memcpy(mutant, strings.data + starts[i], n + 1);
+        mutate(mutant, n, &x);
+        disagreements += disagree(&k, mutant);
+    }
+
+    unsigned long bad = posix_rejected + regen_rejected + disagreements;
+    printf("%-40s  %8lu  %9.4f%%  %12.0f  %9.1f  %10.1f  %10.1f\n", regex, samples,
+           100.0 * bad / (3.0 * samples), samples / generating, bytes / generating / 1e6,
+           bytes / posix_time / 1e6, bytes / regen_time / 1e6);
+    totals->strings += 3 * samples;
+    totals->mismatches += bad;
+    if (bad) {
+        int examples = 0;
+        totals->failed++;
+        printf("    translated: %s\n", ere);
+        printf("    %lu generated strings regexec rejects, %lu regen_match rejects, %lu changed strings they disagree on\n",
+               posix_rejected, regen_rejected, disagreements);
+        for (i = 0; i < samples && examples < CONFORM_EXAMPLES; i++) {
+            char * s = strings.data + starts[i];
+            if (!posix_match(&k, s) || !regen_matches(&k, s)) {
+                report(&k, "generated", s);
+                examples++;
+            }
+        }
+        x = seed;
+        for (i = 0; i < samples && examples < CONFORM_EXAMPLES; i++) {
+            size_t n = starts[i + 1] - starts[i] - 1;
+            memcpy(mutant, strings.data + starts[i], n + 1);
+            mutate(mutant, n, &x);
+            if (disagree(&k, mutant)) {
+                report(&k, "changed", mutant);
+                examples++;
+            }
+        }
+    }
+
+    free(mutant);
+    free(starts);
+    free(strings.data);
+    free(ere);
+    regfree(&k.posix);
+    regen_state_free(state);
+    regen_matcher_free(k.matcher);
+    regen_pattern_free(pattern);
+}
+
+int main(int argc, const char * argv[]) {
+    unsigned long samples = CONFORM_DEFAULT_SAMPLES;
+    uint64_t seed = REGEN_DEFAULT_SEED;
+    struct totals totals = {0, 0, 0, 0, 0};
+    char line[4096];
+    FILE * corpus;
+
+    if (argc < 2 || argc > 4) {
+        printf("Usage: conform corpus [samples [seed]]\n");
+        printf("Each line of corpus is a pattern; blank lines and lines starting with # are skipped.\n");
+        exit(2);
+    }
+    if (argc > 2 && (samples = strtoul(argv[2], NULL, 10)) == 0) {
+        printf("Invalid number of samples \"%s\".\n", argv[2]);
+        exit(2);
+    }
+    if (argc > 3) {
+        seed = strtoull(argv[3], NULL, 0);
+    }
+    if ((corpus = fopen(argv[1], "r")) == NULL) {
+        printf("Unable to open file \"%s\".\n", argv[1]);
+        exit(2);
+    }
+
+    printf("%-40s  %8s  %10s  %12s  %9s  %10s  %10s\n", "pattern", "samples", "mismatch", "gen lines/s", "gen MB/s",
+           "posix MB/s", "regen MB/s");
+    while (fgets(line, sizeof(line), corpus)) {
+        size_t length = strcspn(line, "\r\n");
+        line[length] = '\0';
+        if (length == 0 || line[0] == '#') {
+            continue;
+        }
+        conform(line, samples, seed, &totals);
+    }
+    fclose(corpus);
+
+    printf("\n%lu patterns, %lu skipped, %lu with mismatches; %lu of %lu strings mismatched (%.4f%%).\n",
+           totals.patterns, totals.skipped, totals.failed, totals.mismatches, totals.strings,
+           totals.strings ? 100.0 * totals.mismatches / totals.strings : 0.0);
+    return totals.mismatches ? 3 : 0;
+}
@@ -0,0 +1,94 @@
+//
+//  arena.c
+//  regen
+//  A bump allocator that owns all of the memory used by one parse tree.
+//
+
+#include "arena.h"
+#include "stats.h"
+
+/*
+ The parser allocates a lot of small things: a token per node, its code array, its element array and a wrapper
+ token for every child.  Allocating each with malloc scatters the tree across the heap and makes tearing it down
+ a second walk over the whole tree.  Instead, everything is carved out of large blocks, one after the other, and
+ the whole tree is released with arena_destroy.
+
+ Blocks come from calloc, and memory is never handed out twice, so every allocation starts out zeroed just like
+ calloc would give.  Block sizes double (up to MAX_ARENA_BLOCK_SIZE) so large patterns need few blocks.
+ */
+
+//Every allocation is aligned well enough for any of the types the parser stores.
+#define ARENA_ALIGN(n) (((n) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+static struct arena_block * new_block(struct arena_block * prev, size_t size) {
+    struct arena_block * block = (struct arena_block *)calloc(1, sizeof(struct arena_block) + size);
+    if (block == NULL) { printf("calloc failure.\n"); exit(1); }
+    block->prev = prev;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+struct arena * arena_create() {
+    struct arena * a = (struct arena *)malloc(sizeof(struct arena));
+    if (a == NULL) { printf("malloc failure.\n"); exit(1); }
+    a->head = new_block(NULL, DEFAULT_ARENA_BLOCK_SIZE);
+    a->last = NULL;
+    return a;
+}
+
+/*
+ @param a the arena to allocate from
+ @param size the number of bytes needed
+ @return a pointer to size zeroed bytes, valid until the arena is destroyed.
+ */
+void * arena_alloc(struct arena * a, size_t size) {
+    STATS_ALLOC();
+    size = ARENA_ALIGN(size);
+    if (a->head->used + size > a->head->size) {
+        size_t blocksize = a->head->size < MAX_ARENA_BLOCK_SIZE ? a->head->size * 2 : a->head->size;
+        if (blocksize < size) {
+            blocksize = size;
+        }
+        a->head = new_block(a->head, blocksize);
+    }
+    void * ptr = a->head->data + a->head->used;
+    a->head->used += size;
+    a->last = ptr;
+    return ptr;
+}
+
+/*
+ Grows an allocation from oldsize to newsize bytes.  The most recent allocation is extended in place when the block
+ has room; anything else is copied to a fresh allocation (the old space is reclaimed with the rest of the arena).
+ The new bytes are zeroed.
+ */
+void * arena_realloc(struct arena * a, void * ptr, size_t oldsize, size_t newsize) {
+    if (ptr == NULL) {
+        return arena_alloc(a, newsize);
+    }
+    STATS_REALLOC();
+    if (ptr == a->last) {
+        size_t offset = (char *)ptr - a->head->data;
+        if (offset + ARENA_ALIGN(newsize) <= a->head->size) {
+            a->head->used = offset + ARENA_ALIGN(newsize);
+            return ptr;
+        }
+    }
+    void * grown = arena_alloc(a, newsize);
+    memcpy(grown, ptr, oldsize);
+    return grown;
+}
+
+/*
+ Releases every allocation made from the arena, and the arena itself.
+ */
+void arena_destroy(struct arena * a) {
+    struct arena_block * block = a->head;
+    while (block) {
+        struct arena_block * prev = block->prev;
+        free(block);
+        block = prev;
+    }
+    free(a);
+}
@@ -0,0 +1,38 @@
+//
+//  arena.h
+//  regen
+//
+//  A bump allocator that owns all of the memory used by one parse tree.
+//
+
+#include "global.h"
+
+#ifndef arena_h
+#define arena_h
+
+struct arena_block {
+    struct arena_block * prev;
+    size_t size;  //of data
+    size_t used;
+    char data[];
+};
+
+struct arena {
+    struct arena_block * head;  //The block currently being allocated from.
+    void * last;                //The most recent allocation, which arena_realloc can grow in place.
+};
+
+struct arena * arena_create(void);
+void * arena_alloc(struct arena * a, size_t size);
+void * arena_realloc(struct arena * a, void * ptr, size_t oldsize, size_t newsize);
+void arena_destroy(struct arena * a);
+
+#endif /* arena_h */
+
+#ifndef DEFAULT_ARENA_BLOCK_SIZE
+#define DEFAULT_ARENA_BLOCK_SIZE 4096
+#endif
+
+#ifndef MAX_ARENA_BLOCK_SIZE
+#define MAX_ARENA_BLOCK_SIZE (1 << 24)
+#endif
@@ -0,0 +1,346 @@
+//
+//  batch.c
+//  regen
+//  Generates samples from many patterns, read from a file, in one run.
+//
+
+#include "batch.h"
+#include "regen.h"
+#include "strbuf.h"
+#include <pthread.h>
+#include <fcntl.h>
+#include <errno.h>
+
+/*
+ --patterns reads one pattern per line and generates -l samples from each, so a whole list of patterns costs one
+ process, one seeding and one pass over the arguments instead of one of each per pattern.  Blank lines are skipped, but
+ still counted, so a pattern is always known by its line number in the file.
+
+ Workers claim patterns one at a time, compile them and generate all of their samples into a buffer of their own.
+ A pattern that doesn't compile is reported on stderr, with its line number, and the run goes on with the next one.
+ Samples are written one of two ways:
+ * tagged: every sample is written as "line<TAB>sample" to the output.  In ordered mode a worker waits for the
+   patterns before its own to be written first, so the output is in file order for any number of threads.
+ * with --out-dir: the samples of the pattern on line n go to the file n.txt in that directory, untagged.
+
+ Pattern n is generated with a seed derived from the run's seed and n, so its samples don't depend on which thread
+ generated it or on the patterns before it.
+
+ compile_batch compiles a pattern file into a cache file instead (--compile-to), and a later run can take its patterns
+ from the cache (--load), each already compiled and tagged with the line it came from.
+ */
+
+struct batch_state {
+    const struct batch_job * job;
+    char ** patterns;          //Unless the patterns come from a cache.
+    unsigned long * numbers;   //Line number of each pattern in the file.
+    unsigned long count;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    unsigned long next_pattern;  //Next pattern to be claimed by a worker.
+    unsigned long next_write;    //Next pattern whose samples are written (ordered mode).
+    unsigned long failed;
+    struct regen_budget_counts counts;
+};
+
+/*
+ Reads every non-blank line of the file into st, without its line ending.
+ */
+static void read_patterns(struct batch_state * st, const char * file) {
+    FILE * in = strcmp(file, "-") ? fopen(file, "r") : stdin;
+    char * line = NULL;
+    size_t len = 0;
+    ssize_t n;
+    unsigned long number = 0;
+    unsigned long size = 0;
+
+    if (in == NULL) {
+        printf("Could not open pattern file \"%s\".\n", file);
+        exit(2);
+    }
+    st->patterns = NULL;
+    st->numbers = NULL;
+    st->count = 0;
+    while ((n = getline(&line, &len, in)) != -1) {
+        number++;
+        while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r')) {
+            line[--n] = '\0';
+        }
+        if (n == 0) {
+            continue;
+        }
+        if (st->count == size) {
+            size = size ? size * 2 : 1024;
+            st->patterns = (char **)realloc(st->patterns, size * sizeof(char *));
+            st->numbers = (unsigned long *)realloc(st->numbers, size * sizeof(unsigned long));
+            if (st->patterns == NULL || st->numbers == NULL) { printf("realloc failure.\n"); exit(1); }
+        }
+        st->patterns[st->count] = strdup(line);
+        if (st->patterns[st->count] == NULL) { printf("strdup failure.\n"); exit(1); }
+        st->numbers[st->count] = number;
+        st->count++;
+    }
+    free(line);
+    if (in != stdin) {
+        fclose(in);
+    }
+}
+
+//Reports a pattern that could not be compiled on stderr.
+static void report(unsigned long number, const struct regen_error * error) {
+    if (error->position >= 0) {
+        fprintf(stderr, "Line %lu, character %ld: %s\n", number, error->position + 1, error->message);
+    } else {
+        fprintf(stderr, "Line %lu: %s\n", number, error->message);
+    }
+}
+
+static int compile_pattern(const struct batch_job * job, regen_pattern ** pattern, const char * regex,
+                           struct regen_error * error) {
+    if (job->enumerate) {
+        return regen_compile_enumerate(pattern, regex, strlen(regex), job->longest, job->order, error);
+    }
+    if (job->uniform) {
+        return regen_compile_uniform(pattern, regex, strlen(regex), job->minlength, job->maxlength, error);
+    }
+    if (job->bounded) {
+        return regen_compile_bounded(pattern, regex, strlen(regex), job->minlength, job->maxlength, error);
+    }
+    return regen_compile(pattern, regex, strlen(regex), error);
+}
+
+//Adds one worker's budget counts to the run's.  The caller holds the lock.
+static void add_counts(struct batch_state * st, const struct regen_budget_counts * counts) {
+    st->counts.truncated += counts->truncated;
+    st->counts.resampled += counts->resampled;
+    st->counts.failed += counts->failed;
+}
+
+/*
+ Writes the samples of pattern i, tagged, to the output.  In ordered mode, waits until every pattern before it is out.
+ */
+static void write_tagged(struct batch_state * st, unsigned long i, const struct strbuf * buf) {
+    pthread_mutex_lock(&st->lock);
+    while (st->job->ordered && st->next_write != i) {
+        pthread_cond_wait(&st->changed, &st->lock);
+    }
+    write_all(st->job->fd, buf->data, buf->length);
+    st->next_write++;
+    pthread_cond_broadcast(&st->changed);
+    pthread_mutex_unlock(&st->lock);
+}
+
+/*
+ Writes the samples of pattern i to their own file in the output directory.
+ */
+static void write_file(struct batch_state * st, unsigned long i, const regen_pattern * pattern) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%lu.txt", st->job->dir, st->numbers[i]);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1) {
+        printf("Could not open \"%s\": %s.\n", path, strerror(errno));
+        exit(1);
+    }
+    struct regen_lines run;
+    struct regen_budget_counts counts;
+    run.p = st->job->pval;
+    run.seed = regen_stream_seed(st->job->seed, st->numbers[i]);
+    run.start = st->job->start;
+    run.count = st->job->lines;
+    run.threads = 1;
+    run.ordered = 1;
+    run.preallocate = 0;
+    run.unique = 0;
+    run.false_positive = 0;
+    run.space = 0;
+    run.max_bytes = st->job->maxbytes;
+    run.max_steps = st->job->maxsteps;
+    run.budget_policy = st->job->policy;
+    run.counts = &counts;
+    run.stats = NULL;
+    run.verify = NULL;
+    run.mismatches = NULL;
+    regen_write_lines(pattern, &run, fd, NULL);
+    close(fd);
+    pthread_mutex_lock(&st->lock);
+    add_counts(st, &counts);
+    pthread_mutex_unlock(&st->lock);
+}
+
+static void * batch_worker(void * arg) {
+    struct batch_state * st = (struct batch_state *)arg;
+    const struct batch_job * job = st->job;
+    struct strbuf buf = {NULL, 0, 0};
+    char tag[32];
+    regen_state * state;
+    unsigned long i;
+    unsigned long k;
+
+    if (regen_state_create(&state, job->pval, job->seed) != REGEN_OK) {
+        printf("Invalid decimal value for -p.\n");
+        exit(2);
+    }
+    regen_state_budget(state, job->maxbytes, job->maxsteps, job->policy);
+    for (;;) {
+        pthread_mutex_lock(&st->lock);
+        i = st->next_pattern++;
+        pthread_mutex_unlock(&st->lock);
+        if (i >= st->count) {
+            break;
+        }
+
+        const regen_pattern * pattern;
+        regen_pattern * compiled = NULL;
+        struct regen_error error;
+        buf.length = 0;
+        if (job->cache) {
+            pattern = regen_cache_pattern(job->cache, i);
+        } else if (compile_pattern(job, &compiled, st->patterns[i], &error) == REGEN_OK) {
+            pattern = compiled;
+        } else {
+            pthread_mutex_lock(&st->lock);
+            report(st->numbers[i], &error);
+            st->failed++;
+            pthread_mutex_unlock(&st->lock);
+            if (!job->dir) {
+                write_tagged(st, i, &buf);  //Nothing to write, but the patterns after it may be waiting for it.
+            }
+            continue;
+        }
+
+        if (job->dir) {
+            write_file(st, i, pattern);
+        } else {
+            uint64_t seed = regen_stream_seed(job->seed, st->numbers[i]);
+            int taglen = snprintf(tag, sizeof(tag), "%lu\t", st->numbers[i]);
+            for (k = 0; k < job->lines; k++) {
+                size_t length;
+                regen_state_seed(state, seed, job->start + k);
+                const char * sample = regen_generate(pattern, state, &length);
+                if (sample == NULL && regen_enumerate_count(pattern)) {
+                    break;  //An enumerated pattern's list has ended.
+                }
+                if (sample == NULL) {
+                    continue;  //Over its budget, and given up on.
+                }
+                char * at = strbuf_reserve(&buf, taglen + length + 1);
+                memcpy(at, tag, taglen);
+                memcpy(at + taglen, sample, length);
+                at[taglen + length] = '\n';
+                buf.length += taglen + length + 1;
+            }
+            write_tagged(st, i, &buf);
+        }
+        regen_pattern_free(compiled);
+    }
+    struct regen_budget_counts counts;
+    regen_state_counts(state, &counts);
+    pthread_mutex_lock(&st->lock);
+    add_counts(st, &counts);
+    pthread_mutex_unlock(&st->lock);
+    regen_state_free(state);
+    strbuf_free(&buf);
+    return NULL;
+}
+
+/*
+ @param job describes the run: the pattern file, how many samples of each, the seed, and where they go.
+ @return the number of patterns that could not be compiled.  The others have all been written.
+ */
+unsigned long run_batch(const struct batch_job * job) {
+    struct batch_state st;
+    unsigned long i = 0;
+
+    if (job->cache) {
+        st.patterns = NULL;
+        st.count = regen_cache_count(job->cache);
+        st.numbers = (unsigned long *)malloc((st.count ? st.count : 1) * sizeof(unsigned long));
+        if (st.numbers == NULL) { printf("malloc failure.\n"); exit(1); }
+        for (; i < st.count; i++) {
+            st.numbers[i] = regen_cache_tag(job->cache, i);
+        }
+    } else {
+        read_patterns(&st, job->file);
+    }
+    st.job = job;
+    st.next_pattern = 0;
+    st.next_write = 0;
+    st.failed = 0;
+    memset(&st.counts, 0, sizeof(st.counts));
+    pthread_mutex_init(&st.lock, NULL);
+    pthread_cond_init(&st.changed, NULL);
+
+    if (job->threads <= 1) {
+        batch_worker(&st);
+    } else {
+        pthread_t * workers = (pthread_t *)malloc(job->threads * sizeof(pthread_t));
+        if (workers == NULL) { printf("malloc failure.\n"); exit(1); }
+        for (i = 0; i < job->threads; i++) {
+            if (pthread_create(&workers[i], NULL, batch_worker, &st)) {
+                printf("Could not start worker thread.\n");
+                exit(1);
+            }
+        }
+        for (i = 0; i < job->threads; i++) {
+            pthread_join(workers[i], NULL);
+        }
+        free(workers);
+    }
+
+    for (i = 0; st.patterns && i < st.count; i++) {
+        free(st.patterns[i]);
+    }
+    free(st.patterns);
+    free(st.numbers);
+    pthread_mutex_destroy(&st.lock);
+    pthread_cond_destroy(&st.changed);
+    if (job->counts) {
+        *job->counts = st.counts;
+    }
+    return st.failed;
+}
+
+/*
+ @param file the pattern file, one pattern per line.  "-" is stdin.
+ @param path the cache file to write, for --load.
+ @return the number of patterns that could not be compiled.  They are reported on stderr and left out of the cache.
+ */
+unsigned long compile_batch(const char * file, const char * path) {
+    struct batch_state st;
+    unsigned long failed = 0;
+    unsigned long kept = 0;
+    unsigned long i = 0;
+
+    read_patterns(&st, file);
+    regen_pattern ** compiled = (regen_pattern **)malloc((st.count ? st.count : 1) * sizeof(regen_pattern *));
+    if (compiled == NULL) { printf("malloc failure.\n"); exit(1); }
+    for (; i < st.count; i++) {
+        struct regen_error error;
+        if (regen_compile(&compiled[kept], st.patterns[i], strlen(st.patterns[i]), &error) != REGEN_OK) {
+            report(st.numbers[i], &error);
+            failed++;
+            free(st.patterns[i]);
+            continue;
+        }
+        //Pack the patterns that compiled to the front, with their sources and line numbers.
+        st.patterns[kept] = st.patterns[i];
+        st.numbers[kept] = st.numbers[i];
+        kept++;
+    }
+
+    if (regen_cache_write(path, (const regen_pattern * const *)compiled, (const char * const *)st.patterns,
+                          st.numbers, kept, REGEN_CACHE_BATCH) != REGEN_OK) {
+        printf("Could not write \"%s\": %s\n", path, strerror(errno));
+        exit(1);
+    }
+
+    for (i = 0; i < kept; i++) {
+        regen_pattern_free(compiled[i]);
+        free(st.patterns[i]);
+    }
+    free(compiled);
+    free(st.patterns);
+    free(st.numbers);
+    return failed;
+}
@@ -0,0 +1,42 @@
+//
+//  batch.h
+//  regen
+//  Generates samples from many patterns, read from a file, in one run.
+//
+
+#include "global.h"
+#include "regen.h"
+
+#ifndef batch_h
+#define batch_h
+
+#include <stdint.h>
+
+struct batch_job {
+    const char * file;      //One pattern per line.  "-" is stdin.
+    const regen_cache * cache;  //If set, the patterns come from here, already compiled, instead of from file.
+    double pval;
+    uint64_t seed;
+    unsigned long start;    //Index of the first sample of each pattern.
+    unsigned long lines;    //Samples per pattern.
+    int threads;
+    int ordered;            //Write the patterns' samples in file order, or as soon as they are done.
+    int fd;                 //Where tagged samples are written, when dir is NULL.
+    const char * dir;       //If set, each pattern's samples go to their own file in this directory instead.
+    int uniform;            //Pick samples uniformly from the strings of minlength to maxlength characters.
+    unsigned long minlength;
+    unsigned long maxlength;
+    int bounded;            //Or generate samples as usual, but only of minlength to maxlength characters.
+    int enumerate;          //List every string of each pattern instead, up to longest characters (-1 for no limit).
+    long longest;
+    int order;              //REGEN_ORDER_LENGTH or REGEN_ORDER_LEX
+    size_t maxbytes;        //The budget of each sample; see regen_state_budget.
+    unsigned long maxsteps;
+    int policy;
+    struct regen_budget_counts * counts;  //Set to how often samples went over their budget.
+};
+
+unsigned long run_batch(const struct batch_job * job);
+unsigned long compile_batch(const char * file, const char * path);
+
+#endif /* batch_h */
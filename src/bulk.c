@@ -0,0 +1,515 @@
+//
+//  bulk.c
+//  regen
+//  Generates many lines from one program, optionally spread across worker threads.
+//
+
+#include "bulk.h"
+#include "strgen.h"
+#include <pthread.h>
+#include <limits.h>
+
+/*
+ Every line draws from its own random stream, picked by the run's seed and the line's index.  The stream is a
+ counter-based one: seeding it is a few SplitMix64 steps on (seed, index), no matter how large the index is.  So the
+ text of line k depends only on the seed and k - never on which thread made it, or on the lines before it.  This is
+ what lets --start begin a run at any line without replaying the ones before it, and lets one logical run be split
+ over several processes or machines.
+
+ The lines of a run are cut into blocks of BULK_BLOCK_LINES, the unit of work.  Lines are generated straight into a
+ block buffer that is reused for the whole run, so the hot loop neither allocates nor formats anything, and output
+ leaves in large write() or writev() calls rather than through stdio, into space the file was given up front when it
+ is a regular file (see sink.c).  With one thread the calling thread generates blocks into one buffer and writes it
+ whenever it holds BULK_WRITE_SIZE bytes.
+
+ With more threads, workers take the next block number, generate the whole block into a buffer, and hand it over.
+ In ordered mode they hand it to a writer thread through a ring of 2 * threads slots; the writer writes every
+ consecutive finished block it finds with one writev(), in order, so the output is the same as with one thread.  A
+ worker only waits if the writer is a whole ring behind it.  In unordered mode a worker writes its block itself as
+ soon as it is done, which never waits on a slower worker but interleaves blocks in whatever order they finish.
+
+ With unique, blocks are made until enough new lines have been written, and each block has its repeats taken out
+ before it is written.  In ordered mode that is done by whoever writes, one block after another in order, so the
+ lines kept are the first of each, exactly as with one thread.  In unordered mode each worker checks its own block
+ against the shared set, whose shards have locks of their own, and only takes the write lock to write it.  The run
+ ends early once as many lines have been written as the pattern can make (job->space), or once UNIQUE_MAX_REPEATS
+ lines in a row have all been repeats.
+
+ With job->stats, each block's generation and each write is timed, and the lines are counted as they are written.  In
+ a stats build every thread that runs the program also counts its instructions, and adds them to the run's at the end.
+
+ With job->verify, every thread has a matcher of its own, and checks each line right after making it, while it is
+ still in the cache.
+ */
+
+struct slot {
+    struct strbuf buf;
+    unsigned long block;
+    int full;
+};
+
+struct bulk_state {
+    const struct bulk_job * job;
+    unsigned long blocks;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    unsigned long next_block;    //Next block to be claimed by a worker.
+    unsigned long next_write;    //Next block the writer will write (ordered mode).
+    struct slot * slots;
+    unsigned long nslots;
+
+    struct uniqset set;          //Lines written so far, with unique.
+    unsigned long written;
+    unsigned long repeats;       //Repeats since the last new line.
+    int done;                    //Set once unique has written enough, and no more blocks are needed.
+    struct budget_counts counts; //Added to by every block.
+    struct sink sink;            //Where blocks are written, by whoever holds the lock or is the writer.
+};
+
+/*
+ Counts a line that did not match the pattern, and keeps it if it comes before every other one found.
+ */
+static void mismatch(struct bulk_state * st, unsigned long index, const char * line, size_t length) {
+    struct regen_mismatches * found = st->job->mismatches;
+    if (st->job->threads > 1) {
+        pthread_mutex_lock(&st->lock);
+    }
+    if (found->count++ == 0 || index < found->first) {
+        found->first = index;
+        length = length < sizeof(found->line) - 1 ? length : sizeof(found->line) - 1;
+        memcpy(found->line, line, length);
+        found->line[length] = '\0';
+    }
+    if (st->job->threads > 1) {
+        pthread_mutex_unlock(&st->lock);
+    }
+}
+
+/*
+ Generates every line of block k onto the end of buf.  Lines the budget gives up on are left out.
+ @param check the thread's matcher, or NULL if lines are not checked.
+ */
+static void generate_block(struct bulk_state * st, unsigned long k, struct strbuf * buf, struct matcher * check) {
+    const struct bulk_job * job = st->job;
+    struct budget_counts counts = {0, 0, 0};
+    struct rng rng;
+    unsigned long first = k * BULK_BLOCK_LINES;
+    unsigned long count = job->lines - first < BULK_BLOCK_LINES ? job->lines - first : BULK_BLOCK_LINES;
+    if (job->unique) {
+        count = BULK_BLOCK_LINES;  //Blocks are made until enough of their lines are new.
+    }
+    unsigned long i = 0;
+    struct moment began;
+    if (job->stats) {
+        stats_start(&began);
+    }
+
+    if (job->enumeration) {
+        struct enum_iter it;
+        enum_iter_init(&it, job->enumeration);
+        enum_iter_seek(&it, job->start + first);
+        for (; i < count && !it.done; i++) {
+            char * at = strbuf_reserve(buf, it.length + 1);
+            memcpy(at, it.string, it.length);
+            at[it.length] = '\n';
+            buf->length += it.length + 1;
+            if (check && !matcher_match(check, it.string, it.length)) {
+                mismatch(st, job->start + first + i, it.string, it.length);
+            }
+            enum_iter_next(&it);
+        }
+        enum_iter_free(&it);
+        if (job->stats) {
+            stats_stop(&began, &job->stats->generate);
+        }
+        return;
+    }
+    for (; i < count; i++) {
+        size_t from = buf->length;
+        rng_seed_stream(&rng, job->seed, job->start + first + i);
+        if (job->uniform) {
+            uniform_generate(job->uniform, &rng, buf);
+        } else if (job->window) {
+            window_generate(job->window, job->pval, &rng, buf);
+        } else if (generate_budgeted(job->prog, job->pval, &rng, buf, &job->budget, &counts)) {
+            continue;
+        }
+        if (check && !matcher_match(check, buf->data + from, buf->length - from)) {
+            mismatch(st, job->start + first + i, buf->data + from, buf->length - from);
+        }
+        *strbuf_reserve(buf, 1) = '\n';
+        buf->length++;
+    }
+    if (counts.truncated || counts.resampled || counts.failed) {
+        __sync_fetch_and_add(&st->counts.truncated, counts.truncated);
+        __sync_fetch_and_add(&st->counts.resampled, counts.resampled);
+        __sync_fetch_and_add(&st->counts.failed, counts.failed);
+    }
+    if (job->stats) {
+        stats_stop(&began, &job->stats->generate);
+    }
+}
+
+/*
+ Writes length bytes of whole lines to the run's file.  The caller holds the lock, or is the only thread writing.
+ */
+static void write_lines(struct bulk_state * st, const char * data, size_t length) {
+    struct moment began;
+    if (st->job->stats) {
+        stats_start(&began);
+        sink_write(&st->sink, data, length);
+        stats_stop(&began, &st->job->stats->write);
+        count_lines(st->job->stats, data, length);
+    } else {
+        sink_write(&st->sink, data, length);
+    }
+}
+
+/*
+ In a stats build, counts the instructions this thread runs into counts, until stop_counting adds them to the run's.
+ */
+static void start_counting(struct bulk_state * st, struct vm_stats * counts) {
+#ifdef REGEN_STATS
+    if (st->job->stats && st->job->prog) {
+        vm_stats_init(counts, st->job->prog->code, st->job->prog->length);
+        vm_counters = counts;
+    }
+#else
+    (void)st;
+    (void)counts;
+#endif
+}
+
+static void stop_counting(struct bulk_state * st, struct vm_stats * counts) {
+#ifdef REGEN_STATS
+    if (vm_counters == counts) {
+        vm_counters = NULL;
+        if (st->job->threads > 1) {
+            pthread_mutex_lock(&st->lock);
+        }
+        vm_stats_add(&st->job->stats->vm, counts);
+        if (st->job->threads > 1) {
+            pthread_mutex_unlock(&st->lock);
+        }
+        vm_stats_free(counts);
+    }
+#else
+    (void)st;
+    (void)counts;
+#endif
+}
+
+/*
+ Takes the repeats out of the lines of buf from from on.
+ @param lines set to how many lines there were.
+ @param trailing set to how many repeats came after the last new line.
+ @return how many lines are left.
+ */
+static unsigned long drop_repeats(struct bulk_state * st, struct strbuf * buf, size_t from, unsigned long * lines,
+                                  unsigned long * trailing) {
+    size_t read = from;
+    size_t kept = from;
+    unsigned long count = 0;
+    *lines = 0;
+    *trailing = 0;
+    while (read < buf->length) {
+        char * end = (char *)memchr(buf->data + read, '\n', buf->length - read);
+        size_t length = end - (buf->data + read);
+        (*lines)++;
+        if (uniqset_add(&st->set, buf->data + read, length)) {
+            memmove(buf->data + kept, buf->data + read, length + 1);
+            kept += length + 1;
+            count++;
+            *trailing = 0;
+        } else {
+            (*trailing)++;
+        }
+        read += length + 1;
+    }
+    buf->length = kept;
+    return count;
+}
+
+/*
+ Counts the new lines of a block that drop_repeats has been through, cutting off any past the lines asked for, and
+ decides whether the run is over.  The caller holds the lock, or is the only thread.
+ */
+static void settle(struct bulk_state * st, struct strbuf * buf, size_t from, unsigned long kept, unsigned long lines,
+                   unsigned long trailing) {
+    const struct bulk_job * job = st->job;
+    unsigned long wanted = job->lines - st->written;
+    if (kept > wanted) {
+        size_t at = from;
+        unsigned long i = 0;
+        for (; i < wanted; i++) {
+            at = (char *)memchr(buf->data + at, '\n', buf->length - at) - buf->data + 1;
+        }
+        buf->length = at;
+        kept = wanted;
+    }
+    st->written += kept;
+    st->repeats = kept ? trailing : st->repeats + lines;
+    if (st->written == job->lines || (job->space && st->written >= job->space) || st->repeats >= UNIQUE_MAX_REPEATS) {
+        st->done = 1;
+    }
+}
+
+//Takes the repeats out of a block and counts what is left.  The caller holds the lock, or is the only thread.
+static void keep_new(struct bulk_state * st, struct strbuf * buf, size_t from) {
+    unsigned long lines;
+    unsigned long trailing;
+    unsigned long kept = drop_repeats(st, buf, from, &lines, &trailing);
+    settle(st, buf, from, kept, lines, trailing);
+}
+
+static unsigned long claim_block(struct bulk_state * st) {
+    pthread_mutex_lock(&st->lock);
+    unsigned long k = st->done ? st->blocks : st->next_block++;
+    pthread_mutex_unlock(&st->lock);
+    return k;
+}
+
+static void * ordered_worker(void * arg) {
+    struct bulk_state * st = (struct bulk_state *)arg;
+    struct vm_stats counts;
+    struct matcher check;
+    unsigned long k;
+    start_counting(st, &counts);
+    if (st->job->verify) {
+        matcher_init(&check, st->job->verify);
+    }
+
+    while ((k = claim_block(st)) < st->blocks) {
+        struct slot * slot = &st->slots[k % st->nslots];
+
+        //Wait until the writer is done with the block that last used this slot.
+        pthread_mutex_lock(&st->lock);
+        while ((slot->full || st->next_write + st->nslots <= k) && !st->done) {
+            pthread_cond_wait(&st->changed, &st->lock);
+        }
+        int done = st->done;
+        pthread_mutex_unlock(&st->lock);
+        if (done) {
+            break;
+        }
+
+        slot->buf.length = 0;
+        generate_block(st, k, &slot->buf, st->job->verify ? &check : NULL);
+
+        pthread_mutex_lock(&st->lock);
+        slot->block = k;
+        slot->full = 1;
+        pthread_cond_broadcast(&st->changed);
+        pthread_mutex_unlock(&st->lock);
+    }
+    stop_counting(st, &counts);
+    if (st->job->verify) {
+        matcher_free(&check);
+    }
+    return NULL;
+}
+
+static void * writer(void * arg) {
+    struct bulk_state * st = (struct bulk_state *)arg;
+    struct iovec * iov = (struct iovec *)malloc(st->nslots * sizeof(struct iovec));
+    unsigned long k = 0;
+    if (iov == NULL) { printf("malloc failure.\n"); exit(1); }
+
+    while (k < st->blocks && !st->done) {
+        int count = 0;
+
+        //Wait for the next block, then take it and every finished block right after it.
+        pthread_mutex_lock(&st->lock);
+        while (!st->slots[k % st->nslots].full || st->slots[k % st->nslots].block != k) {
+            pthread_cond_wait(&st->changed, &st->lock);
+        }
+        while (k + count < st->blocks && count < st->nslots && count < IOV_MAX) {
+            struct slot * slot = &st->slots[(k + count) % st->nslots];
+            if (!slot->full || slot->block != k + count) {
+                break;
+            }
+            iov[count].iov_base = slot->buf.data;
+            iov[count].iov_len = slot->buf.length;
+            count++;
+        }
+        pthread_mutex_unlock(&st->lock);
+
+        //The taken slots are the writer's until it marks them empty, so repeats are taken out without the lock.
+        if (st->job->unique) {
+            int i = 0;
+            int done = 0;
+            for (; i < count && !done; i++) {
+                struct slot * slot = &st->slots[(k + i) % st->nslots];
+                keep_new(st, &slot->buf, 0);
+                iov[i].iov_len = slot->buf.length;
+                done = st->done;
+            }
+            count = i;
+        }
+        if (st->job->stats) {
+            struct moment began;
+            int i = 0;
+            for (; i < count; i++) {
+                count_lines(st->job->stats, (const char *)iov[i].iov_base, iov[i].iov_len);
+            }
+            stats_start(&began);
+            sink_writev(&st->sink, iov, count);
+            stats_stop(&began, &st->job->stats->write);
+        } else {
+            sink_writev(&st->sink, iov, count);
+        }
+
+        pthread_mutex_lock(&st->lock);
+        for (; count > 0; count--, k++) {
+            st->slots[k % st->nslots].full = 0;
+        }
+        st->next_write = k;
+        pthread_cond_broadcast(&st->changed);
+        pthread_mutex_unlock(&st->lock);
+    }
+    free(iov);
+    return NULL;
+}
+
+static void * unordered_worker(void * arg) {
+    struct bulk_state * st = (struct bulk_state *)arg;
+    struct strbuf buf = {NULL, 0, 0};
+    struct vm_stats counts;
+    struct matcher check;
+    unsigned long k;
+    start_counting(st, &counts);
+    if (st->job->verify) {
+        matcher_init(&check, st->job->verify);
+    }
+
+    while ((k = claim_block(st)) < st->blocks) {
+        unsigned long lines = 0;
+        unsigned long trailing = 0;
+        unsigned long kept = 0;
+        buf.length = 0;
+        generate_block(st, k, &buf, st->job->verify ? &check : NULL);
+        if (st->job->unique) {
+            kept = drop_repeats(st, &buf, 0, &lines, &trailing);
+        }
+        pthread_mutex_lock(&st->lock);
+        if (st->job->unique) {
+            if (st->done) {
+                pthread_mutex_unlock(&st->lock);
+                break;
+            }
+            settle(st, &buf, 0, kept, lines, trailing);
+        }
+        write_lines(st, buf.data, buf.length);
+        pthread_mutex_unlock(&st->lock);
+    }
+    stop_counting(st, &counts);
+    if (st->job->verify) {
+        matcher_free(&check);
+    }
+    strbuf_free(&buf);
+    return NULL;
+}
+
+static unsigned long finish(struct bulk_state * st) {
+    sink_close(&st->sink);
+    if (st->job->counts) {
+        *st->job->counts = st->counts;
+    }
+    if (st->job->unique) {
+        uniqset_free(&st->set);
+        return st->written;
+    }
+    return st->job->lines - st->counts.failed;
+}
+
+/*
+ @param job describes the run: the program, how many lines, the seed, and where to write them.
+
+ Writes job->lines lines to job->fd.  Returns once all of them have been written.
+ @return the number of lines written.  Unique runs write fewer than job->lines when the pattern runs out of new
+ lines, and other runs leave out the lines their budget gives up on.
+ */
+unsigned long generate_bulk(const struct bulk_job * job) {
+    struct bulk_state st;
+    unsigned long i = 0;
+
+    st.job = job;
+    st.blocks = job->unique ? ULONG_MAX / BULK_BLOCK_LINES : (job->lines + BULK_BLOCK_LINES - 1) / BULK_BLOCK_LINES;
+    st.next_block = 0;
+    st.next_write = 0;
+    st.slots = NULL;
+    st.nslots = 0;
+    st.written = 0;
+    st.repeats = 0;
+    st.done = 0;
+    memset(&st.counts, 0, sizeof(st.counts));
+    sink_init(&st.sink, job->fd, job->preallocate, job->lines);
+    if (job->unique) {
+        uniqset_init(&st.set, job->false_positive, job->lines);
+    }
+
+    if (job->threads <= 1) {
+        struct strbuf buf = {NULL, 0, 0};
+        struct vm_stats counts;
+        struct matcher check;
+        start_counting(&st, &counts);
+        if (job->verify) {
+            matcher_init(&check, job->verify);
+        }
+        for (; i < st.blocks && !st.done; i++) {
+            size_t from = buf.length;
+            generate_block(&st, i, &buf, job->verify ? &check : NULL);
+            if (job->unique) {
+                keep_new(&st, &buf, from);
+            }
+            if (buf.length >= BULK_WRITE_SIZE || i + 1 == st.blocks || st.done) {
+                write_lines(&st, buf.data, buf.length);
+                buf.length = 0;
+            }
+        }
+        stop_counting(&st, &counts);
+        if (job->verify) {
+            matcher_free(&check);
+        }
+        strbuf_free(&buf);
+        return finish(&st);
+    }
+
+    pthread_mutex_init(&st.lock, NULL);
+    pthread_cond_init(&st.changed, NULL);
+    pthread_t * workers = (pthread_t *)malloc(job->threads * sizeof(pthread_t));
+    pthread_t writer_thread;
+    if (workers == NULL) { printf("malloc failure.\n"); exit(1); }
+
+    if (job->ordered) {
+        st.nslots = 2 * job->threads;
+        st.slots = (struct slot *)calloc(st.nslots, sizeof(struct slot));
+        if (st.slots == NULL) { printf("calloc failure.\n"); exit(1); }
+        if (pthread_create(&writer_thread, NULL, writer, &st)) {
+            printf("Could not start writer thread.\n");
+            exit(1);
+        }
+    }
+    for (i = 0; i < job->threads; i++) {
+        if (pthread_create(&workers[i], NULL, job->ordered ? ordered_worker : unordered_worker, &st)) {
+            printf("Could not start worker thread.\n");
+            exit(1);
+        }
+    }
+    for (i = 0; i < job->threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    if (job->ordered) {
+        pthread_join(writer_thread, NULL);
+        for (i = 0; i < st.nslots; i++) {
+            strbuf_free(&st.slots[i].buf);
+        }
+        free(st.slots);
+    }
+
+    free(workers);
+    pthread_mutex_destroy(&st.lock);
+    pthread_cond_destroy(&st.changed);
+    return finish(&st);
+}
@@ -0,0 +1,70 @@
+//
+//  bulk.h
+//  regen
+//
+//  Generates many lines from one program, optionally spread across worker threads.
+//
+
+#include "global.h"
+#include "compile.h"
+#include "strgen.h"
+#include "rng.h"
+#include "strbuf.h"
+#include "regen.h"
+#include "uniform.h"
+#include "enumerate.h"
+#include "lengths.h"
+#include "uniqset.h"
+#include "stats.h"
+#include "match.h"
+#include "sink.h"
+
+#ifndef bulk_h
+#define bulk_h
+
+#include <stdint.h>
+
+struct bulk_job {
+    const struct program * prog;  //Shared, read-only, by every worker.
+    const struct uniform * uniform; //If not NULL, lines are picked from it instead of by running prog.
+    const struct enumeration * enumeration; //If not NULL, line k is string k of its list instead.
+    const struct window * window; //If not NULL, lines are generated from its tree to fit its lengths instead.
+    float pval;
+    uint64_t seed;
+    unsigned long start;          //Index of the first line in the run.
+    unsigned long lines;
+    int threads;
+    int ordered;                  //Write blocks in order (deterministic), or as soon as they are done.
+    int fd;                       //Where the lines are written.
+    int preallocate;              //Give fd its space ahead of the lines, if it is a regular file (see sink.c).
+    int unique;                   //Write only lines not written before, until there are lines of them.
+    double false_positive;        //With unique, 0 to remember lines exactly, or the false positive rate of a Bloom filter.
+    uint64_t space;               //With unique, how many different lines the pattern can make, or 0 if unknown.
+    struct budget budget;         //Limits on each line generated by running prog.
+    struct budget_counts * counts; //If not NULL, set to how often the budget ran out.
+    struct run_stats * stats;     //If not NULL, the run's times and lines are added to it.
+    const struct automaton * verify; //If not NULL, every line generated is checked against it,
+    struct regen_mismatches * mismatches; //and the ones that don't match are counted here.
+};
+
+unsigned long generate_bulk(const struct bulk_job * job);
+
+#endif /* bulk_h */
+
+//Lines per block, the unit of work handed to a thread.
+#ifndef BULK_BLOCK_LINES
+#define BULK_BLOCK_LINES 1024
+#endif
+
+//With one thread, blocks are collected until they hold this many bytes, then written at once.
+#ifndef BULK_WRITE_SIZE
+#define BULK_WRITE_SIZE (1 << 18)
+#endif
+
+#ifndef UNIQUE_MAX_REPEATS
+#define UNIQUE_MAX_REPEATS REGEN_UNIQUE_MAX_REPEATS
+#endif
+
+#ifndef MAX_THREADS
+#define MAX_THREADS REGEN_MAX_THREADS
+#endif
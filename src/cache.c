@@ -0,0 +1,227 @@
+//
+//  cache.c
+//  regen
+//  Saves compiled programs to a file that can later be mapped into memory and run as is.
+//
+
+#include "cache.h"
+#include "strbuf.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ Compiled programs don't point anywhere: jumps are indices into the program's own code array (see compile.h).  So a
+ program can be written to a file as it is, and run later straight out of a read-only mapping of that file, without
+ parsing, compiling, or copying.  Opening a cache costs one mmap, a checksum pass and one small allocation, however
+ many patterns it holds.
+
+ The checksum only guards against damaged or truncated files.  A cache file is trusted like a program: one built
+ on purpose to be harmful can make regen jump anywhere in the code arrays.
+ */
+
+/*
+ FNV-1a over 8 bytes at a time, with the tail handled byte by byte.
+ */
+static uint64_t checksum(const unsigned char * data, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 0x100000001b3ULL;
+    }
+    for (; i < length; i++) {
+        hash = (hash ^ data[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+//Appends length bytes to buf, zero padded to a multiple of 8, and returns the offset they start at.
+static uint64_t append(struct strbuf * buf, const void * data, size_t length) {
+    size_t padded = (length + 7) & ~(size_t)7;
+    uint64_t at = buf->length;
+    char * to = strbuf_reserve(buf, padded);
+    memset(to, 0, padded);
+    memcpy(to, data, length);
+    buf->length += padded;
+    return at;
+}
+
+/*
+ Writes all of data to fd, retrying after short writes and interruptions.
+ @return 0, or -1 with errno set.  Unlike write_all, a library call must not end the program over a full disk.
+ */
+static int write_fully(int fd, const char * data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += written;
+        length -= written;
+    }
+    return 0;
+}
+
+/*
+ @param path the file to write.  It is written under a temporary name and renamed over path when complete, so a
+ reader never sees half a file.
+ @param programs, sources, tags count programs, the patterns they were compiled from, and a number for each.
+ @param flags stored as is, for the caller's use.
+ @return 0, or -1 with errno set if the file could not be written.
+ */
+int cache_write(const char * path, const struct program * const * programs, const char * const * sources,
+                const unsigned long * tags, unsigned long count, uint64_t flags) {
+    struct strbuf buf = {NULL, 0, 0};
+    struct cache_header header;
+    struct cache_entry * entries;
+    unsigned long i = 0;
+
+    //Header and entries first, filled in once the offsets are known.
+    strbuf_reserve(&buf, sizeof(header) + count * sizeof(struct cache_entry));
+    memset(buf.data, 0, sizeof(header) + count * sizeof(struct cache_entry));
+    buf.length = sizeof(header) + count * sizeof(struct cache_entry);
+
+    for (; i < count; i++) {
+        size_t source_length = strlen(sources[i]);
+        uint64_t source = append(&buf, sources[i], source_length + 1);
+        uint64_t code = append(&buf, programs[i]->code, programs[i]->length * sizeof(int));
+        entries = (struct cache_entry *)(buf.data + sizeof(header));
+        entries[i].tag = tags[i];
+        entries[i].code = code;
+        entries[i].source = source;
+        entries[i].code_length = (uint32_t)programs[i]->length;
+        entries[i].source_length = (uint32_t)source_length;
+        entries[i].depth = programs[i]->depth;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "RGC", 4);
+    header.version = CACHE_FORMAT_VERSION;
+    header.program_version = PROGRAM_FORMAT_VERSION;
+    header.int_size = sizeof(int);
+    header.byte_order = CACHE_BYTE_ORDER;
+    header.count = count;
+    header.flags = flags;
+    header.size = buf.length;
+    header.checksum = checksum((unsigned char *)buf.data + sizeof(header), buf.length - sizeof(header));
+    memcpy(buf.data, &header, sizeof(header));
+
+    size_t namelength = strlen(path) + 5;
+    char * temp = (char *)malloc(namelength);
+    if (temp == NULL) { printf("malloc failure.\n"); exit(1); }
+    snprintf(temp, namelength, "%s.tmp", path);
+    int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    int result = -1;
+    int saved = errno;
+    if (fd != -1) {
+        result = write_fully(fd, buf.data, buf.length);
+        saved = errno;
+        if (close(fd) != 0 && result == 0) {
+            result = -1;
+            saved = errno;
+        }
+        if (result == 0 && rename(temp, path) != 0) {
+            result = -1;
+            saved = errno;
+        }
+        if (result != 0) {
+            unlink(temp);
+        }
+    }
+    free(temp);
+    strbuf_free(&buf);
+    errno = saved;
+    return result;
+}
+
+/*
+ Checks everything about the mapped file that could make reading it go out of bounds.
+ */
+static int valid(const struct cache * c) {
+    const struct cache_header * header = (const struct cache_header *)c->map;
+    unsigned long i = 0;
+
+    if (c->size < sizeof(*header) || memcmp(header->magic, "RGC", 4) || header->version != CACHE_FORMAT_VERSION
+        || header->program_version != PROGRAM_FORMAT_VERSION || header->int_size != sizeof(int)
+        || header->byte_order != CACHE_BYTE_ORDER || header->size != c->size
+        || header->count > (c->size - sizeof(*header)) / sizeof(struct cache_entry)) {
+        return 0;
+    }
+    if (checksum((const unsigned char *)c->map + sizeof(*header), c->size - sizeof(*header)) != header->checksum) {
+        return 0;
+    }
+    for (; i < header->count; i++) {
+        const struct cache_entry * e = &c->entries[i];
+        if (e->code % sizeof(int) || e->code > c->size || e->code_length == 0
+            || e->code_length > (c->size - e->code) / sizeof(int)
+            || e->source > c->size || e->source_length >= c->size - e->source
+            || ((const char *)c->map)[e->source + e->source_length] != '\0' || e->depth < 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ @param c filled in with the mapped cache.  Release it with cache_close.
+ @param path the file, written by cache_write.
+ @return CACHE_OK, CACHE_EIO or CACHE_EFORMAT.
+ */
+int cache_open(struct cache * c, const char * path) {
+    struct stat st;
+    unsigned long i = 0;
+    int fd = open(path, O_RDONLY);
+
+    c->map = NULL;
+    c->programs = NULL;
+    if (fd == -1) {
+        return CACHE_EIO;
+    }
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return CACHE_EIO;
+    }
+    c->size = st.st_size;
+    if (c->size < sizeof(struct cache_header)) {
+        close(fd);
+        return CACHE_EFORMAT;
+    }
+    c->map = mmap(NULL, c->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (c->map == MAP_FAILED) {
+        c->map = NULL;
+        return CACHE_EIO;
+    }
+    c->entries = (const struct cache_entry *)((const char *)c->map + sizeof(struct cache_header));
+    if (!valid(c)) {
+        cache_close(c);
+        return CACHE_EFORMAT;
+    }
+
+    c->count = ((const struct cache_header *)c->map)->count;
+    c->flags = ((const struct cache_header *)c->map)->flags;
+    c->programs = (struct program *)malloc((c->count ? c->count : 1) * sizeof(struct program));
+    if (c->programs == NULL) { printf("malloc failure.\n"); exit(1); }
+    for (; i < c->count; i++) {
+        c->programs[i].code = (int *)((char *)c->map + c->entries[i].code);
+        c->programs[i].length = c->entries[i].code_length;
+        c->programs[i].depth = c->entries[i].depth;
+        c->programs[i].positions = NULL;
+    }
+    return CACHE_OK;
+}
+
+void cache_close(struct cache * c) {
+    if (c->map) {
+        munmap(c->map, c->size);
+    }
+    free(c->programs);
+    c->map = NULL;
+    c->programs = NULL;
+}
@@ -0,0 +1,72 @@
+//
+//  cache.h
+//  regen
+//  Saves compiled programs to a file that can later be mapped into memory and run as is.
+//
+
+#include "global.h"
+#include "compile.h"
+
+#ifndef cache_h
+#define cache_h
+
+#include <stdint.h>
+
+/*
+ Layout of a cache file.  All numbers are in the byte order of the machine that wrote the file, which must match the
+ machine that reads it.
+
+ header                        struct cache_header
+ entries                       count struct cache_entry records
+ data                          every pattern's source text (NUL-terminated) and code array, each 8-byte aligned
+
+ Offsets are from the start of the file.  The checksum covers everything after the header.
+ */
+struct cache_header {
+    char magic[4];             //"RGC" and a NUL
+    uint32_t version;          //CACHE_FORMAT_VERSION, the layout of the file.
+    uint32_t program_version;  //PROGRAM_FORMAT_VERSION, the instruction set of the code arrays.
+    uint16_t int_size;         //sizeof(int) on the machine that wrote the file.
+    uint16_t reserved;
+    uint32_t byte_order;       //CACHE_BYTE_ORDER as written by that machine.
+    uint32_t reserved2;
+    uint64_t count;            //of entries
+    uint64_t flags;
+    uint64_t size;             //of the whole file
+    uint64_t checksum;
+};
+
+struct cache_entry {
+    uint64_t tag;              //A number the writer picked, such as the pattern's line in its file.
+    uint64_t code;             //Offset of the code array
+    uint64_t source;           //Offset of the source text
+    uint32_t code_length;      //in ints
+    uint32_t source_length;
+    int32_t depth;
+    uint32_t reserved;
+};
+
+//A cache file mapped into memory.  Every program's code points into the mapping.
+struct cache {
+    void * map;
+    size_t size;
+    unsigned long count;
+    uint64_t flags;
+    struct program * programs;
+    const struct cache_entry * entries;
+};
+
+int cache_write(const char * path, const struct program * const * programs, const char * const * sources,
+                const unsigned long * tags, unsigned long count, uint64_t flags);
+int cache_open(struct cache * c, const char * path);
+void cache_close(struct cache * c);
+
+#endif /* cache_h */
+
+#define CACHE_FORMAT_VERSION 1
+#define CACHE_BYTE_ORDER 0x01020304
+
+//Results of cache_open
+#define CACHE_OK 0
+#define CACHE_EIO 1       //The file could not be opened, read or mapped.
+#define CACHE_EFORMAT 2   //The file is not a cache, is damaged, or was written by a different version or machine.
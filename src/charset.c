@@ -0,0 +1,106 @@
+//
+//  charset.c
+//  regen
+//  Sets of characters, one bit per byte value.
+//
+
+#include "charset.h"
+
+/*
+ The parser collects the members of a character class into a 256 bit set, so adding a range, removing a character or
+ asking whether a character is in the class are all constant time, and a character listed twice is still only in the
+ class once.  When the class is done, charset_flatten lists the members in order, which is the table generation picks
+ from with a single index.
+ */
+
+/*
+ Adds every character from low to high, inclusive.
+ */
+void charset_range(struct charset * set, unsigned char low, unsigned char high) {
+    unsigned int c = low;
+    for (; c <= high; c++) {
+        charset_add(set, (unsigned char)c);
+    }
+}
+
+/*
+ The set used by . and as the starting point of a negated class: the visible characters in NOT_BASE_CHARACTER_SET.
+ */
+void charset_universe(struct charset * set) {
+    const char * c = NOT_BASE_CHARACTER_SET;
+    memset(set, 0, sizeof(struct charset));
+    for (; *c; c++) {
+        charset_add(set, (unsigned char)*c);
+    }
+}
+
+/*
+ Replaces the set with the characters of the universe (see charset_universe) that are not in it.
+ */
+void charset_invert(struct charset * set) {
+    struct charset universe;
+    int i = 0;
+    charset_universe(&universe);
+    for (; i < 4; i++) {
+        set->bits[i] = universe.bits[i] & ~set->bits[i];
+    }
+}
+
+/*
+ @param c the character after a \
+ @return 1 and adds the class's characters to set if \c names a class, 0 if it doesn't.
+
+ \d is the digits, \w is letters, digits and _, and \s is a space or a tab.  (A newline would split a line of
+ output in two, so \s leaves it out; write \n to ask for one.)  \D, \W and \S are their negations, taken from the
+ same characters as . and [^...].
+ */
+int charset_escape(struct charset * set, char c) {
+    struct charset class;
+    int i = 0;
+    memset(&class, 0, sizeof(struct charset));
+
+    switch (c) {
+        case 'd':
+        case 'D':
+            charset_range(&class, '0', '9');
+            break;
+        case 'w':
+        case 'W':
+            charset_range(&class, 'a', 'z');
+            charset_range(&class, 'A', 'Z');
+            charset_range(&class, '0', '9');
+            charset_add(&class, '_');
+            break;
+        case 's':
+        case 'S':
+            charset_add(&class, ' ');
+            charset_add(&class, '\t');
+            break;
+        default:
+            return 0;
+    }
+    if (c == 'D' || c == 'W' || c == 'S') {
+        charset_invert(&class);
+    }
+    for (; i < 4; i++) {
+        set->bits[i] |= class.bits[i];
+    }
+    return 1;
+}
+
+/*
+ Writes the members of the set to out in increasing order, followed by a terminating null character.  out must have
+ room for 257 characters.
+ @return the number of members.
+ */
+unsigned long charset_flatten(const struct charset * set, char * out) {
+    unsigned long n = 0;
+    unsigned int c = 1; //A null character can't appear in the pattern, so it is never a member.
+    for (; c < 256; c++) {
+        if (charset_has(set, (unsigned char)c)) {
+            out[n++] = (char)c;
+        }
+    }
+    out[n] = '\0';
+    return n;
+}
@@ -0,0 +1,33 @@
+//
+//  charset.h
+//  regen
+//
+//  Sets of characters, one bit per byte value.
+//
+
+#include "global.h"
+
+#ifndef charset_h
+#define charset_h
+
+#include <stdint.h>
+
+struct charset {
+    uint64_t bits[4];
+};
+
+static inline void charset_add(struct charset * set, unsigned char c) {
+    set->bits[c >> 6] |= (uint64_t)1 << (c & 63);
+}
+
+static inline int charset_has(const struct charset * set, unsigned char c) {
+    return (set->bits[c >> 6] >> (c & 63)) & 1;
+}
+
+void charset_range(struct charset * set, unsigned char low, unsigned char high);
+void charset_universe(struct charset * set);
+void charset_invert(struct charset * set);
+int charset_escape(struct charset * set, char c);
+unsigned long charset_flatten(const struct charset * set, char * out);
+
+#endif /* charset_h */
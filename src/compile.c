@@ -0,0 +1,279 @@
+//
+//  compile.c
+//  regen
+//  Lowers the parse tree into a flat program for the interpreter in strgen.c
+//
+
+#include "compile.h"
+#include "fill.h"
+#include "lengths.h"
+#include "optimize.h"
+#include "stats.h"
+#include <limits.h>
+
+/*
+ The parse tree is convenient to build, but walking it means chasing a struct token pointer, its code array and its
+ element array for every character generated.  compile_tree walks the tree once and writes the same instructions out
+ into a single int array (see compile.h for the instruction set).  Character classes are copied inline right after
+ their OP_CLASS instruction, so the interpreter never leaves the code array.
+
+ Every quantifier becomes a counted loop: the count is drawn once when the loop starts (for * and + from the
+ geometric distribution that repeating with probability p describes), and the loop then runs that many times.
+
+ Parts of the tree that always produce the same number of characters make room for all of them at once, with
+ OP_RESERVE or with the room a loop makes up front, and are then written with instructions that skip the check.
+ */
+
+struct compiler {
+    int * code;
+    unsigned long length;  //Next free spot in code
+    unsigned long size;    //Allocated length of code
+    int depth;             //Current nesting of counted loops
+    int maxdepth;
+    int reserved;          //Whether room has already been made for whatever is emitted now.
+    int * positions;       //Stats builds only: the node each word was emitted for, as its index in the pattern.
+    int position;          //The node being emitted.
+};
+
+static void emit_tree(struct compiler * c, struct token * subtree);
+
+/*
+ Makes room for n more ints at the end of the program and returns the index of the first one.
+ */
+static unsigned long reserve(struct compiler * c, unsigned long n) {
+    while (c->length + n > c->size) {
+        c->size *= 2;
+        c->code = (int *)realloc(c->code, c->size * sizeof(int));
+        if (c->code == NULL) { printf("realloc failure.\n"); exit(1); }
+        STATS_REALLOC();
+#ifdef REGEN_STATS
+        c->positions = (int *)realloc(c->positions, c->size * sizeof(int));
+        if (c->positions == NULL) { printf("realloc failure.\n"); exit(1); }
+#endif
+    }
+#ifdef REGEN_STATS
+    unsigned long i = c->length;
+    for (; i < c->length + n; i++) {
+        c->positions[i] = c->position;
+    }
+#endif
+    c->length += n;
+    return c->length - n;
+}
+
+static unsigned long emit(struct compiler * c, int word) {
+    unsigned long at = reserve(c, 1);
+    c->code[at] = word;
+    return at;
+}
+
+/*
+ Emits the only child of a *, +, ?, {n} or {n:m} token.
+ */
+static void emit_body(struct compiler * c, struct token * subtree) {
+    emit_tree(c, ((struct token **)(subtree->element))[0]);
+}
+
+/*
+ Emits the minimum length operand of a loop instruction, clamped to fit an int.
+ */
+static void emit_min_length(struct compiler * c, struct token * subtree) {
+    unsigned long least = min_length_of(((struct token **)(subtree->element))[0]);
+    emit(c, least > INT_MAX ? INT_MAX : (int)least);
+}
+
+/*
+ Emits a class's characters, zero padded to fill words ints.
+ */
+static void emit_chars(struct compiler * c, struct token * class, unsigned long words) {
+    unsigned long at = reserve(c, words);
+    memset(c->code + at, 0, words * sizeof(int));
+    memcpy(c->code + at, class->element, class->length);
+}
+
+/*
+ Emits a counted loop around the body.  The caller has already emitted the instruction that pushes the count.
+ A body that is just a character class is filled in one go by OP_RUN.
+ */
+static void emit_loop(struct compiler * c, struct token * subtree) {
+    struct token * body = ((struct token **)(subtree->element))[0];
+    c->depth++;
+    if (c->depth > c->maxdepth) {
+        c->maxdepth = c->depth;
+    }
+    if (body->code[0] == 0 && body->length <= MAX_RUN_CLASS_SIZE) {
+        emit(c, OP_RUN);
+        emit(c, (int)body->length);
+        emit(c, run_threshold(body->length));
+        emit_chars(c, body, RUN_WORDS(body->length));
+        c->depth--;
+        return;
+    }
+    unsigned long loop = emit(c, OP_LOOP);
+    unsigned long end = emit(c, 0);
+    //The loop made room for count times the shortest pass, which is every pass when they all have the same length.
+    int reserved = c->reserved;
+    long fixed = fixed_length(body);
+    if (fixed > 0 && fixed < INT_MAX) {
+        c->reserved = 1;
+    }
+    emit_body(c, subtree);
+    c->reserved = reserved;
+    emit(c, OP_JMP);
+    emit(c, (int)loop);
+    c->code[end] = (int)c->length;
+    c->depth--;
+}
+
+/*
+ Emits the branches of a | after their jump table, which starts at at.  Each branch ends with a jump to the end of
+ the last one.
+ */
+static void emit_branches(struct compiler * c, struct token * subtree, unsigned long at, unsigned long end) {
+    unsigned long i = 0;
+    for (; i < subtree->length; i++) {
+        c->code[at + i] = (int)c->length;
+        emit_tree(c, ((struct token **)(subtree->element))[i]);
+        emit(c, OP_JMP);
+        emit(c, 0); //Patched below, once the end is known.
+    }
+    for (i = 0; i < subtree->length; i++) {
+        unsigned long next = (i + 1 < subtree->length) ? (unsigned long)c->code[at + i + 1] : c->length;
+        c->code[next - 1] = (int)c->length;
+    }
+    c->code[end] = (int)c->length;
+}
+
+static void emit_node(struct compiler * c, struct token * subtree) {
+    unsigned long i = 0;
+    unsigned long at;
+    unsigned long end;
+    int sum = 0;
+
+    switch (subtree->code[0]) {
+        case 0: //Character class; the characters follow the count, packed into as many ints as needed.
+            emit(c, c->reserved ? OP_CLASS_UNCHECKED : OP_CLASS);
+            emit(c, (int)subtree->length);
+            emit_chars(c, subtree, CLASS_WORDS(subtree->length));
+            break;
+        case 8: //Literal, packed the same way.
+            emit(c, c->reserved ? OP_LIT_UNCHECKED : OP_LIT);
+            emit(c, (int)subtree->length);
+            emit_chars(c, subtree, CLASS_WORDS(subtree->length));
+            break;
+        case 1: //A sequence needs no instruction of its own.
+            for (; i < subtree->length; i++) {
+                emit_tree(c, ((struct token **)(subtree->element))[i]);
+            }
+            break;
+        case 2: //*
+            emit(c, OP_STAR);
+            emit_min_length(c, subtree);
+            emit_loop(c, subtree);
+            break;
+        case 3: //+
+            emit(c, OP_PLUS);
+            emit_min_length(c, subtree);
+            emit_loop(c, subtree);
+            break;
+        case 4: //?
+            emit(c, OP_QUEST);
+            end = emit(c, 0);
+            emit_body(c, subtree);
+            c->code[end] = (int)c->length;
+            break;
+        case 5: //{n}
+            emit(c, OP_REPEAT);
+            emit(c, subtree->code[1]);
+            emit_min_length(c, subtree);
+            emit_loop(c, subtree);
+            break;
+        case 6: //{n:m}
+            emit(c, OP_BETWEEN);
+            emit(c, subtree->code[1]);
+            emit(c, subtree->code[2]);
+            emit_min_length(c, subtree);
+            emit_loop(c, subtree);
+            break;
+        case 7: //| : a jump table of branch starts, then each branch jumping to the common end.
+            emit(c, OP_OR);
+            emit(c, (int)subtree->length);
+            end = emit(c, 0);
+            at = reserve(c, subtree->length);
+            emit_branches(c, subtree, at, end);
+            break;
+        case 9: //Weighted | : the jump table is followed by the running totals of the weights.
+            emit(c, OP_WOR);
+            emit(c, (int)subtree->length);
+            emit(c, subtree->code[1]);
+            end = emit(c, 0);
+            at = reserve(c, subtree->length);
+            for (; i < subtree->length; i++) {
+                sum += subtree->code[2 + i];
+                emit(c, sum);
+            }
+            emit_branches(c, subtree, at, end);
+            break;
+    }
+}
+
+/*
+ Emits the subtree.  If room has not been made for it yet and it always produces the same number of characters, room
+ is made for all of them first.
+ */
+static void emit_tree(struct compiler * c, struct token * subtree) {
+    int outer = c->position;
+    c->position = subtree->position;
+    if (!c->reserved && subtree->code[0] != 0 && subtree->code[0] != 8) {
+        long fixed = fixed_length(subtree);
+        if (fixed > 1) {
+            emit(c, OP_RESERVE);
+            emit(c, (int)fixed);
+            c->reserved = 1;
+            emit_node(c, subtree);
+            c->reserved = 0;
+            c->position = outer;
+            return;
+        }
+    }
+    emit_node(c, subtree);
+    c->position = outer;
+}
+
+/*
+ @param tree a parse tree built by parse_regex, and usually simplified by optimize_tree
+ @return a newly allocated program equivalent to the tree.  Release it with free_program.
+ */
+struct program * compile_tree(struct token * tree) {
+    struct compiler c;
+    c.size = DEFAULT_PROGRAM_SIZE;
+    c.length = 0;
+    c.depth = 0;
+    c.maxdepth = 0;
+    c.reserved = 0;
+    c.positions = NULL;
+    c.position = tree->position;
+    c.code = (int *)malloc(c.size * sizeof(int));
+    if (c.code == NULL) { printf("malloc failure.\n"); exit(1); }
+#ifdef REGEN_STATS
+    c.positions = (int *)malloc(c.size * sizeof(int));
+    if (c.positions == NULL) { printf("malloc failure.\n"); exit(1); }
+#endif
+
+    emit_tree(&c, tree);
+    emit(&c, OP_HALT);
+
+    struct program * prog = (struct program *)malloc(sizeof(struct program));
+    if (prog == NULL) { printf("malloc failure.\n"); exit(1); }
+    prog->code = c.code;
+    prog->length = c.length;
+    prog->depth = c.maxdepth;
+    prog->positions = c.positions;
+    return prog;
+}
+
+void free_program(struct program * prog) {
+    free(prog->code);
+    free(prog->positions);
+    free(prog);
+}
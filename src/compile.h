@@ -0,0 +1,84 @@
+//
+//  compile.h
+//  regen
+//
+//  Lowers the parse tree produced by parse_regex into a flat instruction array.
+//
+
+#include "global.h"
+
+#ifndef compile_h
+#define compile_h
+
+/*
+ * Opcodes of the compiled program.  Every instruction is one int holding the opcode, followed by its operands.
+ * Jump targets are indices into the code array, so a program does not depend on where it is loaded.
+ *
+ * OP_HALT                   end of the program.
+ * OP_CLASS n c...           append one of the n characters packed into the following words.
+ * OP_CLASS_UNCHECKED n c... OP_CLASS, where room for the character has already been made.
+ * OP_LIT n c...             append the n characters packed into the following words, as they are.
+ * OP_LIT_UNCHECKED n c...   OP_LIT, where room for the characters has already been made.
+ * OP_RESERVE n              make room for n more characters.  The fixed length code that follows is unchecked.
+ * OP_STAR min               * : push a geometrically distributed count (0 or more) onto the loop counter stack.
+ * OP_PLUS min               + : push 1 + a geometrically distributed count onto the loop counter stack.
+ * OP_QUEST end              ? : 50/50 shot of jumping over the body to end.
+ * OP_REPEAT n min           {n} : push n onto the loop counter stack.
+ * OP_BETWEEN n m min        {n:m} : push a random count in [n, m] onto the loop counter stack.
+ * OP_RUN n t c...           pop the counter and append that many characters from the class of n characters that
+ *                           follows, all at once.  t is the class's rejection threshold (see fill.c).  Takes the
+ *                           place of OP_LOOP when the body is a single character class.
+ * OP_LOOP end               pop the counter and jump to end if it is zero, otherwise decrement it and run the body.
+ *                           The body is followed by OP_JMP back to the OP_LOOP.
+ * OP_OR k end t1..tk        | : jump to one of the k branch starts.  Every branch ends with OP_JMP end.
+ * OP_WOR k w end t1..tk c1..ck
+ *                           OP_OR where the branches have weights that add up to w.  ci is the sum of the first i
+ *                           weights; branch i is taken when a random number in [0, w) falls below ci but not c(i-1).
+ * OP_JMP target             unconditional jump.
+ *
+ * OP_STAR, OP_PLUS, OP_REPEAT and OP_BETWEEN are always followed by OP_LOOP or OP_RUN.  Their last operand is the fewest
+ * characters one pass through the body can write, which lets the output be sized for the whole loop up front.
+ */
+enum opcode {
+    OP_HALT,
+    OP_CLASS,
+    OP_CLASS_UNCHECKED,
+    OP_LIT,
+    OP_LIT_UNCHECKED,
+    OP_RESERVE,
+    OP_STAR,
+    OP_PLUS,
+    OP_QUEST,
+    OP_REPEAT,
+    OP_BETWEEN,
+    OP_LOOP,
+    OP_RUN,
+    OP_OR,
+    OP_WOR,
+    OP_JMP,
+    OP_COUNT
+};
+
+//Changes whenever the instruction set or its encoding does, so that cache files of older programs are turned away.
+#define PROGRAM_FORMAT_VERSION 1
+
+//Words taken by the characters of an OP_CLASS, OP_LIT or OP_RUN.  OP_RUN classes take at least 16 bytes, so they can be
+//loaded into a vector register whole.
+#define CLASS_WORDS(n) (((n) + sizeof(int) - 1) / sizeof(int))
+#define RUN_WORDS(n) (CLASS_WORDS(n) < 16 / sizeof(int) ? 16 / sizeof(int) : CLASS_WORDS(n))
+
+struct program {
+    int * code;
+    unsigned long length;  //of code, in ints.
+    int depth;             //Deepest nesting of loops, which sizes the loop counter stack.
+    int * positions;       //In a stats build, the pattern index of the node each word of code came from.  Else NULL.
+};
+
+struct program * compile_tree(struct token * tree);
+void free_program(struct program * prog);
+
+#endif /* compile_h */
+
+#ifndef DEFAULT_PROGRAM_SIZE
+#define DEFAULT_PROGRAM_SIZE 64
+#endif
@@ -0,0 +1,365 @@
+//
+//  dfa.c
+//  regen
+//  Turns an NFA into a deterministic automaton over classes of interchangeable characters.
+//
+
+#include "dfa.h"
+
+/*
+ The usual subset construction.  A state of the DFA is the set of NFA states the NFA could be in, keeping only those
+ that read a character or accept, since the others are only ways of getting to those.  Sets are kept sorted, so
+ equal sets are equal arrays, and a hash table finds the DFA state of a set that has been seen before.
+
+ From each state, every NFA state in its set that reads a character adds its target to the targets of each symbol
+ its set holds; each symbol's targets, closed over the moves that read nothing, are the next state.
+
+ The sets and their hash table are a struct subsets, which the lazy matcher in match.c makes its states with too.
+ */
+
+struct builder {
+    struct subsets sets;    //Set i is DFA state i.
+    struct dfa * d;
+    int capacity;           //of next and accepting, in states.
+};
+
+static unsigned long hash_set(const int * set, unsigned long length) {
+    unsigned long long h = 0xcbf29ce484222325ULL;
+    unsigned long i = 0;
+    for (; i < length; i++) {
+        h = (h ^ (unsigned int)set[i]) * 0x100000001b3ULL;
+    }
+    return (unsigned long)(h ^ (h >> 29));
+}
+
+static int compare_ints(const void * x, const void * y) {
+    int a = *(const int *)x;
+    int b = *(const int *)y;
+    return (a > b) - (a < b);
+}
+
+/*
+ Splits the characters into symbols: two characters share a symbol if every set of the NFA holds both or neither.
+ Fills in only the symbol fields of d.
+ */
+void dfa_partition(struct dfa * d, const struct nfa * n) {
+    int remap[2][257];
+    int count = 0;
+    unsigned long s = 0;
+    int c;
+
+    for (c = 0; c < 256; c++) {
+        d->symbol[c] = -1;
+    }
+    for (; s < n->nsets; s++) {
+        int next = 0;
+        memset(remap, -1, sizeof(remap));
+        for (c = 0; c < 256; c++) {
+            int in = charset_has(&n->sets[s], (unsigned char)c);
+            if (d->symbol[c] < 0 && !in) {
+                continue;
+            }
+            int * slot = &remap[in][d->symbol[c] + 1];
+            if (*slot < 0) {
+                *slot = next++;
+            }
+            d->symbol[c] = (short)*slot;
+        }
+        count = next;
+    }
+
+    d->nsyms = count;
+    int filled[257];
+    memset(d->symstart, 0, sizeof(d->symstart));
+    for (c = 0; c < 256; c++) {
+        if (d->symbol[c] >= 0) {
+            d->symstart[d->symbol[c] + 1]++;
+        }
+    }
+    for (c = 0; c < count; c++) {
+        d->symstart[c + 1] += d->symstart[c];
+    }
+    memcpy(filled, d->symstart, sizeof(filled));
+    for (c = 0; c < 256; c++) {
+        if (d->symbol[c] >= 0) {
+            d->symchars[filled[d->symbol[c]]++] = (unsigned char)c;
+        }
+    }
+}
+
+/*
+ @param s filled in with no sets, for the states of n.  Release it with subsets_free.
+ */
+void subsets_init(struct subsets * s, const struct nfa * n) {
+    s->n = n;
+    s->count = 0;
+    s->capacity = 64;
+    s->offsets = (unsigned long *)malloc((s->capacity + 1) * sizeof(unsigned long));
+    s->poolsize = 1024;
+    s->poollength = 0;
+    s->pool = (int *)malloc(s->poolsize * sizeof(int));
+    s->tablesize = 1024;
+    s->table = (int *)malloc(s->tablesize * sizeof(int));
+    s->marks = (int *)calloc(n->length, sizeof(int));
+    s->stack = (int *)malloc(n->length * sizeof(int));
+    s->stamp = 0;
+    if (s->offsets == NULL || s->pool == NULL || s->table == NULL || s->marks == NULL || s->stack == NULL) {
+        printf("malloc failure.\n");
+        exit(1);
+    }
+    memset(s->table, -1, s->tablesize * sizeof(int));
+    s->offsets[0] = 0;
+}
+
+//Adds NFA state q to the end of the pool.
+void subsets_push(struct subsets * s, int q) {
+    if (s->poollength == s->poolsize) {
+        s->poolsize *= 2;
+        s->pool = (int *)realloc(s->pool, s->poolsize * sizeof(int));
+        if (s->pool == NULL) { printf("realloc failure.\n"); exit(1); }
+    }
+    s->pool[s->poollength++] = q;
+}
+
+/*
+ Replaces the count NFA states at the end of the pool with their closure over moves that read nothing, sorted and
+ without the states that neither read nor accept.
+ @return the length of the closed set.
+ */
+unsigned long subsets_closure(struct subsets * s, unsigned long from, unsigned long count) {
+    const struct nfa * n = s->n;
+    unsigned long top = 0;
+    unsigned long i = 0;
+
+    s->stamp++;
+    for (; i < count; i++) {
+        int q = s->pool[from + i];
+        if (s->marks[q] != s->stamp) {
+            s->marks[q] = s->stamp;
+            s->stack[top++] = q;
+        }
+    }
+    s->poollength = from;
+    while (top > 0) {
+        int q = s->stack[--top];
+        const struct nfa_state * st = &n->states[q];
+        if (st->set >= 0 || q == n->accept) {
+            subsets_push(s, q);
+            continue;
+        }
+        if (st->out >= 0 && s->marks[st->out] != s->stamp) {
+            s->marks[st->out] = s->stamp;
+            s->stack[top++] = st->out;
+        }
+        if (st->out1 >= 0 && s->marks[st->out1] != s->stamp) {
+            s->marks[st->out1] = s->stamp;
+            s->stack[top++] = st->out1;
+        }
+    }
+    qsort(s->pool + from, s->poollength - from, sizeof(int), compare_ints);
+    return s->poollength - from;
+}
+
+static void grow_table(struct subsets * s) {
+    unsigned long i = 0;
+    free(s->table);
+    s->tablesize *= 2;
+    s->table = (int *)malloc(s->tablesize * sizeof(int));
+    if (s->table == NULL) { printf("malloc failure.\n"); exit(1); }
+    memset(s->table, -1, s->tablesize * sizeof(int));
+    for (; i < (unsigned long)s->count; i++) {
+        unsigned long length = s->offsets[i + 1] - s->offsets[i];
+        unsigned long slot = hash_set(s->pool + s->offsets[i], length) & (s->tablesize - 1);
+        while (s->table[slot] >= 0) {
+            slot = (slot + 1) & (s->tablesize - 1);
+        }
+        s->table[slot] = (int)i;
+    }
+}
+
+/*
+ Finds the set at the end of the pool among those found so far, adding it as set count if it is new.
+ @return the set, or -1 if it is new and there are max sets already.  The set is left in the pool then.
+ */
+int subsets_find(struct subsets * s, unsigned long from, unsigned long length, int max) {
+    unsigned long slot = hash_set(s->pool + from, length) & (s->tablesize - 1);
+
+    for (; s->table[slot] >= 0; slot = (slot + 1) & (s->tablesize - 1)) {
+        int other = s->table[slot];
+        unsigned long otherlength = s->offsets[other + 1] - s->offsets[other];
+        if (otherlength == length && !memcmp(s->pool + s->offsets[other], s->pool + from, length * sizeof(int))) {
+            s->poollength = from; //Already known; drop the copy.
+            return other;
+        }
+    }
+    if (s->count >= max) {
+        return -1;
+    }
+    if (s->count + 1 >= s->capacity) {
+        s->capacity *= 2;
+        s->offsets = (unsigned long *)realloc(s->offsets, (s->capacity + 1) * sizeof(unsigned long));
+        if (s->offsets == NULL) { printf("realloc failure.\n"); exit(1); }
+    }
+    int id = s->count++;
+    s->table[slot] = id;
+    s->offsets[id + 1] = from + length;
+    if (2 * (unsigned long)s->count > s->tablesize) {
+        grow_table(s);
+    }
+    return id;
+}
+
+//@return 1 if the set holds the NFA's accepting state, otherwise 0.
+int subsets_accepting(const struct subsets * s, int set) {
+    unsigned long i = s->offsets[set];
+    for (; i < s->offsets[set + 1]; i++) {
+        if (s->pool[i] == s->n->accept) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//Forgets every set, keeping the memory.
+void subsets_clear(struct subsets * s) {
+    s->count = 0;
+    s->poollength = 0;
+    memset(s->table, -1, s->tablesize * sizeof(int));
+}
+
+void subsets_free(struct subsets * s) {
+    free(s->offsets);
+    free(s->pool);
+    free(s->table);
+    free(s->marks);
+    free(s->stack);
+}
+
+/*
+ Finds the DFA state for the set at the end of the pool, making a new one if it is new.
+ @return the state, or -1 if there would be more than MAX_DFA_STATES.
+ */
+static int find_state(struct builder * b, unsigned long from, unsigned long length) {
+    struct dfa * d = b->d;
+    int id = subsets_find(&b->sets, from, length, MAX_DFA_STATES);
+    int i;
+
+    if (id < d->nstates) {
+        return id;
+    }
+    if (d->nstates + 1 >= b->capacity) {
+        b->capacity *= 2;
+        d->next = (int *)realloc(d->next, (size_t)b->capacity * (d->nsyms ? d->nsyms : 1) * sizeof(int));
+        d->accepting = (unsigned char *)realloc(d->accepting, b->capacity);
+        if (d->next == NULL || d->accepting == NULL) { printf("realloc failure.\n"); exit(1); }
+    }
+    d->nstates++;
+    for (i = 0; i < d->nsyms; i++) {
+        d->next[(size_t)id * d->nsyms + i] = -1;
+    }
+    d->accepting[id] = (unsigned char)subsets_accepting(&b->sets, id);
+    return id;
+}
+
+/*
+ @param d filled in with the automaton.  Release it with dfa_free.
+ @param n the NFA to follow.
+ @return 0, or -1 if the automaton needs more than MAX_DFA_STATES states.
+ */
+int dfa_build(struct dfa * d, const struct nfa * n) {
+    struct builder b;
+    int result = 0;
+    unsigned long s;
+    int state;
+    int sym;
+
+    memset(d, 0, sizeof(*d));
+    dfa_partition(d, n);
+
+    //The symbols each set of the NFA holds.
+    unsigned long * setstart = (unsigned long *)calloc(n->nsets + 1, sizeof(unsigned long));
+    int * setsyms = (int *)malloc(((size_t)n->nsets * d->nsyms + 1) * sizeof(int));
+    if (setstart == NULL || setsyms == NULL) { printf("malloc failure.\n"); exit(1); }
+    for (s = 0; s < n->nsets; s++) {
+        setstart[s + 1] = setstart[s];
+        for (sym = 0; sym < d->nsyms; sym++) {
+            if (charset_has(&n->sets[s], d->symchars[d->symstart[sym]])) {
+                setsyms[setstart[s + 1]++] = sym;
+            }
+        }
+    }
+
+    subsets_init(&b.sets, n);
+    b.d = d;
+    b.capacity = 64;
+    d->next = (int *)malloc((size_t)b.capacity * (d->nsyms ? d->nsyms : 1) * sizeof(int));
+    d->accepting = (unsigned char *)malloc(b.capacity);
+    if (d->next == NULL || d->accepting == NULL) { printf("malloc failure.\n"); exit(1); }
+
+    //Targets of each symbol from the state being worked on.
+    int ** targets = (int **)calloc(d->nsyms ? d->nsyms : 1, sizeof(int *));
+    unsigned long * counts = (unsigned long *)calloc(d->nsyms ? d->nsyms : 1, sizeof(unsigned long));
+    unsigned long * sizes = (unsigned long *)calloc(d->nsyms ? d->nsyms : 1, sizeof(unsigned long));
+    if (targets == NULL || counts == NULL || sizes == NULL) { printf("calloc failure.\n"); exit(1); }
+
+    subsets_push(&b.sets, n->start);
+    d->start = find_state(&b, 0, subsets_closure(&b.sets, 0, 1));
+
+    for (state = 0; state < d->nstates && result == 0; state++) {
+        unsigned long i;
+        for (sym = 0; sym < d->nsyms; sym++) {
+            counts[sym] = 0;
+        }
+        for (i = b.sets.offsets[state]; i < b.sets.offsets[state + 1]; i++) {
+            const struct nfa_state * q = &n->states[b.sets.pool[i]];
+            if (q->set < 0) {
+                continue;
+            }
+            for (s = setstart[q->set]; s < setstart[q->set + 1]; s++) {
+                sym = setsyms[s];
+                if (counts[sym] == sizes[sym]) {
+                    sizes[sym] = sizes[sym] ? sizes[sym] * 2 : 8;
+                    targets[sym] = (int *)realloc(targets[sym], sizes[sym] * sizeof(int));
+                    if (targets[sym] == NULL) { printf("realloc failure.\n"); exit(1); }
+                }
+                targets[sym][counts[sym]++] = q->out;
+            }
+        }
+        for (sym = 0; sym < d->nsyms; sym++) {
+            if (counts[sym] == 0) {
+                continue;
+            }
+            unsigned long from = b.sets.poollength;
+            for (i = 0; i < counts[sym]; i++) {
+                subsets_push(&b.sets, targets[sym][i]);
+            }
+            int to = find_state(&b, from, subsets_closure(&b.sets, from, counts[sym]));
+            if (to < 0) {
+                result = -1;
+                break;
+            }
+            d->next[(size_t)state * d->nsyms + sym] = to;
+        }
+    }
+
+    for (sym = 0; sym < d->nsyms; sym++) {
+        free(targets[sym]);
+    }
+    free(targets);
+    free(counts);
+    free(sizes);
+    free(setstart);
+    free(setsyms);
+    subsets_free(&b.sets);
+    if (result < 0) {
+        dfa_free(d);
+    }
+    return result;
+}
+
+void dfa_free(struct dfa * d) {
+    free(d->next);
+    free(d->accepting);
+    d->next = NULL;
+    d->accepting = NULL;
+}
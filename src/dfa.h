@@ -0,0 +1,63 @@
+//
+//  dfa.h
+//  regen
+//  Turns an NFA into a deterministic automaton over classes of interchangeable characters.
+//
+
+#include "global.h"
+#include "nfa.h"
+
+#ifndef dfa_h
+#define dfa_h
+
+/*
+ Characters that every set of the NFA either holds together or leaves out together can't be told apart by the
+ automaton, so they share one symbol, and the automaton has one move per symbol rather than one per character.
+ */
+struct dfa {
+    int nstates;
+    int nsyms;
+    int start;
+    int * next;                   //next[state * nsyms + symbol], or -1 if the symbol leads nowhere.
+    unsigned char * accepting;    //per state
+    short symbol[256];            //The symbol of each character, or -1 if no set holds it.
+    int symstart[257];            //The characters of symbol s are symchars[symstart[s]] to symchars[symstart[s + 1] - 1].
+    unsigned char symchars[256];
+};
+
+/*
+ The sets of NFA states that the subset construction makes into DFA states, numbered in the order they are found.
+ dfa_build makes the whole DFA with them, and the matcher in match.c makes it lazily; each keeps its own moves.
+ */
+struct subsets {
+    const struct nfa * n;
+    int count;                    //Sets found so far.
+    int capacity;                 //of offsets, in sets.
+    int * pool;                   //The NFA states of every set, one after another.
+    unsigned long poollength;
+    unsigned long poolsize;
+    unsigned long * offsets;      //Where each set starts in pool; offsets[count] is the end.
+    int * table;                  //Hash table of sets, -1 for empty slots.
+    unsigned long tablesize;
+    int * marks;                  //per NFA state, the last closure that reached it.
+    int stamp;
+    int * stack;
+};
+
+void subsets_init(struct subsets * s, const struct nfa * n);
+void subsets_push(struct subsets * s, int q);
+unsigned long subsets_closure(struct subsets * s, unsigned long from, unsigned long count);
+int subsets_find(struct subsets * s, unsigned long from, unsigned long length, int max);
+int subsets_accepting(const struct subsets * s, int set);
+void subsets_clear(struct subsets * s);
+void subsets_free(struct subsets * s);
+
+int dfa_build(struct dfa * d, const struct nfa * n);
+void dfa_partition(struct dfa * d, const struct nfa * n);
+void dfa_free(struct dfa * d);
+
+#endif /* dfa_h */
+
+#ifndef MAX_DFA_STATES
+#define MAX_DFA_STATES (1 << 18)
+#endif
@@ -0,0 +1,388 @@
+//
+//  enumerate.c
+//  regen
+//  Lists every string a pattern matches, in order, or any stretch of that list.
+//
+
+#include "enumerate.h"
+#include "nfa.h"
+#include "dfa.h"
+
+/*
+ Walking the parse tree itself would list a string once for every way the pattern can make it (a*a* makes "aa"
+ three ways), so the list is walked on the pattern's DFA instead, where every string has exactly one path.
+
+ The walk is a depth-first search from the start state, trying characters in byte order and writing out a string
+ whenever it stops somewhere it may stop: at an accepting state (ENUMERATE_LEX), or at an accepting state after
+ exactly budget characters, for each budget from 0 up (ENUMERATE_LENGTH).  It only needs the string so far and the
+ state after each of its prefixes, and moving to the next string takes a few steps on average.
+
+ To skip branches that lead nowhere, and to start anywhere in the list, the number of strings each branch holds is
+ counted ahead of time, for every state and every number of characters left:
+
+    count(s, 0) = 1 if s accepts, else 0
+    count(s, r) = (s accepts, for ENUMERATE_LEX) + sum over the characters c of count(next(s, c), r - 1)
+
+ With those, string k of the list is found by going down one character at a time, skipping whole branches of fewer
+ than k strings.  That is what lets a long list be cut into stretches that threads work through on their own.
+ Counts stop at UINT64_MAX rather than wrapping; a list that long is cut short there.
+ */
+
+static uint64_t add(uint64_t a, uint64_t b) {
+    return a + b < a ? UINT64_MAX : a + b;
+}
+
+/*
+ Marks the states that some string leads from to an accepting state.
+ */
+static void find_productive(const struct dfa * d, unsigned char * productive) {
+    int * rstart = (int *)calloc(d->nstates + 1, sizeof(int));
+    int * rfrom = (int *)malloc(((size_t)d->nstates * d->nsyms + 1) * sizeof(int));
+    int * queue = (int *)malloc(d->nstates * sizeof(int));
+    int s;
+    int sym;
+    int head = 0;
+    int tail = 0;
+    if (rstart == NULL || rfrom == NULL || queue == NULL) { printf("malloc failure.\n"); exit(1); }
+
+    //The moves into each state.
+    for (s = 0; s < d->nstates; s++) {
+        for (sym = 0; sym < d->nsyms; sym++) {
+            int t = d->next[(size_t)s * d->nsyms + sym];
+            if (t >= 0) {
+                rstart[t + 1]++;
+            }
+        }
+    }
+    for (s = 0; s < d->nstates; s++) {
+        rstart[s + 1] += rstart[s];
+    }
+    for (s = 0; s < d->nstates; s++) {
+        for (sym = 0; sym < d->nsyms; sym++) {
+            int t = d->next[(size_t)s * d->nsyms + sym];
+            if (t >= 0) {
+                rfrom[rstart[t]++] = s;
+            }
+        }
+    }
+    for (s = d->nstates; s > 0; s--) {
+        rstart[s] = rstart[s - 1];
+    }
+    rstart[0] = 0;
+
+    for (s = 0; s < d->nstates; s++) {
+        productive[s] = d->accepting[s];
+        if (productive[s]) {
+            queue[tail++] = s;
+        }
+    }
+    while (head < tail) {
+        int t = queue[head++];
+        int j = rstart[t];
+        for (; j < rstart[t + 1]; j++) {
+            if (!productive[rfrom[j]]) {
+                productive[rfrom[j]] = 1;
+                queue[tail++] = rfrom[j];
+            }
+        }
+    }
+    free(rstart);
+    free(rfrom);
+    free(queue);
+}
+
+/*
+ @return the length of the longest string the pattern matches, -1 if it matches none, or -2 if there is no longest.
+ The moves have already been cut down to those between productive states, so any loop means strings of every length.
+ */
+static long longest(const struct enumeration * e) {
+    unsigned char * color = (unsigned char *)calloc(e->nstates, 1); //0 unseen, 1 on the stack, 2 done
+    long * length = (long *)malloc(e->nstates * sizeof(long));
+    int * stack = (int *)malloc(e->nstates * sizeof(int));
+    int * edge = (int *)malloc(e->nstates * sizeof(int));
+    int top = 0;
+    long result;
+    if (color == NULL || length == NULL || stack == NULL || edge == NULL) { printf("malloc failure.\n"); exit(1); }
+
+    if (e->cstart[e->start] == e->cstart[e->start + 1] && !e->accepting[e->start]) {
+        result = -1;
+        goto done;
+    }
+    stack[0] = e->start;
+    edge[0] = e->cstart[e->start];
+    color[e->start] = 1;
+    length[e->start] = e->accepting[e->start] ? 0 : -1;
+    while (top >= 0) {
+        int s = stack[top];
+        if (edge[top] == e->cstart[s + 1]) {
+            color[s] = 2;
+            top--;
+            if (top >= 0 && length[s] + 1 > length[stack[top]]) {
+                length[stack[top]] = length[s] + 1;
+            }
+            continue;
+        }
+        int t = e->cnext[edge[top]++];
+        if (color[t] == 1) {
+            result = -2;
+            goto done;
+        }
+        if (color[t] == 2) {
+            if (length[t] + 1 > length[s]) {
+                length[s] = length[t] + 1;
+            }
+            continue;
+        }
+        color[t] = 1;
+        length[t] = e->accepting[t] ? 0 : -1;
+        top++;
+        stack[top] = t;
+        edge[top] = e->cstart[t];
+    }
+    result = length[e->start];
+
+done:
+    free(color);
+    free(length);
+    free(stack);
+    free(edge);
+    return result;
+}
+
+/*
+ @param e filled in with the tables.  Release them with enumerate_free.
+ @param tree the parse tree of the pattern.
+ @param max the longest string to list, or -1 to list them all.
+ @param order ENUMERATE_LENGTH or ENUMERATE_LEX.
+ @return ENUMERATE_OK, ENUMERATE_EINFINITE if max is -1 but there is no longest string, or ENUMERATE_ELIMIT if the
+ tables would be bigger than MAX_ENUMERATE_TABLE entries (or the automaton bigger than MAX_NFA_STATES or
+ MAX_DFA_STATES states).
+ */
+int enumerate_build(struct enumeration * e, struct token * tree, long max, int order) {
+    struct nfa n;
+    struct dfa d;
+    unsigned long r;
+    int s;
+    int c;
+
+    memset(e, 0, sizeof(*e));
+    e->order = order;
+    if (nfa_build(&n, tree) < 0) {
+        nfa_free(&n);
+        return ENUMERATE_ELIMIT;
+    }
+    int built = dfa_build(&d, &n);
+    nfa_free(&n);
+    if (built < 0) {
+        return ENUMERATE_ELIMIT;
+    }
+
+    //The characters that lead on from each state, skipping those that lead where nothing can match.
+    unsigned char * productive = (unsigned char *)malloc(d.nstates);
+    if (productive == NULL) { printf("malloc failure.\n"); exit(1); }
+    find_productive(&d, productive);
+    unsigned long moves = 0;
+    for (s = 0; s < d.nstates; s++) {
+        for (c = 0; c < 256; c++) {
+            moves += d.symbol[c] >= 0 && d.next[(size_t)s * d.nsyms + d.symbol[c]] >= 0
+                     && productive[d.next[(size_t)s * d.nsyms + d.symbol[c]]];
+        }
+    }
+    e->nstates = d.nstates;
+    e->start = d.start;
+    e->accepting = d.accepting;
+    d.accepting = NULL;
+    if (moves > MAX_ENUMERATE_TABLE) {
+        free(productive);
+        dfa_free(&d);
+        enumerate_free(e);
+        return ENUMERATE_ELIMIT;
+    }
+    e->cstart = (int *)malloc((d.nstates + 1) * sizeof(int));
+    e->cchar = (unsigned char *)malloc(moves + 1);
+    e->cnext = (int *)malloc((moves + 1) * sizeof(int));
+    if (e->cstart == NULL || e->cchar == NULL || e->cnext == NULL) { printf("malloc failure.\n"); exit(1); }
+    moves = 0;
+    for (s = 0; s < d.nstates; s++) {
+        e->cstart[s] = (int)moves;
+        for (c = 0; c < 256; c++) {
+            int t = d.symbol[c] >= 0 ? d.next[(size_t)s * d.nsyms + d.symbol[c]] : -1;
+            if (t >= 0 && productive[t]) {
+                e->cchar[moves] = (unsigned char)c;
+                e->cnext[moves] = t;
+                moves++;
+            }
+        }
+    }
+    e->cstart[d.nstates] = (int)moves;
+    free(productive);
+    dfa_free(&d);
+
+    long most = longest(e);
+    if (most == -2 && max < 0) {
+        enumerate_free(e);
+        return ENUMERATE_EINFINITE;
+    }
+    if (most == -1) {
+        most = 0;  //Nothing matches; the list is empty.
+    }
+    e->max = (most >= 0 && (max < 0 || most < max)) ? (unsigned long)most : (unsigned long)max;
+    if (e->max + 1 > MAX_ENUMERATE_TABLE / (unsigned long)e->nstates) {
+        enumerate_free(e);
+        return ENUMERATE_ELIMIT;
+    }
+
+    e->count = (uint64_t *)malloc((e->max + 1) * e->nstates * sizeof(uint64_t));
+    if (e->count == NULL) { printf("malloc failure.\n"); exit(1); }
+    for (s = 0; s < e->nstates; s++) {
+        e->count[s] = e->accepting[s];
+    }
+    for (r = 1; r <= e->max; r++) {
+        uint64_t * row = e->count + r * e->nstates;
+        const uint64_t * prev = row - e->nstates;
+        for (s = 0; s < e->nstates; s++) {
+            uint64_t total = order == ENUMERATE_LEX ? e->accepting[s] : 0;
+            int j = e->cstart[s];
+            for (; j < e->cstart[s + 1]; j++) {
+                total = add(total, prev[e->cnext[j]]);
+            }
+            row[s] = total;
+        }
+    }
+    if (order == ENUMERATE_LEX) {
+        e->total = e->count[e->max * e->nstates + e->start];
+    } else {
+        for (r = 0; r <= e->max; r++) {
+            e->total = add(e->total, e->count[r * e->nstates + e->start]);
+        }
+    }
+    return ENUMERATE_OK;
+}
+
+void enumerate_free(struct enumeration * e) {
+    free(e->count);
+    free(e->accepting);
+    free(e->cstart);
+    free(e->cchar);
+    free(e->cnext);
+    e->count = NULL;
+    e->accepting = NULL;
+    e->cstart = NULL;
+    e->cchar = NULL;
+    e->cnext = NULL;
+}
+
+void enum_iter_init(struct enum_iter * it, const struct enumeration * e) {
+    it->e = e;
+    it->states = (int *)malloc((e->max + 1) * sizeof(int));
+    it->next = (int *)malloc((e->max + 1) * sizeof(int));
+    it->string = (char *)malloc(e->max + 1);
+    if (it->states == NULL || it->next == NULL || it->string == NULL) { printf("malloc failure.\n"); exit(1); }
+    enum_iter_seek(it, 0);
+}
+
+void enum_iter_free(struct enum_iter * it) {
+    free(it->states);
+    free(it->next);
+    free(it->string);
+}
+
+//Whether the walk may stop where it is and write out the string so far.
+static int stops(const struct enum_iter * it) {
+    return it->e->accepting[it->states[it->length]] && (it->e->order == ENUMERATE_LEX || it->length == it->budget);
+}
+
+//Strings from state s with r characters to go.
+static uint64_t strings(const struct enumeration * e, int s, unsigned long r) {
+    return e->count[r * e->nstates + s];
+}
+
+//Goes on to character j from the end of the string.
+static void push(struct enum_iter * it, int j) {
+    const struct enumeration * e = it->e;
+    it->next[it->length] = j + 1;
+    it->string[it->length] = (char)e->cchar[j];
+    it->length++;
+    it->states[it->length] = e->cnext[j];
+    it->next[it->length] = e->cstart[e->cnext[j]];
+}
+
+/*
+ Moves to string rank of the list, going down from the start state and skipping every branch that ends before it.
+ */
+void enum_iter_seek(struct enum_iter * it, uint64_t rank) {
+    const struct enumeration * e = it->e;
+    it->rank = rank;
+    it->done = rank >= e->total;
+    if (it->done) {
+        return;
+    }
+    it->budget = e->max;
+    if (e->order == ENUMERATE_LENGTH) {
+        for (it->budget = 0; rank >= strings(e, e->start, it->budget); it->budget++) {
+            rank -= strings(e, e->start, it->budget);
+        }
+    }
+    it->length = 0;
+    it->states[0] = e->start;
+    it->next[0] = e->cstart[e->start];
+    for (;;) {
+        if (stops(it)) {
+            if (rank == 0) {
+                return;
+            }
+            rank--;
+        }
+        int s = it->states[it->length];
+        unsigned long r = it->budget - it->length;
+        int j = e->cstart[s];
+        for (; j < e->cstart[s + 1]; j++) {
+            uint64_t count = strings(e, e->cnext[j], r - 1);
+            if (rank < count) {
+                break;
+            }
+            rank -= count;
+        }
+        push(it, j);
+    }
+}
+
+/*
+ Moves to the next string of the list: further down if the string so far leads on to more, otherwise back up to the
+ nearest prefix with a later character to try.
+ */
+void enum_iter_next(struct enum_iter * it) {
+    const struct enumeration * e = it->e;
+    if (it->done) {
+        return;
+    }
+    it->rank++;
+    if (it->rank >= e->total) {
+        it->done = 1;
+        return;
+    }
+    for (;;) {
+        int s = it->states[it->length];
+        unsigned long r = it->budget - it->length;
+        int j = it->next[it->length];
+        if (r > 0) {
+            while (j < e->cstart[s + 1] && strings(e, e->cnext[j], r - 1) == 0) {
+                j++;
+            }
+        }
+        if (r > 0 && j < e->cstart[s + 1]) {
+            push(it, j);
+            if (stops(it)) {
+                return;
+            }
+        } else if (it->length > 0) {
+            it->length--;
+        } else {
+            //Every string of this length is out; start on the next length that has any.
+            do {
+                it->budget++;
+            } while (strings(e, e->start, it->budget) == 0);
+            it->next[0] = e->cstart[e->start];
+        }
+    }
+}
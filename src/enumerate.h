@@ -0,0 +1,67 @@
+//
+//  enumerate.h
+//  regen
+//  Lists every string a pattern matches, in order, or any stretch of that list.
+//
+
+#include "global.h"
+#include "strbuf.h"
+
+#ifndef enumerate_h
+#define enumerate_h
+
+#include <stdint.h>
+
+enum enumerate_order {
+    ENUMERATE_LENGTH = 0,         //Shorter strings first, and strings of the same length in byte order.
+    ENUMERATE_LEX                 //Byte order, each string right before the strings it is a prefix of.
+};
+
+enum enumerate_result {
+    ENUMERATE_OK = 0,
+    ENUMERATE_EINFINITE,          //The pattern matches strings of every length, and no longest length was given.
+    ENUMERATE_ELIMIT              //The automaton or its tables would be too big.
+};
+
+/*
+ Read-only once built, so any number of threads can walk their own parts of the list at once.
+ */
+struct enumeration {
+    int order;
+    int nstates;
+    int start;
+    unsigned long max;            //Longest string listed.
+    uint64_t total;               //Strings listed, or UINT64_MAX if there are at least that many.
+    uint64_t * count;             //count[r * nstates + s]: strings listed from state s with r characters to go.
+    unsigned char * accepting;
+    int * cstart;                 //The characters leading on from state s are cchar[cstart[s]] to cchar[cstart[s + 1] - 1],
+    unsigned char * cchar;        //in byte order,
+    int * cnext;                  //each going to state cnext[j].
+};
+
+//A place in the list, and the string there.
+struct enum_iter {
+    const struct enumeration * e;
+    uint64_t rank;                //Index of the string in the list.
+    int done;                     //Set once rank is past the end of the list.
+    unsigned long length;         //of the string, which is also how deep the walk is.
+    unsigned long budget;         //Characters the walk may use; the length of every string being listed, by length.
+    int * states;                 //The state after each prefix of the string,
+    int * next;                   //and the next of its characters to try after it.
+    char * string;
+};
+
+int enumerate_build(struct enumeration * e, struct token * tree, long max, int order);
+void enumerate_free(struct enumeration * e);
+
+void enum_iter_init(struct enum_iter * it, const struct enumeration * e);
+void enum_iter_seek(struct enum_iter * it, uint64_t rank);
+void enum_iter_next(struct enum_iter * it);
+void enum_iter_free(struct enum_iter * it);
+
+#endif /* enumerate_h */
+
+//Most entries the count and move tables may hold together.
+#ifndef MAX_ENUMERATE_TABLE
+#define MAX_ENUMERATE_TABLE (1 << 24)
+#endif
@@ -0,0 +1,168 @@
+//
+//  fill.c
+//  regen
+//  Fills a run of characters drawn from one character class, many at a time.
+//
+
+#include "fill.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+//The pshufb lookup is built whenever SSE2 is: for the target outright, or to be picked at run time on x86.
+#if defined(__SSE2__) && (defined(__SSSE3__) || (defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))))
+#define FILL_PSHUFB
+#if defined(__SSSE3__)
+#define FILL_SSSE3
+#else
+#define FILL_SSSE3 __attribute__((target("ssse3")))
+#endif
+#endif
+
+/*
+ Patterns like [a-z]{1000} or [0-9]+ repeat a single character class many times in a row.  Once the loop's count is
+ known, fill_run writes the whole run at once instead of going through the interpreter for every character.
+
+ Each 64 bit random number is cut into four 16 bit lanes, lowest first.  A lane v becomes the index (v * n) >> 16,
+ which is Lemire's multiply-shift reduction; it is exactly uniform once lanes whose low half, (v * n) & 0xFFFF, is
+ below 65536 % n are thrown away.  For classes of at most a few hundred characters that happens to well under one
+ lane in a hundred.  A run that ends partway through a random number throws away the lanes it didn't need.
+
+ With SSE2, eight lanes are reduced at once, and when none of them is rejected the characters are looked up
+ together.  A class of at most 16 characters is looked up with a single pshufb when the CPU has SSSE3: that loop is
+ compiled for SSSE3 on its own and picked at run time, so the default build, which only assumes SSE2, has it too.
+ When a lane is rejected, those random numbers are handled by the scalar code instead, so every path consumes and
+ uses the random numbers exactly the same way and the output for a seed is the same on every platform.
+ */
+
+/*
+ @return the rejection threshold for a class of n characters, 65536 % n.
+ */
+uint16_t run_threshold(unsigned long n) {
+    return (uint16_t)(65536 % n);
+}
+
+/*
+ Writes as many characters as the four lanes of x give, up to count.  Returns the number written.
+ */
+static inline size_t fill_lanes(uint64_t x, char * dst, size_t count, const char * chars, unsigned long n,
+                                uint16_t threshold) {
+    size_t written = 0;
+    int lane = 0;
+    for (; lane < 4 && written < count; lane++) {
+        uint32_t m = (uint32_t)((x >> (16 * lane)) & 0xFFFF) * (uint32_t)n;
+        if ((uint16_t)m >= threshold) {
+            dst[written++] = chars[m >> 16];
+        }
+    }
+    return written;
+}
+
+#if defined(__SSE2__)
+/*
+ Reduces the eight lanes of a and b to indexes into the class.  Returns 0 if none was rejected.
+ */
+static inline int reduce_sse2(uint64_t a, uint64_t b, unsigned long n, uint16_t threshold, __m128i * index) {
+    __m128i v = _mm_set_epi64x((long long)b, (long long)a);
+    __m128i mult = _mm_set1_epi16((short)n);
+    *index = _mm_mulhi_epu16(v, mult);
+    __m128i low = _mm_mullo_epi16(v, mult);
+    //Unsigned low < threshold, done as a signed compare with both sides shifted by 0x8000.
+    __m128i bias = _mm_set1_epi16((short)0x8000);
+    __m128i rejected = _mm_cmplt_epi16(_mm_xor_si128(low, bias), _mm_xor_si128(_mm_set1_epi16((short)threshold), bias));
+    return _mm_movemask_epi8(rejected);
+}
+
+/*
+ Writes the run eight characters at a time while at least eight are left.  Returns the number written.
+ */
+static size_t fill_sse2(struct rng * g, char * dst, size_t count, const char * chars, unsigned long n,
+                        uint16_t threshold) {
+    size_t done = 0;
+    struct rng local = *g;
+    uint16_t lanes[8];
+    while (count - done >= 8) {
+        uint64_t a = rng_next(&local);
+        uint64_t b = rng_next(&local);
+        __m128i index;
+        if (reduce_sse2(a, b, n, threshold, &index)) {
+            done += fill_lanes(a, dst + done, count - done, chars, n, threshold);
+            done += fill_lanes(b, dst + done, count - done, chars, n, threshold);
+            continue;
+        }
+        int i = 0;
+        _mm_storeu_si128((__m128i *)lanes, index);
+        for (; i < 8; i++) {
+            dst[done + i] = chars[lanes[i]];
+        }
+        done += 8;
+    }
+    *g = local;
+    return done;
+}
+#endif
+
+#if defined(FILL_PSHUFB)
+/*
+ fill_sse2 for a class of at most 16 characters, whose eight characters are looked up with one pshufb.
+ */
+static FILL_SSSE3 size_t fill_pshufb(struct rng * g, char * dst, size_t count, const char * chars, unsigned long n,
+                                     uint16_t threshold) {
+    size_t done = 0;
+    struct rng local = *g;
+    __m128i table = _mm_loadu_si128((const __m128i *)chars);
+    while (count - done >= 8) {
+        uint64_t a = rng_next(&local);
+        uint64_t b = rng_next(&local);
+        __m128i index;
+        if (reduce_sse2(a, b, n, threshold, &index)) {
+            done += fill_lanes(a, dst + done, count - done, chars, n, threshold);
+            done += fill_lanes(b, dst + done, count - done, chars, n, threshold);
+            continue;
+        }
+        _mm_storel_epi64((__m128i *)(dst + done), _mm_shuffle_epi8(table, _mm_packus_epi16(index, index)));
+        done += 8;
+    }
+    *g = local;
+    return done;
+}
+
+static int has_ssse3(void) {
+#if defined(__SSSE3__)
+    return 1;
+#else
+    return __builtin_cpu_supports("ssse3");
+#endif
+}
+#endif
+
+/*
+ @param g the random number generator to draw from
+ @param dst where the run is written; it must have room for count characters
+ @param count the length of the run
+ @param chars the character class
+ @param n the number of characters in the class, at most MAX_RUN_CLASS_SIZE.  chars must be readable for 16 bytes
+        when n is 16 or less.
+ @param threshold run_threshold(n)
+ */
+void fill_run(struct rng * g, char * dst, size_t count, const char * chars, unsigned long n, uint16_t threshold) {
+    size_t done = 0;
+    //A private copy of the generator: the characters written to dst could alias *g as far as the compiler knows,
+    //which would force the state to be stored and reloaded around every write.
+    struct rng local = *g;
+
+#if defined(FILL_PSHUFB)
+    if (n <= 16 && has_ssse3()) {
+        done = fill_pshufb(&local, dst, count, chars, n, threshold);
+    } else {
+        done = fill_sse2(&local, dst, count, chars, n, threshold);
+    }
+#elif defined(__SSE2__)
+    done = fill_sse2(&local, dst, count, chars, n, threshold);
+#endif
+    while (done < count) {
+        done += fill_lanes(rng_next(&local), dst + done, count - done, chars, n, threshold);
+    }
+    *g = local;
+}
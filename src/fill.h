@@ -0,0 +1,24 @@
+//
+//  fill.h
+//  regen
+//
+//  Fills a run of characters drawn from one character class, many at a time.
+//
+
+#include "global.h"
+#include "rng.h"
+
+#ifndef fill_h
+#define fill_h
+
+#include <stdint.h>
+
+uint16_t run_threshold(unsigned long n);
+void fill_run(struct rng * g, char * dst, size_t count, const char * chars, unsigned long n, uint16_t threshold);
+
+#endif /* fill_h */
+
+//Classes with more characters than this are repeated one character at a time instead.
+#ifndef MAX_RUN_CLASS_SIZE
+#define MAX_RUN_CLASS_SIZE 65535
+#endif
@@ -12,6 +12,7 @@ struct token {
     int * code;
     void **element;
     unsigned long length;  //of element.
+    int position;          //Index into the pattern of the operator that made the node, or of where the node starts.
 };
 
 #endif /* global_h */
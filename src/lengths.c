@@ -0,0 +1,681 @@
+//
+//  lengths.c
+//  regen
+//  Works out how long the strings of each part of a pattern can be, and generates strings of a chosen length range.
+//
+
+#include "lengths.h"
+#include <math.h>
+
+/*
+ The shortest and longest lengths of a subtree follow from its children's.  They say roughly how long a pattern's
+ strings are, but not whether a given length can be made: (ab)* makes 4 characters but never 3.  So to generate strings
+ between min and max characters, every node also gets the exact set of lengths up to max it can make, as a bitset:
+
+ * a class is {1} and a literal {its length};
+ * a sequence is the sum set of its children's sets, {a + b + ...}; the sum set of the children from i on is kept
+   for each i;
+ * | is the union of its branches', and ? adds 0 to its child's;
+ * a repeat keeps the sets of k copies of its child for each k, P(0) = {0} and P(k + 1) = P(k) + child, until k
+   reaches the repeat's bound, the set is empty (everything is past max), or it stops changing (the child can make
+   "", so more copies add nothing new).  Its own set is the union over the counts it allows.
+
+ Generating is then the same walk generate_into makes, with each node given the set of lengths it may produce, so
+ that the rest of the string can still be finished.  Every choice (a branch, whether ? is taken, a repeat count)
+ only considers the options that can produce one of those lengths, with the same chances relative to each other as
+ without a window: repeat counts still follow the geometric distribution for * and +, and are uniform for {n:m},
+ only limited to the counts that fit.  Each child of a sequence, and each copy of a repeat, gets the lengths after
+ which what follows can still make up a length in the set.  So every string lands in the window, with no retries.
+
+ Subtrees that always make the same number of characters have nothing to fit, and are generated without sets.
+ */
+
+#define INFINITE_ADD(a, b) ((a) == LENGTH_UNBOUNDED || (b) == LENGTH_UNBOUNDED || (a) + (b) < (a) ? LENGTH_UNBOUNDED : (a) + (b))
+
+static struct token * child(struct token * node, unsigned long i) {
+    return ((struct token **)(node->element))[i];
+}
+
+static unsigned long multiply(unsigned long a, unsigned long n) {
+    if (a == LENGTH_UNBOUNDED || (n != 0 && a > LENGTH_UNBOUNDED / n)) {
+        return n == 0 ? 0 : LENGTH_UNBOUNDED;
+    }
+    return a * n;
+}
+
+/*
+ @return the fewest characters the subtree can produce.
+ */
+unsigned long min_length_of(struct token * subtree) {
+    unsigned long total = 0;
+    unsigned long i = 0;
+    switch (subtree->code[0]) {
+        case 0:
+            return 1;
+        case 8:
+            return subtree->length;
+        case 1:
+            for (; i < subtree->length; i++) {
+                total = INFINITE_ADD(total, min_length_of(child(subtree, i)));
+            }
+            return total;
+        case 3:
+            return min_length_of(child(subtree, 0));
+        case 5:
+        case 6:
+            return multiply(min_length_of(child(subtree, 0)), subtree->code[1]);
+        case 7:
+        case 9:
+            total = LENGTH_UNBOUNDED;
+            for (; i < subtree->length; i++) {
+                unsigned long each = min_length_of(child(subtree, i));
+                total = each < total ? each : total;
+            }
+            return total;
+        default: //* and ?
+            return 0;
+    }
+}
+
+/*
+ @return the most characters the subtree can produce, or LENGTH_UNBOUNDED if there is no most.
+ */
+unsigned long max_length_of(struct token * subtree) {
+    unsigned long total = 0;
+    unsigned long i = 0;
+    switch (subtree->code[0]) {
+        case 0:
+            return 1;
+        case 8:
+            return subtree->length;
+        case 1:
+            for (; i < subtree->length; i++) {
+                total = INFINITE_ADD(total, max_length_of(child(subtree, i)));
+            }
+            return total;
+        case 2:
+        case 3:
+            return max_length_of(child(subtree, 0)) == 0 ? 0 : LENGTH_UNBOUNDED;
+        case 4:
+            return max_length_of(child(subtree, 0));
+        case 5:
+            return multiply(max_length_of(child(subtree, 0)), subtree->code[1]);
+        case 6:
+            return multiply(max_length_of(child(subtree, 0)), subtree->code[2]);
+        default: //| and weighted |
+            for (; i < subtree->length; i++) {
+                unsigned long each = max_length_of(child(subtree, i));
+                total = each > total ? each : total;
+            }
+            return total;
+    }
+}
+
+/*
+ Bitsets of the lengths 0 to max.  Bits past max are always 0.
+ */
+struct builder {
+    struct window * w;
+    unsigned long table;          //uint64_ts handed out so far.
+    unsigned long work;           //Word operations spent on sum sets so far.
+    int failed;
+};
+
+static uint64_t * new_set(struct builder * b) {
+    b->table += b->w->words;
+    if (b->table > MAX_WINDOW_TABLE) {
+        b->failed = 1;
+    }
+    return (uint64_t *)arena_alloc(b->w->arena, b->w->words * sizeof(uint64_t));
+}
+
+static int set_has(const uint64_t * set, unsigned long n) {
+    return (set[n >> 6] >> (n & 63)) & 1;
+}
+
+static void set_add(uint64_t * set, unsigned long n) {
+    set[n >> 6] |= (uint64_t)1 << (n & 63);
+}
+
+static int set_any(const uint64_t * set, unsigned long words) {
+    unsigned long i = 0;
+    for (; i < words; i++) {
+        if (set[i]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int set_meets(const uint64_t * a, const uint64_t * b, unsigned long words) {
+    unsigned long i = 0;
+    for (; i < words; i++) {
+        if (a[i] & b[i]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//The 64 bits of set starting at bit from.
+static uint64_t set_word(const uint64_t * set, unsigned long words, unsigned long from) {
+    unsigned long w = from >> 6;
+    unsigned int shift = from & 63;
+    uint64_t word = w < words ? set[w] >> shift : 0;
+    if (shift && w + 1 < words) {
+        word |= set[w + 1] << (64 - shift);
+    }
+    return word;
+}
+
+//Whether {a - n : a in a} meets b.
+static int set_meets_down(const uint64_t * a, unsigned long n, const uint64_t * b, unsigned long words) {
+    unsigned long i = 0;
+    for (; i < words && (i << 6) + n < (words << 6); i++) {
+        if (set_word(a, words, (i << 6) + n) & b[i]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//set = {a - n : a in set, a >= n}
+static void set_shift_down(uint64_t * set, unsigned long n, unsigned long words) {
+    unsigned long i = 0;
+    for (; i < words; i++) {
+        set[i] = set_word(set, words, (i << 6) + n);
+    }
+}
+
+//to |= {a + n : a in from, a + n <= max}
+static void set_or_up(const struct window * w, uint64_t * to, const uint64_t * from, unsigned long n) {
+    unsigned long words = w->words;
+    unsigned long skip = n >> 6;
+    unsigned int shift = n & 63;
+    unsigned long i = skip;
+    for (; i < words; i++) {
+        uint64_t word = from[i - skip] << shift;
+        if (shift && i > skip) {
+            word |= from[i - skip - 1] >> (64 - shift);
+        }
+        to[i] |= word;
+    }
+    if ((w->max & 63) != 63) {
+        to[words - 1] &= ((uint64_t)1 << ((w->max & 63) + 1)) - 1;
+    }
+}
+
+//to = a + b, the sum set.
+static void sum_set(struct builder * b, uint64_t * to, const uint64_t * x, const uint64_t * y) {
+    unsigned long words = b->w->words;
+    unsigned long i = 0;
+    memset(to, 0, words * sizeof(uint64_t));
+    for (; i < words; i++) {
+        uint64_t word = y[i];
+        while (word) {
+            unsigned long n = (i << 6) + __builtin_ctzll(word);
+            word &= word - 1;
+            set_or_up(b->w, to, x, n);
+            b->work += words;
+        }
+    }
+    if (b->work > MAX_WINDOW_WORK) {
+        b->failed = 1;
+    }
+}
+
+/*
+ Works out the sets of k copies of the repeat's child, for every k the sets can tell apart, and the repeat's own set.
+ */
+static void build_powers(struct builder * b, struct shape * s, unsigned long low, unsigned long high) {
+    unsigned long words = b->w->words;
+    unsigned long size = 16;
+    unsigned long k = 0;
+    uint64_t ** powers;
+
+    //k copies of a child with only one length make k times that length, so there is no need to keep their sets.
+    unsigned long unit = s->children[0]->min;
+    if (unit == s->children[0]->max && unit > 0) {
+        s->npowers = 0;
+        s->stable = 0;
+        for (k = low; k <= high && k <= b->w->max / unit; k++) {
+            set_add(s->set, k * unit);
+        }
+        return;
+    }
+    powers = (uint64_t **)malloc(size * sizeof(uint64_t *));
+    if (powers == NULL) { printf("malloc failure.\n"); exit(1); }
+
+    powers[0] = new_set(b);
+    set_add(powers[0], 0);
+    s->npowers = 1;
+    s->stable = 0;
+    while (k < high && !b->failed) {
+        uint64_t * next = new_set(b);
+        sum_set(b, next, powers[k], s->children[0]->set);
+        if (!set_any(next, words)) {
+            break;
+        }
+        if (!memcmp(next, powers[k], words * sizeof(uint64_t))) {
+            s->stable = 1;
+            break;
+        }
+        if (s->npowers == size) {
+            size *= 2;
+            powers = (uint64_t **)realloc(powers, size * sizeof(uint64_t *));
+            if (powers == NULL) { printf("realloc failure.\n"); exit(1); }
+        }
+        powers[++k] = next;
+        s->npowers++;
+    }
+    s->powers = (uint64_t **)arena_alloc(b->w->arena, s->npowers * sizeof(uint64_t *));
+    memcpy(s->powers, powers, s->npowers * sizeof(uint64_t *));
+    free(powers);
+
+    //The repeat's set: every count from low to high.
+    unsigned long i;
+    for (k = low; k < s->npowers && k <= high; k++) {
+        for (i = 0; i < words; i++) {
+            s->set[i] |= s->powers[k][i];
+        }
+    }
+    if (s->stable && low >= s->npowers) {
+        memcpy(s->set, s->powers[s->npowers - 1], words * sizeof(uint64_t));
+    }
+}
+
+static struct shape * build(struct builder * b, struct token * t, unsigned long depth) {
+    struct shape * s = (struct shape *)arena_alloc(b->w->arena, sizeof(struct shape));
+    unsigned long words = b->w->words;
+    unsigned long n = (t->code[0] == 0 || t->code[0] == 8) ? 0 : t->length;
+    unsigned long i;
+
+    if (depth > b->w->depth) {
+        b->w->depth = depth;
+    }
+    s->token = t;
+    s->min = min_length_of(t);
+    s->max = max_length_of(t);
+    s->set = new_set(b);
+    s->children = (struct shape **)arena_alloc(b->w->arena, (n ? n : 1) * sizeof(struct shape *));
+    for (i = 0; i < n && !b->failed; i++) {
+        s->children[i] = build(b, child(t, i), depth + 1);
+    }
+    if (b->failed) {
+        return s;
+    }
+
+    switch (t->code[0]) {
+        case 0:
+        case 8:
+            if (s->min <= b->w->max) {
+                set_add(s->set, s->min);
+            }
+            break;
+        case 1: //Sum sets from the end, so each child knows what the ones after it can make.
+            s->suffix = (uint64_t **)arena_alloc(b->w->arena, (n + 1) * sizeof(uint64_t *));
+            s->suffix[n] = new_set(b);
+            set_add(s->suffix[n], 0);
+            for (i = n; i > 0 && !b->failed; i--) {
+                s->suffix[i - 1] = i == 1 ? s->set : new_set(b);
+                sum_set(b, s->suffix[i - 1], s->suffix[i], s->children[i - 1]->set);
+            }
+            break;
+        case 2:
+            build_powers(b, s, 0, LENGTH_UNBOUNDED);
+            break;
+        case 3:
+            build_powers(b, s, 1, LENGTH_UNBOUNDED);
+            break;
+        case 4:
+            memcpy(s->set, s->children[0]->set, words * sizeof(uint64_t));
+            set_add(s->set, 0);
+            break;
+        case 5:
+            build_powers(b, s, t->code[1], t->code[1]);
+            break;
+        case 6:
+            build_powers(b, s, t->code[1], t->code[2]);
+            break;
+        default: //| and weighted |
+            for (i = 0; i < n; i++) {
+                unsigned long j = 0;
+                for (; j < words; j++) {
+                    s->set[j] |= s->children[i]->set[j];
+                }
+            }
+            break;
+    }
+    return s;
+}
+
+/*
+ @param w filled in with the sets for generating strings of min to max characters.  Release it with window_free.
+ @param a the arena the tree was built in.  The window takes it over, and destroys it in window_free.
+ @param tree the parse tree of the pattern.
+ @return WINDOW_OK, WINDOW_ENOMATCH if the pattern makes no string of a length from min to max, or WINDOW_ELIMIT if
+ the sets would take more than MAX_WINDOW_TABLE uint64_ts or MAX_WINDOW_WORK steps to work out.  The arena is
+ destroyed on failure as well.
+ */
+int window_build(struct window * w, struct arena * a, struct token * tree, unsigned long min, unsigned long max) {
+    struct builder b;
+    unsigned long n;
+
+    memset(w, 0, sizeof(*w));
+    w->arena = a;
+    w->min = min;
+    w->max = max;
+    w->words = max / 64 + 1;
+    b.w = w;
+    b.table = 0;
+    b.work = 0;
+    b.failed = 0;
+    if (w->words > MAX_WINDOW_TABLE) {
+        window_free(w);
+        return WINDOW_ELIMIT;
+    }
+    w->root = build(&b, tree, 1);
+    if (b.failed) {
+        window_free(w);
+        return WINDOW_ELIMIT;
+    }
+    w->target = new_set(&b);
+    for (n = min; n <= max; n++) {
+        if (set_has(w->root->set, n)) {
+            set_add(w->target, n);
+        }
+    }
+    if (!set_any(w->target, w->words)) {
+        window_free(w);
+        return WINDOW_ENOMATCH;
+    }
+    return WINDOW_OK;
+}
+
+void window_free(struct window * w) {
+    if (w->arena) {
+        arena_destroy(w->arena);
+    }
+    w->arena = NULL;
+    w->root = NULL;
+}
+
+/*
+ Generating.  Each level of the tree has two sets of scratch space: the lengths still allowed, and the lengths
+ allowed for the child being generated.
+ */
+struct walk {
+    const struct window * w;
+    struct rng * rng;
+    double p;
+    double logp;
+    uint64_t * scratch;
+    struct strbuf * out;
+};
+
+static void put(struct walk * k, const char * chars, size_t length) {
+    memcpy(strbuf_reserve(k->out, length), chars, length);
+    k->out->length += length;
+}
+
+static unsigned long pick_weighted(struct rng * rng, const int * weights, unsigned long count, int total) {
+    int pick = (int)random_in(rng, 0, total);
+    unsigned long i = 0;
+    for (; i + 1 < count && pick >= weights[i]; i++) {
+        pick -= weights[i];
+    }
+    return i;
+}
+
+/*
+ Generates the subtree the way generate_into would.  Used for subtrees whose length can't vary.
+ */
+static void plain(struct walk * k, struct token * t) {
+    unsigned long i;
+    unsigned long count;
+    char c;
+    switch (t->code[0]) {
+        case 0:
+            c = ((char *)t->element)[random_in(k->rng, 0, t->length)];
+            put(k, &c, 1);
+            return;
+        case 8:
+            put(k, (char *)t->element, t->length);
+            return;
+        case 1:
+            for (i = 0; i < t->length; i++) {
+                plain(k, child(t, i));
+            }
+            return;
+        case 2:
+            count = random_geometric(k->rng, k->logp);
+            break;
+        case 3:
+            count = 1 + random_geometric(k->rng, k->logp);
+            break;
+        case 4:
+            count = random_float(k->rng) > 0.5;
+            break;
+        case 5:
+            count = t->code[1];
+            break;
+        case 6:
+            count = random_in(k->rng, t->code[1], t->code[2] + 1);
+            break;
+        case 7:
+            plain(k, child(t, random_in(k->rng, 0, t->length)));
+            return;
+        default:
+            plain(k, child(t, pick_weighted(k->rng, t->code + 2, t->length, t->code[1])));
+            return;
+    }
+    for (i = 0; i < count; i++) {
+        plain(k, child(t, 0));
+    }
+}
+
+static void fit(struct walk * k, const struct shape * s, const uint64_t * allowed, unsigned long depth);
+
+//The set of k copies of the repeat's child.
+static const uint64_t * power(const struct shape * s, unsigned long count) {
+    if (count < s->npowers) {
+        return s->powers[count];
+    }
+    return s->stable ? s->powers[s->npowers - 1] : NULL;
+}
+
+/*
+ Fills to with the lengths of the shape's set after which the rest can still produce a length of left.
+ */
+static void lengths_before(const struct walk * k, uint64_t * to, const struct shape * s, const uint64_t * left,
+                           const uint64_t * rest) {
+    unsigned long words = k->w->words;
+    unsigned long i = 0;
+    memset(to, 0, words * sizeof(uint64_t));
+    for (; i < words; i++) {
+        uint64_t word = s->set[i];
+        while (word) {
+            unsigned long n = (i << 6) + __builtin_ctzll(word);
+            word &= word - 1;
+            if (set_meets_down(left, n, rest, words)) {
+                set_add(to, n);
+            }
+        }
+    }
+}
+
+/*
+ Generates one child after another: a sequence's children (rest is the sets of what follows each), or count copies
+ of a repeat's child.  left holds the lengths still allowed and is used up along the way; children with only one
+ length don't need it, so it is only brought up to date before one that has a choice to make.
+ */
+static void fit_each(struct walk * k, const struct shape * s, uint64_t * left, unsigned long count,
+                     unsigned long depth) {
+    uint64_t * allowed = left + k->w->words;
+    size_t from = k->out->length;  //Where left was last brought up to date.
+    unsigned long i = 0;
+    for (; i < count; i++) {
+        const struct shape * c = s->children[s->token->code[0] == 1 ? i : 0];
+        if (c->min == c->max) {
+            plain(k, c->token);
+            continue;
+        }
+        const uint64_t * rest = s->token->code[0] == 1 ? s->suffix[i + 1] : power(s, count - i - 1);
+        set_shift_down(left, k->out->length - from, k->w->words);
+        lengths_before(k, allowed, c, left, rest);
+        from = k->out->length;
+        fit(k, c, allowed, depth + 1);
+    }
+}
+
+//Whether count copies of the repeat's child can produce a length allowed.
+static int count_fits(const struct walk * k, const struct shape * s, unsigned long count, const uint64_t * allowed) {
+    if (s->npowers == 0) {
+        return set_has(allowed, count * s->children[0]->min);
+    }
+    return set_meets(s->powers[count], allowed, k->w->words);
+}
+
+/*
+ Picks a repeat count the way generate_into would, out of the counts from low to high whose copies can produce a
+ length allowed.  * and + weigh count n by p^n; {n:m} weighs every count the same.  Weights are taken relative to the
+ fewest copies that fit, so a window far past the usual lengths doesn't leave them all too small to count.
+ */
+static unsigned long pick_count(struct walk * k, const struct shape * s, const uint64_t * allowed,
+                                unsigned long low, unsigned long high) {
+    int geometric = s->token->code[0] == 2 || s->token->code[0] == 3;
+    double ratio = geometric ? k->p : 1;
+    //The most copies with a set of their own; a child with one length fits k->w->max / length copies at most.
+    unsigned long most = s->npowers ? s->npowers - 1 : k->w->max / s->children[0]->min;
+    unsigned long last = most < high ? most : high;
+    unsigned long first = low;
+    unsigned long n;
+    double total = 0;
+    double weight = 1;
+    double tail = 0;
+
+    while (first <= last && !count_fits(k, s, first, allowed)) {
+        first++;
+    }
+    //Once the weight is too small to count, later counts can't be picked either.
+    for (n = first; n <= last && weight > 0; n++) {
+        if (count_fits(k, s, n, allowed)) {
+            total += weight;
+        }
+        weight *= ratio;
+    }
+    //Counts past the last set worked out all have that same set.
+    if (s->stable && high > last && set_meets(s->powers[last], allowed, k->w->words)) {
+        tail = geometric ? pow(k->p, (double)(last + 1 - (first <= last ? first : last + 1))) / (1 - k->p)
+                         : (double)(high - last);
+    }
+    if (first <= last && ratio == 0) {
+        return first;  //p is 0: * and + repeat as few times as they can.
+    }
+    double pick = random_float(k->rng) * (total + tail);
+    weight = 1;
+    for (n = first; n <= last && weight > 0; n++) {
+        if (count_fits(k, s, n, allowed)) {
+            if (pick < weight) {
+                return n;
+            }
+            pick -= weight;
+        }
+        weight *= ratio;
+    }
+    if (tail == 0) {
+        return first;  //Rounding left pick just past the end.
+    }
+    if (geometric) {
+        return last + 1 + random_geometric(k->rng, k->logp);
+    }
+    return last + 1 + random_in(k->rng, 0, high - last);
+}
+
+/*
+ Generates the subtree so that its length is one of allowed, which shares at least one length with the subtree's set.
+ */
+static void fit(struct walk * k, const struct shape * s, const uint64_t * allowed, unsigned long depth) {
+    unsigned long words = k->w->words;
+    uint64_t * left = k->scratch + depth * 2 * words;
+    struct token * t = s->token;
+    unsigned long i;
+    unsigned long count;
+
+    if (s->min == s->max) {
+        plain(k, t);
+        return;
+    }
+    switch (t->code[0]) {
+        case 1:
+            memcpy(left, allowed, words * sizeof(uint64_t));
+            fit_each(k, s, left, t->length, depth);
+            return;
+        case 2:
+            count = pick_count(k, s, allowed, 0, LENGTH_UNBOUNDED);
+            break;
+        case 3:
+            count = pick_count(k, s, allowed, 1, LENGTH_UNBOUNDED);
+            break;
+        case 5:
+            count = t->code[1];
+            break;
+        case 6:
+            count = pick_count(k, s, allowed, t->code[1], t->code[2]);
+            break;
+        case 4: { //Either choice that fits, 50/50 if both do.
+            int without = set_has(allowed, 0);
+            int with = set_meets(s->children[0]->set, allowed, words);
+            if (with && (!without || random_float(k->rng) > 0.5)) {
+                for (i = 0; i < words; i++) {
+                    left[i] = allowed[i] & s->children[0]->set[i];
+                }
+                fit(k, s->children[0], left, depth + 1);
+            }
+            return;
+        }
+        default: { //| and weighted |: the branches that fit, with their weights.
+            int total = 0;
+            for (i = 0; i < t->length; i++) {
+                if (set_meets(s->children[i]->set, allowed, words)) {
+                    total += t->code[0] == 9 ? t->code[2 + i] : 1;
+                }
+            }
+            int pick = (int)random_in(k->rng, 0, total);
+            for (i = 0; i < t->length; i++) {
+                if (set_meets(s->children[i]->set, allowed, words)) {
+                    int weight = t->code[0] == 9 ? t->code[2 + i] : 1;
+                    if (pick < weight) {
+                        break;
+                    }
+                    pick -= weight;
+                }
+            }
+            unsigned long j = 0;
+            for (; j < words; j++) {
+                left[j] = allowed[j] & s->children[i]->set[j];
+            }
+            fit(k, s->children[i], left, depth + 1);
+            return;
+        }
+    }
+    memcpy(left, allowed, words * sizeof(uint64_t));
+    fit_each(k, s, left, count, depth);
+}
+
+/*
+ Appends a string to out that the pattern matches and whose length is in the window, chosen the way generate_into
+ would choose, but only among the choices that fit.
+ */
+void window_generate(const struct window * w, float pval, struct rng * rng, struct strbuf * out) {
+    struct walk k;
+    k.w = w;
+    k.rng = rng;
+    k.p = pval;
+    k.logp = log(pval);
+    k.out = out;
+    k.scratch = (uint64_t *)malloc((w->depth + 2) * 2 * w->words * sizeof(uint64_t));
+    if (k.scratch == NULL) { printf("malloc failure.\n"); exit(1); }
+    fit(&k, w->root, w->target, 0);
+    free(k.scratch);
+}
@@ -0,0 +1,68 @@
+//
+//  lengths.h
+//  regen
+//  Works out how long the strings of each part of a pattern can be, and generates strings of a chosen length range.
+//
+
+#include "global.h"
+#include "arena.h"
+#include "rng.h"
+#include "strbuf.h"
+
+#ifndef lengths_h
+#define lengths_h
+
+#include <stdint.h>
+
+//Stands for a maximum length with no bound.
+#define LENGTH_UNBOUNDED ((unsigned long)-1)
+
+/*
+ What is known about the lengths of one node of the parse tree.  The sets are bitsets of every length from 0 to the
+ window's top that the node can produce, one bit per length.
+ */
+struct shape {
+    struct token * token;
+    unsigned long min;
+    unsigned long max;            //LENGTH_UNBOUNDED if there is no longest string.
+    uint64_t * set;
+    struct shape ** children;
+    uint64_t ** suffix;           //Sequences: suffix[i] is the lengths children i and on can produce together.
+    uint64_t ** powers;           //Repeats: powers[k] is the lengths k copies of the child can produce,
+    unsigned long npowers;        //for k up to npowers - 1.
+    int stable;                   //Whether powers[npowers - 1] is also the set for every larger k.
+};
+
+struct window {
+    struct arena * arena;         //Owns the tree and every shape.
+    struct shape * root;
+    unsigned long min;
+    unsigned long max;
+    unsigned long words;          //uint64_ts per set.
+    uint64_t * target;            //The lengths from min to max that the pattern can produce.
+    unsigned long depth;          //Of the tree, for the scratch space generating needs.
+};
+
+enum window_result {
+    WINDOW_OK = 0,
+    WINDOW_ENOMATCH,              //The pattern makes no string of a length in the window.
+    WINDOW_ELIMIT                 //The sets would take too much memory or time to work out.
+};
+
+unsigned long min_length_of(struct token * subtree);
+unsigned long max_length_of(struct token * subtree);
+
+int window_build(struct window * w, struct arena * a, struct token * tree, unsigned long min, unsigned long max);
+void window_generate(const struct window * w, float pval, struct rng * rng, struct strbuf * out);
+void window_free(struct window * w);
+
+#endif /* lengths_h */
+
+//Most uint64_ts the sets of one window may take, and most word operations spent working them out.
+#ifndef MAX_WINDOW_TABLE
+#define MAX_WINDOW_TABLE (1 << 22)
+#endif
+
+#ifndef MAX_WINDOW_WORK
+#define MAX_WINDOW_WORK (1UL << 30)
+#endif
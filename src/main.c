@@ -9,20 +9,49 @@
 //Header files
 #include "global.h"
 #include "utils.h"
-#include "strgen.h"
-#include "rdparser.h"
+#include "regen.h"
+#include "batch.h"
+#include "shard.h"
+#include <limits.h>
+#include <errno.h>
 
 int main(int argc, const char * argv[]) {
     //Necessary input parameters
     const char * regex = NULL;
-    unsigned long length = 0;  //of the regex, a character array.
     
     //Command line options
     const char * outflname = NULL;
     const char * inlines = NULL;
     const char * indec = NULL;     //The decimal value used for * and + in  the regex
+    const char * inseed = NULL;
+    const char * inthreads = NULL;
+    const char * instart = NULL;
+    const char * patternfile = NULL;
+    const char * outdir = NULL;
+    const char * compileto = NULL;
+    const char * loadfile = NULL;
+    const char * regexfile = NULL;
+    const char * inlength = NULL;
+    const char * inmaxlength = NULL;
+    const char * inorder = NULL;
+    const char * inbloom = NULL;
+    const char * inminlen = NULL;
+    const char * inmaxlen = NULL;
+    const char * inmaxbytes = NULL;
+    const char * inmaxsteps = NULL;
+    const char * inpolicy = NULL;
+    const char * matchfile = NULL;
+    const char * inshards = NULL;
+    const char * shardname = NULL;
+    char * filetext = NULL;        //The regex, when it is read from a file.
     short overwrite = 0;
     short timerandom = 1;
+    short ordered = 1;
+    short uniform = 0;
+    short enumerate = 0;
+    short unique = 0;
+    short stats = 0;               //1 for --stats, 2 for --stats-json
+    short verify = 0;
     
     //Process command line arguments
     unsigned int i = 1; //Because argv[0] is the name of the function
@@ -43,13 +72,20 @@ int main(int argc, const char * argv[]) {
         }
         
         // -l provides the number of times we want this regex to be evaluated.  Each time, the output is put on a
-        // new line.
-        if (!strcmp(argv[i], "-l") && i + 1 < argc) {
+        // new line.  --count is the same thing, and reads better next to --start.
+        if ((!strcmp(argv[i], "-l") || !strcmp(argv[i], "--count")) && i + 1 < argc) {
             inlines = argv[i + 1];
             i++;
             continue;
         }
         
+        // --start provides the index of the first line to write.  Lines before it are skipped without being generated.
+        if (!strcmp(argv[i], "--start") && i + 1 < argc) {
+            instart = argv[i + 1];
+            i++;
+            continue;
+        }
+        
         // -p provides the decimal value used for * and +
         if (!strcmp(argv[i], "-p") && i + 1 < argc) {
             indec = argv[i + 1];
@@ -57,6 +93,173 @@ int main(int argc, const char * argv[]) {
             continue;
         }
         
+        // -s provides the seed for the random number generator.
+        if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            inseed = argv[i + 1];
+            i++;
+            continue;
+        }
+        
+        // -j provides the number of worker threads.
+        if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            inthreads = argv[i + 1];
+            i++;
+            continue;
+        }
+        
+        // --patterns provides a file of patterns, one per line, to generate from instead of a single pattern.
+        if (!strcmp(argv[i], "--patterns") && i + 1 < argc) {
+            patternfile = argv[i + 1];
+            i++;
+            continue;
+        }
+        
+        // --out-dir, with --patterns, writes each pattern's samples to a file of its own in the given directory.
+        if (!strcmp(argv[i], "--out-dir") && i + 1 < argc) {
+            outdir = argv[i + 1];
+            i++;
+            continue;
+        }
+        
+        // --regex-file reads the pattern from a file, for patterns too long for the command line.
+        if (!strcmp(argv[i], "--regex-file") && i + 1 < argc) {
+            regexfile = argv[i + 1];
+            i++;
+            continue;
+        }
+        
+        // --compile-to compiles the pattern (or the --patterns file) into a cache file, without generating anything.
+        if (!strcmp(argv[i], "--compile-to") && i + 1 < argc) {
+            compileto = argv[i + 1];
+            i++;
+            continue;
+        }
+        
+        // --load takes the compiled pattern(s) from a cache file written by --compile-to.
+        if (!strcmp(argv[i], "--load") && i + 1 < argc) {
+            loadfile = argv[i + 1];
+            i++;
+            continue;
+        }
+        
+        // --uniform picks every line uniformly from the strings the pattern matches of the --length given.
+        if (!strcmp(argv[i], "--uniform")) {
+            uniform = 1;
+            continue;
+        }
+        
+        // --length provides the length, or range of lengths (n:m), of the lines --uniform picks from.
+        if (!strcmp(argv[i], "--length") && i + 1 < argc) {
+            inlength = argv[i + 1];
+            i++;
+            continue;
+        }
+        
+        // --min-len and --max-len provide the shortest and longest lines to generate; choices that can't end in that
+        // range are never made.
+        if (!strcmp(argv[i], "--min-len") && i + 1 < argc) {
+            inminlen = argv[i + 1];
+            i++;
+            continue;
+        }
+        
+        if (!strcmp(argv[i], "--max-len") && i + 1 < argc) {
+            inmaxlen = argv[i + 1];
+            i++;
+            continue;
+        }
+        
+        // --enumerate writes every string the pattern matches, each once, in order, instead of random samples.
+        if (!strcmp(argv[i], "--enumerate")) {
+            enumerate = 1;
+            continue;
+        }
+        
+        // --max-length provides the longest string --enumerate writes, for patterns that match strings of any length.
+        if (!strcmp(argv[i], "--max-length") && i + 1 < argc) {
+            inmaxlength = argv[i + 1];
+            i++;
+            continue;
+        }
+        
+        // --order provides the order --enumerate writes strings in: length (shortest first) or lex (byte order).
+        if (!strcmp(argv[i], "--order") && i + 1 < argc) {
+            inorder = argv[i + 1];
+            i++;
+            continue;
+        }
+        
+        // -u writes each distinct line only once.
+        if (!strcmp(argv[i], "-u")) {
+            unique = 1;
+            continue;
+        }
+        
+        // --bloom provides a false positive rate; -u then remembers lines with a Bloom filter of bounded size.
+        if (!strcmp(argv[i], "--bloom") && i + 1 < argc) {
+            inbloom = argv[i + 1];
+            i++;
+            continue;
+        }
+        
+        // --max-bytes and --max-steps give every line a budget of characters and of passes through repeats, and
+        // --on-budget says what happens to a line that goes over it: truncate, resample or fail.
+        if (!strcmp(argv[i], "--max-bytes") && i + 1 < argc) {
+            inmaxbytes = argv[i + 1];
+            i++;
+            continue;
+        }
+        
+        if (!strcmp(argv[i], "--max-steps") && i + 1 < argc) {
+            inmaxsteps = argv[i + 1];
+            i++;
+            continue;
+        }
+        
+        if (!strcmp(argv[i], "--on-budget") && i + 1 < argc) {
+            inpolicy = argv[i + 1];
+            i++;
+            continue;
+        }
+        
+        // --stats reports where the run's time went on stderr, and --stats-json does the same as JSON.
+        if (!strcmp(argv[i], "--stats") || !strcmp(argv[i], "--stats-json")) {
+            stats = strcmp(argv[i], "--stats") ? 2 : 1;
+            continue;
+        }
+        
+        // --verify checks every line against the pattern as it is written.
+        if (!strcmp(argv[i], "--verify")) {
+            verify = 1;
+            continue;
+        }
+        
+        // --match provides a file whose lines that match the pattern are written out, instead of generating any.
+        if (!strcmp(argv[i], "--match") && i + 1 < argc) {
+            matchfile = argv[i + 1];
+            i++;
+            continue;
+        }
+        
+        // --shards splits the lines over that many files, each with a seed of its own, named by --shard-pattern.
+        if (!strcmp(argv[i], "--shards") && i + 1 < argc) {
+            inshards = argv[i + 1];
+            i++;
+            continue;
+        }
+        
+        if (!strcmp(argv[i], "--shard-pattern") && i + 1 < argc) {
+            shardname = argv[i + 1];
+            i++;
+            continue;
+        }
+        
+        // --unordered lets worker threads write their lines as soon as they are done, in any order.
+        if (!strcmp(argv[i], "--unordered")) {
+            ordered = 0;
+            continue;
+        }
+        
         // -o allows automatic overwriting of any output files present without a prompt.
         if (!strcmp(argv[i], "-o")) {
             overwrite = 1; //Basically the same as "true"
@@ -69,8 +272,8 @@ int main(int argc, const char * argv[]) {
             continue;
         }
         
-        // The first non-option argument is the regex pattern
-        if (regex == NULL) {
+        // The first non-option argument is the regex pattern, unless the patterns come from a file.
+        if (regex == NULL && patternfile == NULL && loadfile == NULL && regexfile == NULL) {
             regex = argv[i];
             continue;
         }
@@ -87,24 +290,240 @@ int main(int argc, const char * argv[]) {
     //Set up default values
     FILE * flptr = stdout;
     float cont = .9;
-    int lines = 1;
+    unsigned long lines = 1;
+    unsigned long start = 0;
+    unsigned long minlength = 0;
+    unsigned long maxlength = 0;
+    long longest = -1;
+    int order = REGEN_ORDER_LENGTH;
+    double false_positive = 0;
+    unsigned long maxbytes = 0;
+    unsigned long maxsteps = 0;
+    int policy = REGEN_BUDGET_RESAMPLE;
+    int threads = 1;
+    unsigned long shards = 0;
     //overwrite's default (0) is set when it is initialized.
     
     /*
      Check validity of args and overwrite defaults, where applicable
      */
-    if (!regex) {
+    if (regexfile) {
+        filetext = read_regex_file(regexfile);
+        regex = filetext;
+    }
+    if (!regex && !patternfile && !loadfile) {
         printf("Usage:\n\n   regen [OPTIONS] [PATTERN] [OPTIONS]\n\nTry \"regen --help\" for more information.\n");
         exit(2);
     }
-    length = strlen(regex);
+    if (outdir && !patternfile && !loadfile) {
+        printf("--out-dir can only be used with --patterns or --load.\n");
+        exit(2);
+    }
+    if (loadfile && (patternfile || compileto)) {
+        printf("--load can't be used with --patterns or --compile-to.\n");
+        exit(2);
+    }
+    if (uniform != (inlength != NULL)) {
+        printf("--uniform and --length must be used together.\n");
+        exit(2);
+    }
+    if (uniform && (loadfile || compileto)) {
+        printf("--uniform can't be used with --load or --compile-to.\n");
+        exit(2);
+    }
+    if (inminlen && !inmaxlen) {
+        printf("--min-len must be used with --max-len.\n");
+        exit(2);
+    }
+    if (inmaxlen && (uniform || enumerate || loadfile || compileto)) {
+        printf("--max-len can't be used with --uniform, --enumerate, --load or --compile-to.\n");
+        exit(2);
+    }
+    if ((inmaxlength || inorder) && !enumerate) {
+        printf("--max-length and --order can only be used with --enumerate.\n");
+        exit(2);
+    }
+    if (enumerate && (uniform || loadfile || compileto)) {
+        printf("--enumerate can't be used with --uniform, --load or --compile-to.\n");
+        exit(2);
+    }
+    if (inbloom && !unique) {
+        printf("--bloom can only be used with -u.\n");
+        exit(2);
+    }
+    if (unique && patternfile) {
+        printf("-u can't be used with --patterns.\n");
+        exit(2);
+    }
+    if (verify && (patternfile || compileto)) {
+        printf("--verify can't be used with --patterns or --compile-to.\n");
+        exit(2);
+    }
+    if (matchfile && (patternfile || loadfile || compileto || uniform || enumerate || inmaxlen || unique || verify
+                      || stats || inmaxbytes || inmaxsteps)) {
+        printf("--match can only be used with a pattern or --regex-file, and -f and -o.\n");
+        exit(2);
+    }
+    if (stats && (patternfile || compileto)) {
+        printf("--stats can't be used with --patterns or --compile-to.\n");
+        exit(2);
+    }
+    if (inpolicy && !inmaxbytes && !inmaxsteps) {
+        printf("--on-budget can only be used with --max-bytes or --max-steps.\n");
+        exit(2);
+    }
+    if ((inmaxbytes || inmaxsteps) && (uniform || enumerate || inmaxlen)) {
+        printf("--max-bytes and --max-steps can't be used with --uniform, --enumerate or --max-len, whose lines are bounded already.\n");
+        exit(2);
+    }
+    if (shardname && !inshards) {
+        printf("--shard-pattern can only be used with --shards.\n");
+        exit(2);
+    }
+    if (inshards && (patternfile || compileto || enumerate || unique || verify || stats || matchfile)) {
+        printf("--shards can't be used with --patterns, --compile-to, --enumerate, -u, --verify, --stats or --match.\n");
+        exit(2);
+    }
+    if (inshards) {
+        char * end;
+        shards = strtoul(inshards, &end, 10);
+        if (*inshards < '0' || *inshards > '9' || *end != '\0' || shards == 0 || shards > SHARD_MAX) {
+            printf("Invalid integer for --shards: \"%s\".\n", inshards);
+            printf("Value must be an integer between 1 and %d.\n", SHARD_MAX);
+            exit(2);
+        }
+        shardname = shardname ? shardname : SHARD_PATTERN;
+        if (!shard_name_valid(shardname)) {
+            printf("Invalid --shard-pattern: \"%s\".\n", shardname);
+            printf("It must have one integer conversion, such as %%04d, for the shard's number.\n");
+            exit(2);
+        }
+    }
+    if (inmaxbytes) {
+        char * end;
+        maxbytes = strtoul(inmaxbytes, &end, 10);
+        if (*inmaxbytes < '0' || *inmaxbytes > '9' || *end != '\0' || maxbytes == 0) {
+            printf("Invalid integer for --max-bytes: \"%s\".\n", inmaxbytes);
+            printf("Value must be an integer greater than zero.\n");
+            exit(2);
+        }
+    }
+    if (inmaxsteps) {
+        char * end;
+        maxsteps = strtoul(inmaxsteps, &end, 10);
+        if (*inmaxsteps < '0' || *inmaxsteps > '9' || *end != '\0' || maxsteps == 0) {
+            printf("Invalid integer for --max-steps: \"%s\".\n", inmaxsteps);
+            printf("Value must be an integer greater than zero.\n");
+            exit(2);
+        }
+    }
+    if (inpolicy) {
+        if (!strcmp(inpolicy, "truncate")) {
+            policy = REGEN_BUDGET_TRUNCATE;
+        } else if (!strcmp(inpolicy, "fail")) {
+            policy = REGEN_BUDGET_FAIL;
+        } else if (strcmp(inpolicy, "resample")) {
+            printf("Invalid policy for --on-budget: \"%s\".\n", inpolicy);
+            printf("Value must be truncate, resample or fail.\n");
+            exit(2);
+        }
+    }
+    if (inbloom) {
+        char * end;
+        false_positive = strtod(inbloom, &end);
+        if (*inbloom == '\0' || *end != '\0' || !(false_positive > 0 && false_positive < 1)) {
+            printf("Invalid rate for --bloom: \"%s\".\n", inbloom);
+            printf("Value must be between 0 and 1, such as 0.001.\n");
+            exit(2);
+        }
+    }
+    if (inmaxlength) {
+        char * end;
+        longest = strtol(inmaxlength, &end, 10);
+        if (*inmaxlength < '0' || *inmaxlength > '9' || *end != '\0' || longest < 0) {
+            printf("Invalid integer for --max-length: \"%s\".\n", inmaxlength);
+            printf("Value must be an integer zero or greater.\n");
+            exit(2);
+        }
+    }
+    if (inorder) {
+        if (!strcmp(inorder, "lex")) {
+            order = REGEN_ORDER_LEX;
+        } else if (strcmp(inorder, "length")) {
+            printf("Invalid order for --order: \"%s\".\n", inorder);
+            printf("Value must be length or lex.\n");
+            exit(2);
+        }
+    }
+    if (inlength) {
+        char * end;
+        minlength = strtoul(inlength, &end, 10);
+        maxlength = minlength;
+        if (*end == ':' && !strchr(inlength, '-')) {
+            maxlength = strtoul(end + 1, &end, 10);
+        }
+        if (*inlength < '0' || *inlength > '9' || *end != '\0' || strchr(inlength, '-') || minlength > maxlength) {
+            printf("Invalid length for --length: \"%s\".\n", inlength);
+            printf("Value must be an integer n, or a range n:m with n <= m.\n");
+            exit(2);
+        }
+    }
+    if (inmaxlen) {
+        char * end;
+        maxlength = strtoul(inmaxlen, &end, 10);
+        if (*inmaxlen < '0' || *inmaxlen > '9' || *end != '\0') {
+            printf("Invalid integer for --max-len: \"%s\".\n", inmaxlen);
+            printf("Value must be an integer zero or greater.\n");
+            exit(2);
+        }
+    }
+    if (inminlen) {
+        char * end;
+        minlength = strtoul(inminlen, &end, 10);
+        if (*inminlen < '0' || *inminlen > '9' || *end != '\0' || minlength > maxlength) {
+            printf("Invalid integer for --min-len: \"%s\".\n", inminlen);
+            printf("Value must be an integer from 0 to the --max-len.\n");
+            exit(2);
+        }
+    }
+    
+    //Compiling to a cache file generates nothing, so it is done before any output file is opened.
+    if (compileto) {
+        if (patternfile) {
+            unsigned long failed = compile_batch(patternfile, compileto);
+            if (failed) {
+                fprintf(stderr, "%lu pattern%s could not be compiled.\n", failed, failed == 1 ? "" : "s");
+                exit(4);
+            }
+            return 0;
+        }
+        regen_pattern * pattern;
+        struct regen_error error;
+        unsigned long tag = 0;
+        if (regen_compile(&pattern, regex, strlen(regex), &error) != REGEN_OK) {
+            printf("%s\n", error.message);
+            exit(4);
+        }
+        if (regen_cache_write(compileto, (const regen_pattern * const *)&pattern, &regex, &tag, 1, 0) != REGEN_OK) {
+            printf("Could not write \"%s\".\n", compileto);
+            exit(1);
+        }
+        regen_pattern_free(pattern);
+        free(filetext);
+        return 0;
+    }
     
-    if (timerandom) {
-        unsigned int rand_seed;
-        FILE *handle = fopen("/dev/random", "r");
-        fread(&rand_seed, sizeof(rand_seed), 1, handle);
-        fclose(handle);
-        srand(rand_seed);
+    //Every line draws from its own stream, derived from this seed and the line's index.
+    uint64_t seed = REGEN_DEFAULT_SEED;
+    if (inseed) {
+        char * end;
+        seed = strtoull(inseed, &end, 0);
+        if (*inseed == '\0' || *end != '\0') {
+            printf("Invalid integer for -s: \"%s\".\n", inseed);
+            exit(2);
+        }
+    } else if (timerandom) {
+        seed = regen_entropy_seed();
     }
     
     if (outflname) {
@@ -122,6 +541,28 @@ int main(int argc, const char * argv[]) {
         }
         // file doesn't exist or overwrite
         flptr = fopen(outflname, "w");
+        if (flptr == NULL) {
+            printf("Could not open \"%s\": %s.\n", outflname, strerror(errno));
+            exit(1);
+        }
+    }
+    
+    //Matching a file generates nothing; its matching lines are the output.
+    if (matchfile) {
+        regen_matcher * matcher;
+        struct regen_error error;
+        int status = regen_matcher_create(&matcher, regex, strlen(regex), &error);
+        if (status != REGEN_OK) {
+            printf("%s\n", error.message);
+            exit(status == REGEN_ESYNTAX ? 4 : 2);
+        }
+        filter_lines(matcher, matchfile, fileno(flptr));
+        regen_matcher_free(matcher);
+        if (outflname) {
+            fclose(flptr);
+        }
+        free(filetext);
+        return 0;
     }
     
     //the cont value (for * and +) must be between 0 and MAX_DEC_CONT_VALUE, inclusive.
@@ -135,27 +576,226 @@ int main(int argc, const char * argv[]) {
     }
     
     if (inlines) {
-        int temp = atoi(inlines);  //Using temp value to detect negatives instead of having them be very large positives.
-        if (temp <= 0) {
+        char * end;
+        lines = strtoul(inlines, &end, 10);
+        //strtoul accepts a leading -, so check for it to keep negatives from becoming very large positives.
+        if (lines == 0 || *end != '\0' || strchr(inlines, '-')) {
             printf("Invalid integer for -l: \"%s\".\n", inlines);
             printf("Value must be an integer greater than zero.\n");
             exit(2);
         }
-        lines = temp;
     }
     
-    //Run a quick syntax check for grouping symbols - makes it easier on the parser.
-    grpSymChk(regex, length);
+    if (instart) {
+        char * end;
+        start = strtoul(instart, &end, 10);
+        if (*instart == '\0' || *end != '\0' || strchr(instart, '-')) {
+            printf("Invalid integer for --start: \"%s\".\n", instart);
+            printf("Value must be an integer zero or greater.\n");
+            exit(2);
+        }
+    }
+    
+    if (inthreads) {
+        int temp = atoi(inthreads);
+        if (temp <= 0 || temp > REGEN_MAX_THREADS) {
+            printf("Invalid integer for -j: \"%s\".\n", inthreads);
+            printf("Value must be an integer between 1 and %d.\n", REGEN_MAX_THREADS);
+            exit(2);
+        }
+        threads = temp;
+    } else if (shards) {
+        //Shards are written side by side unless -j says otherwise.
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = shards < cpus ? (int)shards : cpus > 1 ? (int)cpus : 1;
+        threads = threads > REGEN_MAX_THREADS ? REGEN_MAX_THREADS : threads;
+    }
+    
+    //Enumerating writes the whole list unless -l asks for less.
+    if (enumerate && !inlines) {
+        lines = ULONG_MAX;
+    }
     
-    //Calling the recursive descent parser
-    int position = 0;
-    struct token * parsed_regex = parse_regex(regex, length, &position);
+    //Lines are numbered from --start on, and the numbers must not wrap around.  A list just stops at its end instead.
+    if (!enumerate && start > ULONG_MAX - lines) {
+        printf("Invalid --start %lu with -l %lu.\n", start, lines);
+        printf("--start plus -l must be at most %lu.\n", ULONG_MAX);
+        exit(2);
+    }
     
-    //Generate the string and write it to the screen/file
-    for (i = 0; i < lines; i++) {
-        char * str = generate_string(parsed_regex, cont);
-        fprintf(flptr, "%s\n", str);
-        free(str);
+    //A cache file holds either one pattern or a whole --patterns file, already compiled.
+    regen_cache * cache = NULL;
+    if (loadfile) {
+        int status = regen_cache_open(&cache, loadfile);
+        if (status != REGEN_OK) {
+            printf("Could not load \"%s\": %s\n", loadfile, regen_strerror(status));
+            exit(status == REGEN_EIO ? 1 : 2);
+        }
+        if (!(regen_cache_flags(cache) & REGEN_CACHE_BATCH) && outdir) {
+            printf("--out-dir can only be used with a cache built from --patterns.\n");
+            exit(2);
+        }
+    }
+    
+    //Batch mode: every pattern of the file gets its own samples, and a bad pattern doesn't stop the others.
+    if (patternfile || (cache && (regen_cache_flags(cache) & REGEN_CACHE_BATCH))) {
+        if (stats || verify) {
+            printf("--stats and --verify can't be used with a cache built from --patterns.\n");
+            exit(2);
+        }
+        struct batch_job batch;
+        struct regen_budget_counts counts;
+        batch.file = patternfile;
+        batch.cache = cache;
+        batch.pval = cont;
+        batch.seed = seed;
+        batch.start = start;
+        batch.lines = lines;
+        batch.threads = threads;
+        batch.ordered = ordered;
+        batch.fd = fileno(flptr);
+        batch.dir = outdir;
+        batch.uniform = uniform;
+        batch.bounded = inmaxlen != NULL;
+        batch.minlength = minlength;
+        batch.maxlength = maxlength;
+        batch.enumerate = enumerate;
+        batch.longest = longest;
+        batch.order = order;
+        batch.maxbytes = maxbytes;
+        batch.maxsteps = maxsteps;
+        batch.policy = policy;
+        batch.counts = &counts;
+        unsigned long failed = run_batch(&batch);
+        if (outflname) {
+            fclose(flptr);
+        }
+        print_budget_counts(&counts);
+        regen_cache_close(cache);
+        if (failed) {
+            fprintf(stderr, "%lu pattern%s could not be compiled.\n", failed, failed == 1 ? "" : "s");
+            exit(4);
+        }
+        return 0;
+    }
+    
+    //Parse and compile the regex once (unless it comes compiled); every line is generated from the compiled pattern.
+    regen_pattern * compiled = NULL;
+    const regen_pattern * pattern;
+    struct regen_error error;
+    if (cache) {
+        if (regen_cache_count(cache) != 1) {
+            printf("\"%s\" holds no pattern.\n", loadfile);
+            exit(2);
+        }
+        pattern = regen_cache_pattern(cache, 0);
+    } else if (enumerate || uniform || inmaxlen) {
+        int status = enumerate ? regen_compile_enumerate(&compiled, regex, strlen(regex), longest, order, &error)
+                   : uniform ? regen_compile_uniform(&compiled, regex, strlen(regex), minlength, maxlength, &error)
+                   : regen_compile_bounded(&compiled, regex, strlen(regex), minlength, maxlength, &error);
+        if (status != REGEN_OK) {
+            printf("%s\n", error.message);
+            exit(status == REGEN_ESYNTAX ? 4 : 2);
+        }
+        pattern = compiled;
+    } else if (regen_compile(&compiled, regex, strlen(regex), &error) == REGEN_OK) {
+        pattern = compiled;
+    } else {
+        printf("%s\n", error.message);
+        exit(4);  //Indicates syntax error in regex.
+    }
+    
+    //-u stops as soon as every string there is has been written, when the pattern matches few enough to count.
+    uint64_t space = 0;
+    if (unique && !uniform && !enumerate) {
+        regen_pattern * counted;
+        const char * source = cache ? regen_cache_source(cache, 0) : regex;
+        long longer = inmaxlen && maxlength <= LONG_MAX ? (long)maxlength : -1;
+        if (regen_compile_enumerate(&counted, source, strlen(source), longer, REGEN_ORDER_LENGTH, NULL) == REGEN_OK) {
+            space = regen_enumerate_count(counted);
+            space = space == UINT64_MAX ? 0 : space;
+            regen_pattern_free(counted);
+        }
+        //With --min-len, the shorter strings don't count.
+        if (space && minlength > 0 && inmaxlen) {
+            if (regen_compile_enumerate(&counted, source, strlen(source), (long)minlength - 1, REGEN_ORDER_LENGTH,
+                                        NULL) == REGEN_OK) {
+                space -= regen_enumerate_count(counted);
+                regen_pattern_free(counted);
+            } else {
+                space = 0;
+            }
+        }
+    }
+    
+    //Generate the strings and write them to the screen/file
+    struct regen_lines run;
+    struct regen_budget_counts counts;
+    struct regen_stats report;
+    struct regen_mismatches mismatches;
+    regen_matcher * matcher = NULL;
+    if (verify) {
+        const char * source = cache ? regen_cache_source(cache, 0) : regex;
+        struct regen_error error;
+        int status = regen_matcher_create(&matcher, source, strlen(source), &error);
+        if (status != REGEN_OK) {
+            printf("%s\n", error.message);
+            exit(status == REGEN_ESYNTAX ? 4 : 2);
+        }
+    }
+    run.p = cont;
+    run.seed = seed;
+    run.start = start;
+    run.count = lines;
+    run.threads = threads;
+    run.ordered = ordered;
+    run.preallocate = outflname != NULL;
+    run.unique = unique;
+    run.false_positive = false_positive;
+    run.space = space;
+    run.max_bytes = maxbytes;
+    run.max_steps = maxsteps;
+    run.budget_policy = policy;
+    run.counts = &counts;
+    run.stats = stats ? &report : NULL;
+    run.verify = matcher;
+    run.mismatches = &mismatches;
+    if (shards) {
+        struct shard_job sharded;
+        sharded.pattern = pattern;
+        sharded.run = &run;
+        sharded.shards = shards;
+        sharded.name = shardname;
+        sharded.overwrite = overwrite;
+        sharded.manifest = flptr;
+        sharded.counts = &counts;
+        run_shards(&sharded);
+        print_budget_counts(&counts);
+        if (outflname) {
+            fclose(flptr);
+        }
+        regen_pattern_free(compiled);
+        regen_cache_close(cache);
+        free(filetext);
+        return 0;
+    }
+    unsigned long written;
+    if (regen_write_lines(pattern, &run, fileno(flptr), &written) == REGEN_EEXHAUSTED) {
+        if (space && written == space) {
+            fprintf(stderr, "The pattern matches only %lu different strings; all of them were written.\n", written);
+        } else {
+            fprintf(stderr, "Stopped after %d repeats in a row; %lu different strings were written.\n",
+                    REGEN_UNIQUE_MAX_REPEATS, written);
+        }
+    }
+    print_budget_counts(&counts);
+    if (stats) {
+        print_stats(&report, cache ? regen_cache_source(cache, 0) : regex, stats == 2);
+        regen_stats_free(&report);
+    }
+    if (mismatches.count) {
+        fprintf(stderr, "%lu line%s did not match the pattern.  The first was line %lu: %s\n", mismatches.count,
+                mismatches.count == 1 ? "" : "s", mismatches.first, mismatches.line);
     }
     
     //Clean up
@@ -164,7 +804,10 @@ int main(int argc, const char * argv[]) {
     }
     
     //Free stuff
-    free_tree(parsed_regex);
+    regen_pattern_free(compiled);
+    regen_matcher_free(matcher);
+    regen_cache_close(cache);
+    free(filetext);
     
-    return 0;
+    return mismatches.count ? 3 : 0;  //3 tells scripts that --verify found lines that don't match.
 }
@@ -0,0 +1,176 @@
+//
+//  match.c
+//  regen
+//  Checks whether strings match a pattern, with a DFA built lazily from the pattern's NFA.
+//
+
+#include "match.h"
+
+/*
+ The NFA of a pattern (see nfa.c) says exactly which strings it matches, so it is built from the same parse tree that
+ strings are generated from.  Following the NFA directly costs a pass over a set of its states for every character,
+ and turning it into a DFA up front (see dfa.c) can take exponentially many states.  So the matcher builds the DFA
+ lazily: a DFA state (the set of NFA states the NFA could be in) is only made the first time a string gets there,
+ and each of its moves is worked out the first time it is taken.  Generated text keeps going through the same few
+ states, so after the first lines nearly every character costs one table lookup.
+
+ Characters are read as columns: each symbol of the partition in dfa.c gets one, and every character that no set of
+ the NFA holds shares one more, which always leads to the dead state.  The table holds the next state's row (its
+ number times the number of columns), so a step is an add and a load.  State 0 is the dead state, whose moves all
+ lead back to itself, so a string that can no longer match stops being read.
+
+ If a matcher has MATCH_MAX_STATES states and needs another, it throws them all away and starts over from the state
+ the string is in.  Any pattern can then be matched in bounded memory; only the speed suffers.
+ */
+
+/*
+ @param a filled in with the automaton of the tree.  Release it with automaton_free.
+ @return 0, or -1 if the NFA would need more than MAX_NFA_STATES states.
+ */
+int automaton_build(struct automaton * a, struct token * tree) {
+    memset(&a->classes, 0, sizeof(a->classes));
+    if (nfa_build(&a->n, tree) < 0) {
+        nfa_free(&a->n);
+        return -1;
+    }
+    dfa_partition(&a->classes, &a->n);
+    return 0;
+}
+
+void automaton_free(struct automaton * a) {
+    nfa_free(&a->n);
+}
+
+/*
+ Finds the DFA state for the set at the end of the pool, making a new one if it is new.
+ @return the state, or -1 if the matcher has MATCH_MAX_STATES states already.  The set is left in the pool then.
+ */
+static int find_state(struct matcher * m, unsigned long from, unsigned long length) {
+    int before = m->sets.count;
+    int id = subsets_find(&m->sets, from, length, MATCH_MAX_STATES);
+    int i;
+
+    if (id < before) {
+        return id;
+    }
+    if (id + 1 >= m->capacity) {
+        m->capacity *= 2;
+        m->next = (int *)realloc(m->next, (size_t)m->capacity * m->width * sizeof(int));
+        m->accepting = (unsigned char *)realloc(m->accepting, m->capacity);
+        if (m->next == NULL || m->accepting == NULL) { printf("realloc failure.\n"); exit(1); }
+    }
+    for (i = 0; i < m->width; i++) {
+        m->next[(size_t)id * m->width + i] = -1;
+    }
+    m->accepting[id] = (unsigned char)subsets_accepting(&m->sets, id);
+    return id;
+}
+
+//Makes the dead state, state 0, and the start state.  The matcher has no states yet.
+static void add_fixed_states(struct matcher * m) {
+    int i = 0;
+    find_state(m, 0, 0);
+    for (; i < m->width; i++) {
+        m->next[i] = 0;
+    }
+    subsets_push(&m->sets, m->a->n.start);
+    m->start = find_state(m, 0, subsets_closure(&m->sets, 0, 1)) * m->width;
+}
+
+/*
+ Throws every state away but the fixed ones, and makes a state of the set at the end of the pool.
+ @return the row of that state.
+ */
+static int start_over(struct matcher * m, unsigned long from, unsigned long length) {
+    int * set = (int *)malloc((length ? length : 1) * sizeof(int));
+    unsigned long i = 0;
+    if (set == NULL) { printf("malloc failure.\n"); exit(1); }
+    memcpy(set, m->sets.pool + from, length * sizeof(int));
+
+    subsets_clear(&m->sets);
+    add_fixed_states(m);
+
+    from = m->sets.poollength;
+    for (; i < length; i++) {
+        subsets_push(&m->sets, set[i]);
+    }
+    free(set);
+    return find_state(m, from, length) * m->width;
+}
+
+/*
+ Works out the move from the state at row on the characters of column.
+ @return the row of the state it leads to.
+ */
+static int fill(struct matcher * m, int row, int column) {
+    const struct nfa * n = &m->a->n;
+    int state = row / m->width;
+    unsigned long from = m->sets.poollength;
+    unsigned long i;
+
+    if (column < m->a->classes.nsyms) {
+        unsigned char c = m->a->classes.symchars[m->a->classes.symstart[column]];
+        for (i = m->sets.offsets[state]; i < m->sets.offsets[state + 1]; i++) {
+            const struct nfa_state * q = &n->states[m->sets.pool[i]];
+            if (q->set >= 0 && charset_has(&n->sets[q->set], c)) {
+                subsets_push(&m->sets, q->out);
+            }
+        }
+    }
+    unsigned long length = subsets_closure(&m->sets, from, m->sets.poollength - from);
+    int to = find_state(m, from, length);
+    if (to < 0) {
+        return start_over(m, from, length);
+    }
+    m->next[row + column] = to * m->width;
+    return to * m->width;
+}
+
+/*
+ @param m filled in with a matcher for the automaton, which must outlive it.  Release it with matcher_free.
+ */
+void matcher_init(struct matcher * m, const struct automaton * a) {
+    int c = 0;
+    m->a = a;
+    m->width = a->classes.nsyms + 1;
+    for (; c < 256; c++) {
+        m->column[c] = (unsigned short)(a->classes.symbol[c] >= 0 ? a->classes.symbol[c] : a->classes.nsyms);
+    }
+    m->capacity = 64;
+    m->next = (int *)malloc((size_t)m->capacity * m->width * sizeof(int));
+    m->accepting = (unsigned char *)malloc(m->capacity);
+    if (m->next == NULL || m->accepting == NULL) { printf("malloc failure.\n"); exit(1); }
+    subsets_init(&m->sets, &a->n);
+    add_fixed_states(m);
+}
+
+/*
+ @return 1 if the pattern matches the whole string, otherwise 0.
+ */
+int matcher_match(struct matcher * m, const char * string, size_t length) {
+    const unsigned char * s = (const unsigned char *)string;
+    const unsigned char * end = s + length;
+    const int * next = m->next;
+    int row = m->start;
+
+    for (; s < end; s++) {
+        int to = next[row + m->column[*s]];
+        if (to <= 0) {
+            if (to < 0) {
+                to = fill(m, row, m->column[*s]);
+                next = m->next;
+            }
+            if (to == 0) {
+                return 0;
+            }
+        }
+        row = to;
+    }
+    return m->accepting[row / m->width];
+}
+
+void matcher_free(struct matcher * m) {
+    free(m->next);
+    free(m->accepting);
+    subsets_free(&m->sets);
+}
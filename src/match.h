@@ -0,0 +1,45 @@
+//
+//  match.h
+//  regen
+//  Checks whether strings match a pattern, with a DFA built lazily from the pattern's NFA.
+//
+
+#include "global.h"
+#include "nfa.h"
+#include "dfa.h"
+
+#ifndef match_h
+#define match_h
+
+/*
+ The automaton is read-only once built, so any number of matchers (one per thread) can share it.  A matcher holds
+ the states of the DFA it has built so far, and belongs to one thread at a time.
+ */
+struct automaton {
+    struct nfa n;
+    struct dfa classes;           //Only the symbols are filled in (see dfa_partition).
+};
+
+struct matcher {
+    const struct automaton * a;
+    int width;                    //Columns of next: one per symbol, and one for characters no set holds.
+    unsigned short column[256];   //The column of each character.
+    int * next;                   //next[row + column] is the row of the next state, or -1 if not worked out yet.
+    unsigned char * accepting;    //per state
+    int start;                    //Row of the start state.
+    int capacity;                 //of next and accepting, in states.
+    struct subsets sets;          //Set i is state i.
+};
+
+int automaton_build(struct automaton * a, struct token * tree);
+void automaton_free(struct automaton * a);
+void matcher_init(struct matcher * m, const struct automaton * a);
+int matcher_match(struct matcher * m, const char * string, size_t length);
+void matcher_free(struct matcher * m);
+
+#endif /* match_h */
+
+//Most DFA states a matcher keeps.  Past that it starts over, which bounds its memory but not the patterns it takes.
+#ifndef MATCH_MAX_STATES
+#define MATCH_MAX_STATES (1 << 12)
+#endif
@@ -0,0 +1,157 @@
+//
+//  nfa.c
+//  regen
+//  Builds a nondeterministic finite automaton for the language of a parse tree.
+//
+
+#include "nfa.h"
+
+/*
+ The parse tree says how to pick a string at random; the automaton only says which strings the pattern can produce,
+ which is what exact counting (see uniform.c) and matching need.  It is built the Thompson way, except that each
+ piece is built back to front: a subtree is given the state to continue with once it is done, and returns the state
+ it starts at.  That way no list of dangling moves has to be patched later.
+
+ * a class or literal reads its characters one state at a time;
+ * | forks to every branch (the weights of a weighted | don't change which strings there are);
+ * ? forks past the body; * loops back to a fork before the body; + is the body, then the same loop;
+ * {n} is n copies of the body, and {n:m} adds m - n nested optional copies: (x(x(x)?)?)? for x{0:3}.
+
+ Repeats are spelled out copy by copy, so the automaton grows with the counts.  Past MAX_NFA_STATES states the build
+ gives up and reports it.
+ */
+
+static int add_state(struct nfa * n, int set, int out, int out1) {
+    if (n->length >= MAX_NFA_STATES) {
+        n->overflow = 1;
+        return n->accept;
+    }
+    if (n->length == n->size) {
+        n->size = n->size ? n->size * 2 : 256;
+        n->states = (struct nfa_state *)realloc(n->states, n->size * sizeof(struct nfa_state));
+        if (n->states == NULL) { printf("realloc failure.\n"); exit(1); }
+    }
+    n->states[n->length].set = set;
+    n->states[n->length].out = out;
+    n->states[n->length].out1 = out1;
+    return (int)n->length++;
+}
+
+static int add_set(struct nfa * n, const struct charset * set) {
+    if (n->nsets == n->setsize) {
+        n->setsize = n->setsize ? n->setsize * 2 : 64;
+        n->sets = (struct charset *)realloc(n->sets, n->setsize * sizeof(struct charset));
+        if (n->sets == NULL) { printf("realloc failure.\n"); exit(1); }
+    }
+    n->sets[n->nsets] = *set;
+    return (int)n->nsets++;
+}
+
+//The set holding only c, shared by every state that reads c.
+static int single_set(struct nfa * n, unsigned char c) {
+    if (n->single[c] < 0) {
+        struct charset set;
+        memset(&set, 0, sizeof(set));
+        charset_add(&set, c);
+        n->single[c] = add_set(n, &set);
+    }
+    return n->single[c];
+}
+
+static struct token * child(struct token * node, unsigned long i) {
+    return ((struct token **)(node->element))[i];
+}
+
+/*
+ @return the first state of an automaton for the subtree that moves on to next once it has read a match.
+ */
+static int build(struct nfa * n, struct token * t, int next) {
+    unsigned long i;
+    int loop;
+    int entry;
+    struct charset set;
+
+    if (n->overflow) {
+        return next;
+    }
+    switch (t->code[0]) {
+        case 0: //Character class
+            if (t->length == 1) {
+                return add_state(n, single_set(n, *(unsigned char *)t->element), next, -1);
+            }
+            memset(&set, 0, sizeof(set));
+            for (i = 0; i < t->length; i++) {
+                charset_add(&set, ((unsigned char *)t->element)[i]);
+            }
+            return add_state(n, add_set(n, &set), next, -1);
+        case 8: //Literal
+            for (i = t->length; i > 0; i--) {
+                next = add_state(n, single_set(n, ((unsigned char *)t->element)[i - 1]), next, -1);
+            }
+            return next;
+        case 1: //Sequence
+            for (i = t->length; i > 0; i--) {
+                next = build(n, child(t, i - 1), next);
+            }
+            return next;
+        case 2: //*
+            loop = add_state(n, -1, -1, next);
+            entry = build(n, child(t, 0), loop);
+            if (!n->overflow) {
+                n->states[loop].out = entry;
+            }
+            return loop;
+        case 3: //+
+            loop = add_state(n, -1, -1, next);
+            entry = build(n, child(t, 0), loop);
+            if (!n->overflow) {
+                n->states[loop].out = entry;
+            }
+            return entry;
+        case 4: //?
+            return add_state(n, -1, build(n, child(t, 0), next), next);
+        case 5: //{n}
+            for (i = 0; i < (unsigned long)t->code[1] && !n->overflow; i++) {
+                next = build(n, child(t, 0), next);
+            }
+            return next;
+        case 6: //{n:m}
+            entry = next;
+            for (i = t->code[1]; i < (unsigned long)t->code[2] && !n->overflow; i++) {
+                entry = add_state(n, -1, build(n, child(t, 0), entry), next);
+            }
+            for (i = 0; i < (unsigned long)t->code[1] && !n->overflow; i++) {
+                entry = build(n, child(t, 0), entry);
+            }
+            return entry;
+        default: //| and weighted |: a chain of forks, one branch off each.
+            entry = build(n, child(t, t->length - 1), next);
+            for (i = t->length - 1; i > 0; i--) {
+                entry = add_state(n, -1, build(n, child(t, i - 1), next), entry);
+            }
+            return entry;
+    }
+}
+
+/*
+ @param n filled in with the automaton.  Release it with nfa_free.
+ @param tree a parse tree, optimized or not.
+ @return 0, or -1 if the automaton needs more than MAX_NFA_STATES states.
+ */
+int nfa_build(struct nfa * n, struct token * tree) {
+    int i = 0;
+    memset(n, 0, sizeof(*n));
+    for (; i < 256; i++) {
+        n->single[i] = -1;
+    }
+    n->accept = add_state(n, -1, -1, -1);
+    n->start = build(n, tree, n->accept);
+    return n->overflow ? -1 : 0;
+}
+
+void nfa_free(struct nfa * n) {
+    free(n->states);
+    free(n->sets);
+    n->states = NULL;
+    n->sets = NULL;
+}
@@ -0,0 +1,43 @@
+//
+//  nfa.h
+//  regen
+//  Builds a nondeterministic finite automaton for the language of a parse tree.
+//
+
+#include "global.h"
+#include "charset.h"
+
+#ifndef nfa_h
+#define nfa_h
+
+/*
+ Every state either reads one character of a set and moves to out, or (set == -1) moves to out and out1 without
+ reading anything.  -1 stands for no move.
+ */
+struct nfa_state {
+    int set;
+    int out;
+    int out1;
+};
+
+struct nfa {
+    struct nfa_state * states;
+    unsigned long length;
+    unsigned long size;
+    struct charset * sets;
+    unsigned long nsets;
+    unsigned long setsize;
+    int single[256];     //Index of the set holding just that character, or -1 if there is none yet.
+    int start;
+    int accept;
+    int overflow;        //Set if the automaton would have needed more than MAX_NFA_STATES states.
+};
+
+int nfa_build(struct nfa * n, struct token * tree);
+void nfa_free(struct nfa * n);
+
+#endif /* nfa_h */
+
+#ifndef MAX_NFA_STATES
+#define MAX_NFA_STATES (1 << 21)
+#endif
@@ -0,0 +1,475 @@
+//
+//  optimize.c
+//  regen
+//  Simplifies the parse tree before it is compiled.
+//
+
+#include "optimize.h"
+#include <limits.h>
+
+/*
+ The parser wraps every element in a sequence node (code 1) of its own, so abc becomes a sequence of three one-child
+ sequences, each holding a one-character class.  optimize_tree rewrites the tree into an equivalent, smaller one:
+
+ * sequences inside sequences are spliced into their parent, and sequences with one child are replaced by the child;
+ * runs of single characters next to each other become one literal string (code 8), written with one memcpy;
+ * alternations inside alternations are merged into their parent.  To keep every branch exactly as likely as before,
+   a merged alternation whose branches are no longer equally likely becomes a weighted alternation (code 9);
+ * an alternation of nothing but literal strings, such as a word list, becomes a trie: the words' common prefixes
+   are written once, and each step down the trie is weighted by the number of words below it, so every word is still
+   exactly as likely as it was;
+ * {1} is replaced by its subtree, {n:n} becomes {n}, and {0} (or any operator on something that produces nothing)
+   becomes an empty sequence.
+
+ The output of the new tree has the same distribution as that of the old one, although a given seed may give a
+ different string, since some random numbers are no longer needed.
+
+ Instruction codes added by this pass:
+ * Instruction code 8: element is a literal string of length characters.  Write it out as is.  (The parser makes
+   these too, for plain characters in a row.)
+ * Instruction code 9: | with weights.  code[1] is the total weight and code[2 + i] is the weight of element i.
+ */
+
+static struct token * new_token(struct arena * a, int code, int codelength, unsigned long length) {
+    struct token * node = (struct token *)arena_alloc(a, sizeof(struct token));
+    node->code = (int *)arena_alloc(a, codelength * sizeof(int));
+    node->code[0] = code;
+    node->length = length;
+    if (length > 0) {
+        node->element = (void **)arena_alloc(a, length * sizeof(void *));
+    }
+    return node;
+}
+
+static struct token * child(struct token * node, unsigned long i) {
+    return ((struct token **)(node->element))[i];
+}
+
+static int is_empty(struct token * node) {
+    return node->code[0] == 1 && node->length == 0;
+}
+
+/*
+ A growable list of children, with a weight each, used while rebuilding sequences and alternations.
+ */
+struct list {
+    struct token ** items;
+    unsigned long long * weights;
+    unsigned long length;
+    unsigned long size;
+};
+
+static void list_add(struct list * l, struct token * item, unsigned long long weight) {
+    if (l->length == l->size) {
+        l->size = l->size ? l->size * 2 : 16;
+        l->items = (struct token **)realloc(l->items, l->size * sizeof(struct token *));
+        l->weights = (unsigned long long *)realloc(l->weights, l->size * sizeof(unsigned long long));
+        if (l->items == NULL || l->weights == NULL) { printf("realloc failure.\n"); exit(1); }
+    }
+    l->items[l->length] = item;
+    l->weights[l->length] = weight;
+    l->length++;
+}
+
+static void list_free(struct list * l) {
+    free(l->items);
+    free(l->weights);
+}
+
+/*
+ Joins the single characters and literals in items[from, to) into one literal token.
+ */
+static struct token * make_literal(struct arena * a, struct token ** items, unsigned long from, unsigned long to) {
+    unsigned long total = 0;
+    unsigned long i = from;
+    for (; i < to; i++) {
+        total += items[i]->length;
+    }
+    struct token * literal = new_token(a, 8, 1, 0);
+    char * text = (char *)arena_alloc(a, total + 1);
+    literal->element = (void **)text;
+    literal->length = total;
+    literal->position = items[from]->position;
+    for (i = from; i < to; i++) {
+        memcpy(text, items[i]->element, items[i]->length);
+        text += items[i]->length;
+    }
+    return literal;
+}
+
+static int is_literal_piece(struct token * node) {
+    return (node->code[0] == 0 && node->length == 1) || node->code[0] == 8;
+}
+
+static struct token * optimize_sequence(struct arena * a, struct token * node) {
+    struct list flat = {NULL, NULL, 0, 0};
+    struct list merged = {NULL, NULL, 0, 0};
+    unsigned long i = 0;
+    unsigned long j;
+
+    //Splice nested sequences (their own children are already flat) and drop empty ones.
+    for (; i < node->length; i++) {
+        struct token * c = optimize_tree(a, child(node, i));
+        if (c->code[0] == 1) {
+            for (j = 0; j < c->length; j++) {
+                list_add(&flat, child(c, j), 1);
+            }
+        } else {
+            list_add(&flat, c, 1);
+        }
+    }
+
+    //Merge runs of single characters into literals.
+    for (i = 0; i < flat.length; i = j) {
+        j = i + 1;
+        if (is_literal_piece(flat.items[i])) {
+            while (j < flat.length && is_literal_piece(flat.items[j])) {
+                j++;
+            }
+        }
+        if (j - i > 1) {
+            list_add(&merged, make_literal(a, flat.items, i, j), 1);
+        } else {
+            list_add(&merged, flat.items[i], 1);
+        }
+    }
+
+    struct token * result;
+    if (merged.length == 1) {
+        result = merged.items[0];
+    } else {
+        result = new_token(a, 1, 1, merged.length);
+        memcpy(result->element, merged.items, merged.length * sizeof(struct token *));
+        result->position = node->position;
+    }
+    list_free(&flat);
+    list_free(&merged);
+    return result;
+}
+
+/*
+ A literal branch of an alternation, for building a trie.
+ */
+struct word {
+    const char * text;
+    unsigned long length;
+    unsigned long long weight;
+    int position;  //of the branch in the pattern
+};
+
+static int compare_words(const void * x, const void * y) {
+    const struct word * a = (const struct word *)x;
+    const struct word * b = (const struct word *)y;
+    unsigned long shorter = a->length < b->length ? a->length : b->length;
+    int order = memcmp(a->text, b->text, shorter);
+    if (order) {
+        return order;
+    }
+    return a->length < b->length ? -1 : (a->length > b->length);
+}
+
+//The text of a literal or one-character class, or of an empty sequence.  NULL for anything else.
+static const char * literal_text(struct token * node, unsigned long * length) {
+    if (node->code[0] == 8 || (node->code[0] == 0 && node->length == 1)) {
+        *length = node->length;
+        return node->length ? (const char *)node->element : "";
+    }
+    if (is_empty(node)) {
+        *length = 0;
+        return "";
+    }
+    return NULL;
+}
+
+/*
+ Makes a | of the branches, weighted unless every weight is the same.
+ */
+static struct token * make_alternation(struct arena * a, struct token ** branches, unsigned long long * weights,
+                                       unsigned long count, int position) {
+    unsigned long long total = 0;
+    int uniform = 1;
+    unsigned long i = 0;
+    struct token * node;
+
+    for (; i < count; i++) {
+        total += weights[i];
+        uniform = uniform && weights[i] == weights[0];
+    }
+    if (uniform) {
+        node = new_token(a, 7, 1, count);
+    } else {
+        node = new_token(a, 9, 2 + (int)count, count);
+        node->code[1] = (int)total;
+        for (i = 0; i < count; i++) {
+            node->code[2 + i] = (int)weights[i];
+        }
+    }
+    memcpy(node->element, branches, count * sizeof(struct token *));
+    node->position = position;
+    return node;
+}
+
+/*
+ Builds the trie of words[lo, hi), which are sorted and all share their first depth characters, as a tree that writes
+ whatever follows those characters.  sums[i] is the total weight of words[0, i).
+
+ The characters every word in the range shares come first, as a literal.  Then the words that end there (all at the
+ front of the range, being the shortest) get one branch between them, and each group of words with the same next
+ character gets a branch with the rest of the trie, each weighted by the words it holds.
+ */
+static struct token * build_trie(struct arena * a, struct word * words, unsigned long long * sums, unsigned long lo,
+                                 unsigned long hi, unsigned long depth) {
+    unsigned long common = depth;
+    unsigned long i;
+    unsigned long group;
+    struct list branches = {NULL, NULL, 0, 0};
+    struct token * rest;
+
+    //Sorted, the common prefix of the whole range is that of its first and last words.
+    while (common < words[lo].length && common < words[hi - 1].length
+           && words[lo].text[common] == words[hi - 1].text[common]) {
+        common++;
+    }
+
+    for (i = lo; i < hi && words[i].length == common; i++) {
+    }
+    if (i > lo) {
+        list_add(&branches, new_token(a, 1, 1, 0), sums[i] - sums[lo]);
+        branches.items[branches.length - 1]->position = words[lo].position;
+    }
+    for (; i < hi; i = group) {
+        for (group = i + 1; group < hi && words[group].text[common] == words[i].text[common]; group++) {
+        }
+        list_add(&branches, build_trie(a, words, sums, i, group, common), sums[group] - sums[i]);
+    }
+
+    //Only branches of one character each, all as likely, are a character class.
+    int single = !is_empty(branches.items[0]);
+    for (i = 0; i < branches.length && single; i++) {
+        single = branches.items[i]->code[0] == 8 && branches.items[i]->length == 1
+                 && branches.weights[i] == branches.weights[0];
+    }
+    if (branches.length == 1) {
+        rest = branches.items[0];
+    } else if (single) {
+        rest = new_token(a, 0, 1, 0);
+        char * members = (char *)arena_alloc(a, branches.length + 1);
+        for (i = 0; i < branches.length; i++) {
+            members[i] = *(char *)branches.items[i]->element;
+        }
+        rest->element = (void **)members;
+        rest->length = branches.length;
+        rest->position = words[lo].position;
+    } else {
+        rest = make_alternation(a, branches.items, branches.weights, branches.length, words[lo].position);
+    }
+    list_free(&branches);
+
+    if (common == depth) {
+        return rest;
+    }
+    struct token * prefix = new_token(a, 8, 1, 0);
+    prefix->element = (void **)arena_alloc(a, common - depth + 1);
+    memcpy(prefix->element, words[lo].text + depth, common - depth);
+    prefix->length = common - depth;
+    prefix->position = words[lo].position;
+    if (is_empty(rest)) {
+        return prefix;
+    }
+    struct token * node = new_token(a, 1, 1, 2);
+    node->position = words[lo].position;
+    node->element[0] = prefix;
+    node->element[1] = rest;
+    return node;
+}
+
+/*
+ @return the trie of the alternation's branches if every one of them is a literal string, otherwise NULL.
+ */
+static struct token * literal_trie(struct arena * a, struct list * branches) {
+    struct word * words = (struct word *)malloc(branches->length * sizeof(struct word));
+    unsigned long long * sums = (unsigned long long *)malloc((branches->length + 1) * sizeof(unsigned long long));
+    struct token * trie = NULL;
+    unsigned long i = 0;
+
+    if (words == NULL || sums == NULL) { printf("malloc failure.\n"); exit(1); }
+    for (; i < branches->length; i++) {
+        words[i].text = literal_text(branches->items[i], &words[i].length);
+        words[i].weight = branches->weights[i];
+        words[i].position = branches->items[i]->position;
+        if (words[i].text == NULL) {
+            break;
+        }
+    }
+    if (i == branches->length) {
+        qsort(words, branches->length, sizeof(struct word), compare_words);
+        sums[0] = 0;
+        for (i = 0; i < branches->length; i++) {
+            sums[i + 1] = sums[i] + words[i].weight;
+        }
+        trie = build_trie(a, words, sums, 0, branches->length, 0);
+    }
+    free(words);
+    free(sums);
+    return trie;
+}
+
+static unsigned long long gcd(unsigned long long x, unsigned long long y) {
+    while (y) {
+        unsigned long long t = x % y;
+        x = y;
+        y = t;
+    }
+    return x;
+}
+
+/*
+ Merges alternations among the branches into this one, weighting branches so each keeps its old probability.
+ */
+static struct token * optimize_alternation(struct arena * a, struct token * node) {
+    struct list branches = {NULL, NULL, 0, 0};
+    unsigned long long total = 0;
+    unsigned long i = 0;
+    unsigned long j;
+
+    for (; i < node->length; i++) {
+        list_add(&branches, optimize_tree(a, child(node, i)), node->code[0] == 9 ? node->code[2 + i] : 1);
+        total += branches.weights[i];
+    }
+    unsigned long long largest = 0;
+    for (i = 0; i < branches.length; i++) {
+        largest = branches.weights[i] > largest ? branches.weights[i] : largest;
+    }
+
+    //Replace each branch that is itself an alternation by its own branches.  A branch of weight w with sub-branches
+    //weighing u_1..u_m (summing to U) becomes m branches weighing w * u_j, and every other weight is scaled by U.
+    for (i = 0; i < branches.length; i++) {
+        struct token * b = branches.items[i];
+        if (b->code[0] != 7 && b->code[0] != 9) {
+            continue;
+        }
+        unsigned long long sub = b->code[0] == 9 ? (unsigned long long)b->code[1] : b->length;
+        if (largest * sub > MAX_BRANCH_WEIGHT || total * sub > MAX_BRANCH_WEIGHT) {
+            continue; //Leave this one nested rather than let the weights grow without bound.
+        }
+        unsigned long long w = branches.weights[i];
+        for (j = 0; j < branches.length; j++) {
+            branches.weights[j] *= sub;
+        }
+        total *= sub;
+        largest *= sub;
+        branches.items[i] = child(b, 0);
+        branches.weights[i] = w * (b->code[0] == 9 ? (unsigned long long)b->code[2] : 1);
+        for (j = 1; j < b->length; j++) {
+            list_add(&branches, child(b, j), w * (b->code[0] == 9 ? (unsigned long long)b->code[2 + j] : 1));
+        }
+        i--; //The first sub-branch took this spot; look at it again.
+    }
+
+    unsigned long long common = 0;
+    for (i = 0; i < branches.length; i++) {
+        common = gcd(common, branches.weights[i]);
+    }
+    for (i = 0; i < branches.length; i++) {
+        branches.weights[i] /= common;
+    }
+
+    struct token * result;
+    if (branches.length == 1) {
+        result = branches.items[0];
+    } else if ((result = literal_trie(a, &branches)) == NULL) {
+        result = make_alternation(a, branches.items, branches.weights, branches.length, node->position);
+    } else {
+        result->position = node->position;
+    }
+    list_free(&branches);
+    return result;
+}
+
+/*
+ @param a the arena the tree was parsed into.  New nodes come from it too.
+ @param tree the tree, as built by parse_regex or already optimized.
+ @return an equivalent tree.  Parts of the old tree may be reused in it.
+ */
+struct token * optimize_tree(struct arena * a, struct token * tree) {
+    struct token * body;
+    struct token * result;
+
+    switch (tree->code[0]) {
+        case 1:
+            return optimize_sequence(a, tree);
+        case 7:
+        case 9:
+            return optimize_alternation(a, tree);
+        case 2:
+        case 3:
+        case 4:
+        case 5:
+        case 6:
+            body = optimize_tree(a, child(tree, 0));
+            if (is_empty(body) || (tree->code[0] == 5 && tree->code[1] == 0)
+                || (tree->code[0] == 6 && tree->code[2] == 0)) {
+                result = new_token(a, 1, 1, 0);
+                result->position = tree->position;
+                return result;
+            }
+            if ((tree->code[0] == 5 && tree->code[1] == 1) || (tree->code[0] == 6 && tree->code[2] == 1 && tree->code[1] == 1)) {
+                return body;
+            }
+            if (tree->code[0] == 6 && tree->code[1] == tree->code[2]) {
+                result = new_token(a, 5, 2, 1);
+                result->code[1] = tree->code[1];
+            } else {
+                result = new_token(a, tree->code[0], tree->code[0] == 5 ? 2 : (tree->code[0] == 6 ? 3 : 1), 1);
+                memcpy(result->code, tree->code, (tree->code[0] == 5 ? 2 : (tree->code[0] == 6 ? 3 : 1)) * sizeof(int));
+            }
+            result->element[0] = body;
+            result->position = tree->position;
+            return result;
+        default: //Character classes and literals are as simple as they get.
+            return tree;
+    }
+}
+
+/*
+ @return the number of characters the subtree always produces, or -1 if that number can vary (or is too large for
+ an int).
+ */
+long fixed_length(struct token * subtree) {
+    unsigned long i = 0;
+    long total = 0;
+    long each;
+
+    switch (subtree->code[0]) {
+        case 0:
+            return 1;
+        case 8:
+            return subtree->length <= INT_MAX ? (long)subtree->length : -1;
+        case 1:
+            for (; i < subtree->length; i++) {
+                each = fixed_length(child(subtree, i));
+                if (each < 0 || total + each > INT_MAX) {
+                    return -1;
+                }
+                total += each;
+            }
+            return total;
+        case 5:
+            each = fixed_length(child(subtree, 0));
+            if (each < 0 || (each > 0 && subtree->code[1] > INT_MAX / each)) {
+                return -1;
+            }
+            return each * subtree->code[1];
+        case 7:
+        case 9:
+            total = fixed_length(child(subtree, 0));
+            for (i = 1; i < subtree->length && total >= 0; i++) {
+                if (fixed_length(child(subtree, i)) != total) {
+                    return -1;
+                }
+            }
+            return total;
+        default: //*, +, ? and {n:m} vary, unless what they repeat produces nothing.
+            return fixed_length(child(subtree, 0)) == 0 ? 0 : -1;
+    }
+}
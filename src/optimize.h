@@ -0,0 +1,22 @@
+//
+//  optimize.h
+//  regen
+//
+//  Simplifies the parse tree before it is compiled.
+//
+
+#include "global.h"
+#include "arena.h"
+
+#ifndef optimize_h
+#define optimize_h
+
+struct token * optimize_tree(struct arena * a, struct token * tree);
+long fixed_length(struct token * subtree);
+
+#endif /* optimize_h */
+
+//Alternations are only flattened while the branch weights stay below this.
+#ifndef MAX_BRANCH_WEIGHT
+#define MAX_BRANCH_WEIGHT (1 << 24)
+#endif
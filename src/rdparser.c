@@ -8,7 +8,9 @@
 //
 
 #include "rdparser.h"
-#include "utils.h"
+#include "arena.h"
+#include "charset.h"
+#include <stdarg.h>
 
 /*
  * Instruction code 0: element is a character class.  Select one element from the character class.
@@ -19,9 +21,125 @@
  * Instruction code 5: {n} Repeat n of times.
  * Instruction code 6: {n:m} Repeat at least n but no more than m times.
  * Instruction code 7: | select one of element, at random.  Similar to 0, but not necessarily a character class.
+ * Instruction code 8: element is a literal string of length characters, made of plain characters in a row.
  */
 
 /*
+ @param ps the parse under way.
+ @param position the index into the regex where the problem was found.
+ @param format a printf-style description of the problem, without a trailing newline.
+
+ Records the error in ps and returns to wherever the parse was started from (see parse_pattern), so a syntax error
+ ends the parse instead of the program.  Every node built so far lives in the arena, so nothing leaks.
+ */
+void parse_error(struct parser * ps, int position, const char * format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(ps->message, PARSE_MESSAGE_SIZE, format, args);
+    va_end(args);
+    ps->position = position;
+    longjmp(ps->fail, 1);
+}
+
+/*
+ * Checks that the grouping symbols (), {}, and [] are equal in number and open and close in the right
+ * order (ie. there is always a ( before there is a ).
+ * Reports a syntax error through parse_error upon discovery of an error.
+ */
+void grpSymChk(struct parser * ps, const char * regex, unsigned long length) {
+    int paren = 0;   //()
+    int cbrace = 0;  //{}
+    int bracket = 0; //[]
+    
+    short notincc = 1; //Non-bracket grouping symbols don't count if they're inside a character class
+    
+    unsigned long i = 0;
+    for (; i < length; i++) {
+        //Skip escaped characters: the loop steps over the one after the backslash.
+        if (regex[i] == '\\' && i + 2 <= length) {
+            i++;
+            continue;
+        }
+        
+        //Count grouping symbols
+        if (regex[i] == '(' && notincc) { paren++; }
+        if (regex[i] == '{' && notincc) { cbrace++; }
+        if (regex[i] == '[') { bracket++; notincc = 0; }
+        if (regex[i] == ')' && notincc) { paren--;  }
+        if (regex[i] == '}' && notincc) { cbrace--; }
+        if (regex[i] == ']') { bracket--; notincc = 1;}
+        
+        //If any grouping symbol is negative, a closing symbol comes before an opening.
+        if (paren < 0) {
+            parse_error(ps, (int)i, "Closing parenthesis comes before opening parenthesis.");
+        }
+        if (cbrace < 0) {
+            parse_error(ps, (int)i, "Closing curly brace comes before opening curly brace.");
+        }
+        if (bracket < 0) {
+            parse_error(ps, (int)i, "Closing bracket comes before opening bracket.");
+        }
+    }
+    
+    //Make sure all pairs of parenthesis are closed.
+    if (paren > 0) {
+        parse_error(ps, (int)length, "Opening parenthesis not closed.");
+    }
+    if (cbrace > 0) {
+        parse_error(ps, (int)length, "Opening curly brace not closed.");
+    }
+    if (bracket > 0) {
+        parse_error(ps, (int)length, "Opening bracket not closed (character class not closed).");
+    }
+    //Good to go.
+}
+
+/*
+ @param ps a parser whose arena is set.  Its message and position are filled in if the regex has an error.
+ @param regex the regular expression.  The parser looks one character past the end, so regex[length] must be '\\0'.
+ @param length of the regex
+ @return the parse tree, allocated from ps->arena, or NULL if the regex has a syntax error.
+
+ The entry point for parsing a whole regex: checks the grouping symbols, then runs the recursive descent parser.
+ */
+struct token * parse_pattern(struct parser * ps, const char * regex, unsigned long length) {
+    int position = 0;
+    if (setjmp(ps->fail)) {
+        return NULL;
+    }
+    //Run a quick syntax check for grouping symbols - makes it easier on the parser.
+    grpSymChk(ps, regex, length);
+    return parse_regex(ps, regex, length, &position);
+}
+
+//Characters that mean something other than themselves outside of a character class.
+static int is_special(char c) {
+    return c == '\0' || c == '\\' || c == '[' || c == ']' || c == '(' || c == ')' || c == '{' || c == '}'
+        || c == '*' || c == '+' || c == '?' || c == '|' || c == '.';
+}
+
+//Operators that apply to the one element before them.
+static int is_operator(char c) {
+    return c == '*' || c == '+' || c == '?' || c == '{' || c == '|';
+}
+
+/*
+ @return how many characters from position r on are plain characters that stand for themselves and no operator
+ applies to.  The last plain character is left out if an operator follows it, since the operator applies to it alone.
+ */
+static int literal_run(const char * regex, unsigned long length, int r) {
+    int end = r;
+    while (end < length && !is_special(regex[end])) {
+        end++;
+    }
+    if (end > r && end < length && is_operator(regex[end])) {
+        end--;
+    }
+    return end - r;
+}
+
+/*
+ @param ps the parse under way.  Every node of the tree comes from ps->arena; destroying it frees the whole tree.
  @param regex a const string containing the regular expression to be parsed.
  @param length of the regex
  @param r a pointer to the index of the current character of regex.
@@ -29,13 +147,13 @@
  
  Converts the regular expression into a parse tree.
  */
-struct token * parse_regex(const char * regex, unsigned long length, int * r) {
+struct token * parse_regex(struct parser * ps, const char * regex, unsigned long length, int * r) {
     //A token consists of two parts - an instruction and an element.
     //The element could be a character class, or another element derived from a character class.  It could also
     //be a list of multiple mixed character/derived classes for operators that support more than entry in "element."
     //The instruction operates on the element.  Examples include +, *, ?, {n:m}, etc.
-    struct token * parent = (struct token *)calloc(1, sizeof(struct token));  //The node in the tree
-    struct token *(*children) = (struct token *(*))calloc(DEFAULT_ELEMENT_ARRAY_SIZE, sizeof(struct token *)); //The array that "element" points to.
+    struct token * parent = (struct token *)arena_alloc(ps->arena, sizeof(struct token));  //The node in the tree
+    struct token *(*children) = (struct token *(*))arena_alloc(ps->arena, DEFAULT_ELEMENT_ARRAY_SIZE * sizeof(struct token *)); //The array that "element" points to.
     //children will be assigned to parent after everything is assigned to array.
     int clength = DEFAULT_ELEMENT_ARRAY_SIZE;
     struct token * class; //The current character class in the loop below.  Gauranteed to be assigned before use.
@@ -43,9 +161,6 @@ struct token * parse_regex(const char * regex, unsigned long length, int * r) {
     int nlength; //The current length in the loop below.  Gauranteed to be assigned before use.
     struct token *(*arr);
     
-    //Check for allocation failure
-    if (parent == NULL || children == NULL) {printf("calloc failure.\n"); exit(1);}
-    
     int c = 0; //represents the current child (array index)
     //r represents the index of the current character of the regex.
     for (; *r < length; c++) {
@@ -53,35 +168,48 @@ struct token * parse_regex(const char * regex, unsigned long length, int * r) {
         //Exit out of one layer deeper.
         if (regex[*r] == ')') {
             if (children[0] == NULL) {
-                printf("Parentheses contain nothing.\n");
-                exit(4);
+                parse_error(ps, *r, "Parentheses contain nothing.");
             } else {
                 *r = *r + 1;
                 parent->element = (void **)children;
                 parent->length = c;
-                parent->code = (int *)malloc(sizeof(int));
-                if (!(parent->code)) { printf("malloc failure.\n"); exit(1); }
+                parent->code = (int *)arena_alloc(ps->arena, sizeof(int));
                 parent->code[0] = 1;
                 return parent;
             }
         }
         
-        //If we need to grow the array "children", we must do it before assignment.
+        //If we need to grow the array "children", we must do it before assignment.  Doubling keeps long patterns
+        //linear.
         if (c == clength - 1) {
-            clength += 10;
-            children = (struct token *(*))realloc(children, clength * sizeof(struct token *));
-            if (children == NULL) { printf("realloc failure.\n"); exit(1); }
+            clength *= 2;
+            children = (struct token *(*))arena_realloc(ps->arena, children, (clength / 2) * sizeof(struct token *),
+                                                        clength * sizeof(struct token *));
         }
         
+        int run = literal_run(regex, length, *r);
+        int at = *r;
+        
         //Parentheses cause the program to go a level deeper in the tree.
         if (regex[*r] == '(') {
             //Recusively build tree
             *r = *r + 1;
-            class = parse_regex(regex, length, r);
+            class = parse_regex(ps, regex, length, r);
+        } else if (run > 1) {
+            //Several plain characters in a row, none of them with an operator, make one literal.
+            class = (struct token *)arena_alloc(ps->arena, sizeof(struct token));
+            class->code = (int *)arena_alloc(ps->arena, sizeof(int));
+            class->code[0] = 8;
+            class->element = arena_alloc(ps->arena, run + 1);
+            memcpy(class->element, regex + *r, run);
+            class->length = run;
+            *r = *r + run;
         } else {
             //Generate a character class
-            class = charclass(regex, length, r);
+            class = charclass(ps, regex, length, r);
         }
+        class->position = at;
+        int op = *r;
         
         /* This section recognizes and interprets various functional opterators (ex. *, +, |).
          Each struct token has 3 components:
@@ -94,41 +222,36 @@ struct token * parse_regex(const char * regex, unsigned long length, int * r) {
         
         
         if (regex[*r] == '*') { //*: Operator code 2
-            code = (int *)malloc(sizeof(int));   //Allocate memory for operator code.
-            arr = calloc(1, sizeof(struct token *)); //An array of struct token * of size one.
-            if (!code || !arr) { printf("memory allocation failure.\n"); exit(1); }
+            code = (int *)arena_alloc(ps->arena, sizeof(int));   //Allocate memory for operator code.
+            arr = arena_alloc(ps->arena, sizeof(struct token *)); //An array of struct token * of size one.
             arr[0] = class;  //This token, of the * operator, is one of possibly many in the parent 1 operator token
             code[0] = 2;  //2 indictates *
             nlength = 1;  //The * operator works on only one element at a time.
             *r = *r + 1;
         } else if (regex[*r] == '+') {  //+: Operator code 3
-            code = (int *)malloc(sizeof(int));
-            arr = calloc(1, sizeof(struct token *)); //An array of struct token * of size one.
-            if (!code || !arr) { printf("memory allocation failure.\n"); exit(1); }
+            code = (int *)arena_alloc(ps->arena, sizeof(int));
+            arr = arena_alloc(ps->arena, sizeof(struct token *)); //An array of struct token * of size one.
             arr[0] = class;
             code[0] = 3;
             nlength = 1;
             *r = *r + 1;
         } else if (regex[*r] == '?') {  //?: Operator code 4
-            code = (int *)malloc(sizeof(int));
-            arr = calloc(1, sizeof(struct token *)); //An array of struct token * of size one.
-            if (!code || !arr) { printf("memory allocation failure.\n"); exit(1); }
+            code = (int *)arena_alloc(ps->arena, sizeof(int));
+            arr = arena_alloc(ps->arena, sizeof(struct token *)); //An array of struct token * of size one.
             arr[0] = class;
             code[0] = 4;
             nlength = 1;
             *r = *r + 1;
         } else if (regex[*r] == '{') { //{n} or {n:m}.  The repeat_times function will figure out which one.
             *r = *r + 1;
-            code = repeat_times(regex, length, r);
-            arr = calloc(1, sizeof(struct token *)); //An array of struct token * of size one.
-            if (!arr) {printf("memory allocation failure.\n"); exit(1); }
+            code = repeat_times(ps, regex, length, r);
+            arr = arena_alloc(ps->arena, sizeof(struct token *)); //An array of struct token * of size one.
             arr[0] = class;
             nlength = 1;
         } else if (regex[*r] == '|') { //Operator code 7
-            code = (int *)malloc(sizeof(int));
+            code = (int *)arena_alloc(ps->arena, sizeof(int));
             int arrlen = 3;
-            arr = calloc(arrlen, sizeof(struct token *));
-            if (!code || !arr) { printf("memory allocation failure.\n"); exit(1); }
+            arr = arena_alloc(ps->arena, arrlen * sizeof(struct token *));
             arr[0] = class;
             code[0] = 7;
             nlength = 1;
@@ -136,49 +259,92 @@ struct token * parse_regex(const char * regex, unsigned long length, int * r) {
             //There can be many character classes or-ed together.
             while (regex[*r] == '|') {
                 *r = *r + 1;
+                int branch = *r;
                 
                 //The | operator operates on two (or more) char classes.
                 if (regex[*r] == '(') {
                     *r = *r + 1;
-                    class = parse_regex(regex, length, r);
+                    class = parse_regex(ps, regex, length, r);
                 } else {
-                    class = charclass(regex, length, r);
+                    class = charclass(ps, regex, length, r);
                 }
+                class->position = branch;
                 
                 if (nlength > arrlen - 1) {
-                    arrlen += 3;
-                    arr = realloc(arr, arrlen * sizeof(struct token *));
-                    if (!arr) { printf("realloc failure.\n"); exit(1); }
+                    arrlen *= 2;
+                    arr = arena_realloc(ps->arena, arr, (arrlen / 2) * sizeof(struct token *), arrlen * sizeof(struct token *));
                 }
                 arr[nlength] = class;
                 nlength++;
             }
         } else {
-            code = (int *)malloc(sizeof(int));
-            arr = calloc(1, sizeof(struct token *)); //An array of struct token * of size one.
-            if (!code || !arr) { printf("malloc failure.\n"); exit(1); }
+            code = (int *)arena_alloc(ps->arena, sizeof(int));
+            arr = arena_alloc(ps->arena, sizeof(struct token *)); //An array of struct token * of size one.
             arr[0] = class;
             code[0] = 1;
             nlength = 1;
+            op = at;
         }
         
-        struct token * new = calloc(1, sizeof(struct token));
-        if (!new) {printf("calloc failure.\n"); exit(1); }
+        struct token * new = arena_alloc(ps->arena, sizeof(struct token));
         new->element = (void **)arr;
         new->length = nlength;
         new->code = code;
+        new->position = op;
         children[c] = new;
     }
     
     //Attach array to parent
     parent->element = (void *(*))children;
     parent->length = c;
-    parent->code = malloc(sizeof(int));
+    parent->code = arena_alloc(ps->arena, sizeof(int));
     (parent->code)[0] = 1;
     
     return parent;
 }
 
+/*
+ Makes the token for a finished character class: the members of set, listed in order.  A class with no members at all
+ can't produce anything, so it is a syntax error.
+ */
+static struct token * class_from_set(struct parser * ps, struct token * class, const struct charset * set, int position) {
+    char members[257];
+    unsigned long n = charset_flatten(set, members);
+    if (n == 0) {
+        parse_error(ps, position, "Empty character class.");
+    }
+    class->element = arena_alloc(ps->arena, (n + 1) * sizeof(char));
+    memcpy(class->element, members, n + 1);
+    class->length = n;
+    return class;
+}
+
+/*
+ Adds the members of a [...] class to set, up to but not including the closing ].  Each item is a character (possibly
+ escaped), a class escape such as \d, or a range x-y of characters.  A - that can't start a range, because it comes
+ first, last, or right after a range, is a literal -.
+ */
+static void class_members(struct parser * ps, const char * regex, unsigned long length, int * r, struct charset * set) {
+    //Opening and closing brackets are checked before this function is called, but \0 is checked anyway.
+    while (regex[*r] != ']' && regex[*r] != '\0') {
+        if (regex[*r] == '\\' && *r + 1 < length && charset_escape(set, regex[*r + 1])) {
+            *r += 2;
+            continue;
+        }
+        unsigned char low = (unsigned char)escape(ps, regex, length, r);
+        if (regex[*r] == '-' && *r + 1 < length && regex[*r + 1] != ']') {
+            *r = *r + 1; //Account for the -
+            unsigned char high = (unsigned char)escape(ps, regex, length, r);
+            if (high < low) {
+                parse_error(ps, *r - 1, "Invalid range %c-%c in character class.", low, high);
+            }
+            charset_range(set, low, high);
+        } else {
+            charset_add(set, low);
+        }
+    }
+}
+
 /*
  @param regex the expression to generate classes from
  @param length the length of the regex
@@ -190,46 +356,47 @@ struct token * parse_regex(const char * regex, unsigned long length, int * r) {
  the class a string for debugging purposes.
  
  This function generates a character class from notation provided in the regex.  Character classes can be defined
- with the notation [...].  There are 3 special values supported inside a character class: a-z, A-Z, and 0-9.  They
- define the lower case alphabet, the upper case alphabet, and the digits, respectively.  Anything else inside the
- character class (escept escapes, see below) is interpreted literally.
- Examples: [a-z], [a-z0-9], [89hjq], [gt&*+a-z]
+ with the notation [...].  Inside the brackets, x-y stands for every character from x to y (a-z, A-Z and 0-9 are the
+ usual ones, but any range works), and \d, \w and \s stand for the digits, the word characters and the blanks (see
+ charset_escape).  Anything else inside the character class is interpreted literally.  The members are collected
+ into a set, so listing a character twice doesn't make it more likely.
+ Examples: [a-z], [a-z0-9], [89hjq], [gt&*+a-z], [!-/], [\d_]
  
  The escape character treats the next character in the expression literally, disregarding its value as a special
  character.  Inside a character class, you only need to escape ']' or '['
  */
-struct token * charclass(const char * regex, unsigned long length, int * r) {
-    struct token * class = (struct token *)calloc(1, sizeof(struct token));
-    class->code = (int *)malloc(sizeof(int));
+struct token * charclass(struct parser * ps, const char * regex, unsigned long length, int * r) {
+    struct token * class = (struct token *)arena_alloc(ps->arena, sizeof(struct token));
+    struct charset set;
+    class->code = (int *)arena_alloc(ps->arena, sizeof(int));
     (class->code)[0] = 0;  //A character class has operator code zero
+    memset(&set, 0, sizeof(struct charset));
     
     //Detect invalid characters (These are operators; if they are to be used as characters, they should be escaped).
     char l = regex[*r];
     if (l == '*' || l == '+' || l == '?' || l == '{' || l == '}' || l == '|') {
-        printf("Character %c invalid as character class.\n", l);
-        exit(4);
+        parse_error(ps, *r, "Character %c invalid as character class.", l);
     }
     
     //The . character counts for any character except newlines.
     if (regex[*r] == '.') { //NOT_BASE_CHARACTER_SET includes all of the visible, non-whitespace characters in ASCII
-        size_t notlen = strlen(NOT_BASE_CHARACTER_SET);
-        class->element = calloc(notlen + 1, sizeof(char));
-        if (class->element == NULL) {printf("calloc failure.\n"); exit(1); }
-        memcpy(class->element, NOT_BASE_CHARACTER_SET, (notlen + 1) * sizeof(char));
-        class->length = notlen;
+        charset_universe(&set);
         *r = *r + 1;
-        return class;
+        return class_from_set(ps, class, &set, *r - 1);
     }
     
     //Support for escape sequences
     if (regex[*r] == '\\') { //Is an escape character
-        //Add support for character-class escapes like (NOT YET IMPLEMENTED).
+        //Character-class escapes like \d
+        if (*r + 1 < length && charset_escape(&set, regex[*r + 1])) {
+            *r += 2;
+            return class_from_set(ps, class, &set, *r - 1);
+        }
         
-        class->element = calloc(2, sizeof(char)); //zero-s out allocated memory.
-        if (class->element == NULL) {printf("calloc failure.\n"); exit(1); }
+        class->element = arena_alloc(ps->arena, 2 * sizeof(char)); //zero-s out allocated memory.
         //The second space is for the string terminating null character.
         //While the null character doesn't actually have to be there, it makes it easy to print for debugging.
-        ((char *)(class->element))[0] = escape(regex, length, r);
+        ((char *)(class->element))[0] = escape(ps, regex, length, r);
         class->length = 1;
         return class;  //The escape function does all necessary incrementing, so this function doesn't have to.
     }
@@ -238,78 +405,19 @@ struct token * charclass(const char * regex, unsigned long length, int * r) {
     if (regex[*r] == '[') {  //Generate character class from bracket notation
         *r = *r + 1;
         if (regex[*r] == ']') {
-            printf("Empty character class.\n");
-            exit(4);
+            parse_error(ps, *r, "Empty character class.");
         } else if (regex[*r] == '^') {
             *r = *r + 1; //account for the ^
-            return notcharclass(regex, length, r);
-        }
-        int numchars = 0;
-        unsigned long clen = 27;  //Size of the English alphabet, plus one.
-        char * chars = (char *)calloc(clen, sizeof(char)); //Adds the terminating NULL
-        if (!chars) { printf("calloc failure.\n"); exit(1); }
-        
-        //Opening and closing brackets are checked before this class is called, but \0 is checked anyway.
-        while (regex[*r] != ']' && regex[*r] != '\0') {
-            //Handles special value a-z inside a character class
-            if (*r + 2 < length && regex[*r] == 'a' && regex[*r + 1] == '-' && regex[*r + 2] == 'z') {
-                if (numchars + 26 > clen - 1) {
-                    clen += 26;
-                    chars = (char *)realloc(chars, clen * sizeof(char));
-                    if (!chars) { printf("realloc failure.\n"); exit(1); }
-                    chars[clen - 1] = '\0'; //realloc does not initialize memory to zero.
-                }
-                int i = 97;
-                for (; i < 123; i++ ) {chars[numchars] = i; numchars++; }; //Add a-z by their ascii values
-                *r += 3;  //Move up *r by three spots (a, -, and z were used).
-                
-                //Handles special value A-Z inside a character class
-            } else if (*r + 2 < length && regex[*r] == 'A' && regex[*r + 1] == '-' && regex[*r + 2] == 'Z') {
-                if (numchars + 26 > clen - 1) {
-                    clen += 26;
-                    chars = (char *)realloc(chars, clen * sizeof(char));
-                    if (!chars) { printf("realloc failure.\n"); exit(1); }
-                }
-                int i = 65;
-                for (; i < 91; i++ ) {chars[numchars] = i; numchars++; };
-                *r += 3;
-                
-                //Handles special value 0-9 inside a character class
-            } else if (*r + 2 < length && regex[*r] == '0' && regex[*r + 1] == '-' && regex[*r + 2] == '9') {
-                //Resize array if needed.
-                if (numchars + 10 > clen - 1) {
-                    clen += 10;
-                    chars = (char *)realloc(chars, clen * sizeof(char));
-                    if (!chars) { printf("realloc failure.\n"); exit(1); }
-                }
-                int i = 48;
-                for (; i < 58; i++ ) {chars[numchars] = i; numchars++; }; //Fill in the values 0 through 9 in the array
-                *r += 3;
-            } else {
-                if (numchars + 1 > clen - 1) {
-                    clen += 10;
-                    chars = (char *)realloc(chars, clen * sizeof(char));
-                    if (!chars) { printf("realloc failure.\n"); exit(1); }
-                }
-                chars[numchars] = escape(regex, length, r);
-                numchars++;
-            }
+            return notcharclass(ps, regex, length, r);
         }
-        chars[numchars] = '\0'; //Makes it a string for easy debugging.
-        //Reallocation scheme guarantees the extra spot exists.
-        
+        class_members(ps, regex, length, r, &set);
         *r = *r + 1; //Account for the ] at the end of the class.
-        
-        class->element = (void **)chars;
-        class->length = numchars;
-        
-        return class;
+        return class_from_set(ps, class, &set, *r - 1);
     }
     
     
     //Character class consisting of single character.
-    class->element = calloc(2, sizeof(char)); //zero-s out allocated memory.
-    if (class->element == NULL) {printf("calloc failure.\n"); exit(1); }
+    class->element = arena_alloc(ps->arena, 2 * sizeof(char)); //zero-s out allocated memory.
     ((char *)(class->element))[0] = regex[*r];
     class->length = 1;
     *r = *r + 1;
@@ -318,87 +426,21 @@ struct token * charclass(const char * regex, unsigned long length, int * r) {
 
 /*
  The function defines a character class with ^ in it.  It is responsible for creating the entire class by itself,
- not just the element of the class.
+ not just the element of the class.  The class is every character of NOT_BASE_CHARACTER_SET that isn't listed, which
+ takes one pass over the listed members and one over the set.
  */
-struct token * notcharclass(const char * regex, unsigned long length, int * r) {
+struct token * notcharclass(struct parser * ps, const char * regex, unsigned long length, int * r) {
     //We enter the function with the [ and ^ consumed by charclass.
-    char notclass[] = NOT_BASE_CHARACTER_SET;
-    unsigned long notlength = strlen(notclass);
-    unsigned long j;  //Index of notclass while searching notclass for a particular character
-    char i; //The specific character's ascii value as generated by the loops for a-z, A-Z, and 0-9
+    struct token * nottoken = (struct token *)arena_alloc(ps->arena, sizeof(struct token));
+    struct charset set;
+    memset(&set, 0, sizeof(struct charset));
     
-    while (regex[*r] != ']') {
-        //Remove a-z
-        if (*r + 2 < length && regex[*r] == 'a' && regex[*r + 1] == '-' && regex[*r + 2] == 'z') {
-            i = 97;
-            for (; i < 123; i++ ) {
-                j = 0;
-                while (j < notlength && notclass[j] != i) { //Find the character in the NOT class
-                    j++;
-                }
-                //Delete character, if that character was in the base NOT class to begin with
-                if (j < notlength) {
-                    notclass[j] = notclass[notlength - 1];
-                    notlength--;
-                    notclass[notlength] = '\0';
-                }
-            }
-            *r += 3; //Account for a, -, and z
-        //Remove A-Z
-        } else if (*r + 2 < length && regex[*r] == 'A' && regex[*r + 1] == '-' && regex[*r + 2] == 'Z') {
-            i = 65;
-            for (; i < 91; i++ ) {
-                j = 0;
-                while (j < notlength && notclass[j] != i) { //Find the character in the NOT class
-                    j++;
-                }
-                //Delete character, if that character was in the base NOT class to begin with
-                if (j < notlength) {
-                    notclass[j] = notclass[notlength - 1];
-                    notlength--;
-                    notclass[notlength] = '\0';
-                }
-            }
-            *r += 3;
-        //Remomve 0-9
-        } else if (*r + 2 < length && regex[*r] == '0' && regex[*r + 1] == '-' && regex[*r + 2] == '9') {
-            i = 48;
-            for (; i < 58; i++ ) {
-                j = 0;
-                while (j < notlength && notclass[j] != i) { //Find the character in the NOT class
-                    j++;
-                }
-                //Delete character, if that character was in the base NOT class to begin with
-                if (j < notlength) {
-                    notclass[j] = notclass[notlength - 1];
-                    notlength--;
-                    notclass[notlength] = '\0';
-                }
-            }
-            *r += 3;
-        } else {
-            j = 0;
-            char c = escape(regex, length, r);  //Increments r for you
-            while (j < notlength && notclass[j] != c) { //Find the character in the NOT class
-                j++;
-            }
-            //Delete character, if that character was in the base NOT class to begin with
-            if (j < notlength) {
-                notclass[j] = notclass[notlength - 1];
-                notlength--;
-                notclass[notlength] = '\0';
-            }
-        }
-    }
+    class_members(ps, regex, length, r, &set);
     *r = *r + 1; //Accounts for the ].
+    charset_invert(&set);
     
-    struct token * nottoken = (struct token *)calloc(1, sizeof(struct token));
-    nottoken->length = notlength;
-    nottoken->element = (void **)calloc(notlength + 1, sizeof(char));
-    strcpy((char *)nottoken->element, notclass);
-    nottoken->code = calloc(1, sizeof(int)); //Initializes to zero, so code == 0.
-    
-    return nottoken;
+    nottoken->code = arena_alloc(ps->arena, sizeof(int)); //Initializes to zero, so code == 0.
+    return class_from_set(ps, nottoken, &set, *r - 1);
 }
 
 /*
@@ -406,18 +448,21 @@ struct token * notcharclass(const char * regex, unsigned long length, int * r) {
  If the current character is not an escape character, returns the current character.
  Increments *r to account for changes.
  */
-char escape(const char * regex, unsigned long length, int * r) {
+char escape(struct parser * ps, const char * regex, unsigned long length, int * r) {
     if (regex[*r] == '\\') { //Is an escape character
         if (*r + 1 < length) {
             if (regex[*r + 1] == 'n') { //Return a newline character
                 *r = *r + 2;
                 return '\n';
             }
+            if (regex[*r + 1] == 't') { //Return a tab
+                *r = *r + 2;
+                return '\t';
+            }
             *r = *r + 2;
             return regex[*r - 1];
         } else {
-            printf("Regular expression ends with escape character that escapes nothing.\n");
-            exit(4);
+            parse_error(ps, *r, "Regular expression ends with escape character that escapes nothing.");
         }
         
     }
@@ -436,7 +481,7 @@ char escape(const char * regex, unsigned long length, int * r) {
  (Operator code 5 has the exact number of times to repeat as its second array element, and operator code 6 has the
  upper and lower bounds of the range to repeat in its second and third array elements).
  */
-int * repeat_times(const char * regex, unsigned long length, int * r) {
+int * repeat_times(struct parser * ps, const char * regex, unsigned long length, int * r) {
     int num1 = -1;
     unsigned short numstr_len = 10;
     char numstr[10];
@@ -453,22 +498,18 @@ int * repeat_times(const char * regex, unsigned long length, int * r) {
     
     //Check for overflow
     num1 = atoi(numstr);
-    if (num1 < 0) { printf("Number %s is too large.\n", numstr); exit(4); }
+    if (num1 < 0) { parse_error(ps, *r, "Number %s is too large.", numstr); }
     
     if (regex[*r] == '}') {  //Operator {n}, code = 5
-        int * code = calloc(2, sizeof(int));
-        if (!code) { printf("calloc failure.\n"); exit(1); }
+        int * code = arena_alloc(ps->arena, 2 * sizeof(int));
         *r = *r + 1;
         code[0] = 5;
         code[1] = num1;
         return code;
     } else if (regex[*r] > 47 && regex[*r] < 58) {
-        printf("Number beginning with %s is too large.\n", numstr);
-        exit(4);
+        parse_error(ps, *r, "Number beginning with %s is too large.", numstr);
     } else if (regex[*r] != ':' && regex[*r] != ',') {
-        printf("Invalid character: {%s%c\n", numstr, regex[*r]);
-        printf("Format this operator like: {2:8} or {2,8}\n");
-        exit(4);
+        parse_error(ps, *r, "Invalid character: {%s%c\nFormat this operator like: {2:8} or {2,8}", numstr, regex[*r]);
     }
     //This means theres a : or , left, which is the {n:m} operator (code = 6)
     *r = *r + 1;
@@ -485,27 +526,22 @@ int * repeat_times(const char * regex, unsigned long length, int * r) {
     
     if (regex[*r] != '}') {
         if (regex[*r] > 47 && regex[*r] < 58) {
-            printf("Number beginning with %s to large.\n", numstr);
-        } else {
-            printf("Invalid closing character '}'.\n");
+            parse_error(ps, *r, "Number beginning with %s to large.", numstr);
         }
-        exit(4);
+        parse_error(ps, *r, "Invalid closing character '}'.");
     }
     *r = *r + 1;  //Account for closing }
     
     //The {n:m} operator requires 3 integers as part of its operator code.  The first is the operator code itself, 6.
     //The second is the lower bound, n, and the third is the upper bound, m.
-    int * code = (int *)calloc(3, sizeof(int));
-    if (!code) { printf("calloc failure.\n"); exit(1); }
+    int * code = (int *)arena_alloc(ps->arena, 3 * sizeof(int));
     code[0] = 6;
     code[1] = num1;
     
     code[2] = atoi(numstr);
-    if (code[2] < 0) { printf("Number %s is too large.\n", numstr); exit(4); }
+    if (code[2] < 0) { parse_error(ps, *r, "Number %s is too large.", numstr); }
     if (code[1] > code[2]) {
-        printf("n must be less than or equal to m in {n:m} or {n,m}).\n");
-        printf("You had {%d:%d}.\n", code[1], code[2]);
-        exit(4);
+        parse_error(ps, *r - 1, "n must be less than or equal to m in {n:m} or {n,m}).\nYou had {%d:%d}.", code[1], code[2]);
     }
     
     return code;
@@ -7,15 +7,37 @@
 //
 
 #include "global.h"
+#include "arena.h"
 
 #ifndef rdparser_h
 #define rdparser_h
 
-struct token * parse_regex(const char * regex, unsigned long length, int * r);
-struct token * charclass(const char * regex, unsigned long length, int * r);
-char escape(const char * regex, unsigned long length, int * r);
-int * repeat_times(const char * regex, unsigned long length, int * r);
-struct token * notcharclass(const char * regex, unsigned long length, int *r);
+#include <setjmp.h>
+
+#ifndef PARSE_MESSAGE_SIZE
+#define PARSE_MESSAGE_SIZE 256
+#endif
+
+//The state of one parse.  Nothing is shared between parses, so any number can run at once.
+struct parser {
+    struct arena * arena;              //Owns every node of the tree.
+    jmp_buf fail;                      //Where parse_error returns to.
+    int position;                      //Index into the regex of the syntax error, if there is one.
+    char message[PARSE_MESSAGE_SIZE];  //and what is wrong there.
+};
+
+struct token * parse_pattern(struct parser * ps, const char * regex, unsigned long length);
+void parse_error(struct parser * ps, int position, const char * format, ...)
+#ifdef __GNUC__
+    __attribute__((noreturn, format(printf, 3, 4)))
+#endif
+    ;
+void grpSymChk(struct parser * ps, const char * regex, unsigned long length);
+struct token * parse_regex(struct parser * ps, const char * regex, unsigned long length, int * r);
+struct token * charclass(struct parser * ps, const char * regex, unsigned long length, int * r);
+char escape(struct parser * ps, const char * regex, unsigned long length, int * r);
+int * repeat_times(struct parser * ps, const char * regex, unsigned long length, int * r);
+struct token * notcharclass(struct parser * ps, const char * regex, unsigned long length, int *r);
 
 
 #endif /* rdparser_h */
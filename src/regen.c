@@ -0,0 +1,824 @@
+//
+//  regen.c
+//  regen
+//  The public interface of libregen, built on the parser, the compiler and the interpreter.
+//
+
+#include "regen.h"
+#include "rdparser.h"
+#include "optimize.h"
+#include "compile.h"
+#include "strgen.h"
+#include "bulk.h"
+#include "cache.h"
+#include "uniform.h"
+#include "enumerate.h"
+#include "lengths.h"
+#include "stats.h"
+#include "match.h"
+#include <limits.h>
+
+//One of prog, uniform, enumeration and window is set, depending on how the pattern was compiled.
+struct regen_pattern {
+    struct program * prog;
+    struct uniform * uniform;
+    struct enumeration * enumeration;
+    struct window * window;
+    unsigned long id;                 //Tells enumerated patterns apart, even one allocated where a freed one was.
+    struct phase parse;               //How long it took to parse and to compile, for regen_stats.
+    struct phase compile;
+};
+
+//A cache file mapped into memory, and a pattern handle for each of its programs.
+struct regen_cache {
+    struct cache c;
+    regen_pattern * patterns;
+};
+
+//The automaton of a pattern, and a matcher of its own for regen_match.
+struct regen_matcher {
+    struct automaton a;
+    struct matcher m;
+};
+
+struct regen_state {
+    struct rng rng;
+    float pval;
+    struct strbuf buf;                //The last string generated, NUL-terminated.
+    const regen_pattern * pending;    //Set while the last string has not been handed out yet.
+    uint64_t rank;                    //Index of the next string of an enumerated pattern.
+    struct enum_iter iter;            //Where the state is in the list of the enumerated pattern numbered iterid.
+    unsigned long iterid;
+    struct budget budget;             //Limits on each string generated by running a program.
+    struct budget_counts counts;
+};
+
+//Numbers enumerated patterns from 1; 0 is no pattern.
+static unsigned long last_id = 0;
+
+static int valid_p(double p) {
+    return p >= 0 && p <= MAX_DEC_CONT_VALUE;
+}
+
+static int valid_policy(int policy) {
+    return policy == REGEN_BUDGET_TRUNCATE || policy == REGEN_BUDGET_RESAMPLE || policy == REGEN_BUDGET_FAIL;
+}
+
+/*
+ Parses regex into a tree allocated from ps->arena.
+ @return the tree, or NULL (with error filled in) if regex is not a valid pattern.
+ */
+static struct token * parse(struct parser * ps, const char * regex, size_t length, struct regen_error * error,
+                            struct phase * time) {
+    struct moment began;
+    stats_start(&began);
+    ps->arena = arena_create();
+    ps->position = -1;
+    ps->message[0] = '\0';
+
+    //The parser reads one past the end, so it gets a terminated copy.
+    char * copy = (char *)arena_alloc(ps->arena, length + 1);
+    memcpy(copy, regex, length);
+
+    struct token * tree = parse_pattern(ps, copy, length);
+    stats_stop(&began, time);
+    if (tree == NULL && error) {
+        error->status = REGEN_ESYNTAX;
+        error->position = ps->position;
+        snprintf(error->message, REGEN_MESSAGE_SIZE, "%s", ps->message);
+    }
+    return tree;
+}
+
+static void no_error(struct regen_error * error) {
+    if (error) {
+        error->status = REGEN_OK;
+        error->position = -1;
+        error->message[0] = '\0';
+    }
+}
+
+/*
+ @param parsed, began how long parsing took, and when compiling started.
+ */
+static regen_pattern * new_pattern(const struct phase * parsed, const struct moment * began) {
+    regen_pattern * pattern = (regen_pattern *)malloc(sizeof(regen_pattern));
+    if (pattern == NULL) { printf("malloc failure.\n"); exit(1); }
+    pattern->prog = NULL;
+    pattern->uniform = NULL;
+    pattern->enumeration = NULL;
+    pattern->window = NULL;
+    pattern->id = 0;
+    pattern->parse = *parsed;
+    memset(&pattern->compile, 0, sizeof(pattern->compile));
+    stats_stop(began, &pattern->compile);
+    return pattern;
+}
+
+/*
+ @param pattern where the compiled pattern is stored on success.  Release it with regen_pattern_free.
+ @param regex the pattern.  It does not have to be NUL-terminated.
+ @param length of the regex
+ @param error if not NULL, filled in with what went wrong when the result is not REGEN_OK.
+ @return REGEN_OK, or REGEN_ESYNTAX if regex is not a valid pattern.
+ */
+int regen_compile(regen_pattern ** pattern, const char * regex, size_t length, struct regen_error * error) {
+    struct parser ps;
+    struct phase parsed = {0, 0};
+    struct moment began;
+    struct token * tree = parse(&ps, regex, length, error, &parsed);
+    if (tree == NULL) {
+        arena_destroy(ps.arena);
+        return REGEN_ESYNTAX;
+    }
+
+    //Lower the tree into a flat program; the tree itself is no longer needed after this.
+    stats_start(&began);
+    struct program * prog = compile_tree(optimize_tree(ps.arena, tree));
+    arena_destroy(ps.arena);
+
+    *pattern = new_pattern(&parsed, &began);
+    (*pattern)->prog = prog;
+    no_error(error);
+    return REGEN_OK;
+}
+
+/*
+ Like regen_compile, but strings generated from the pattern are picked uniformly from every string it matches whose
+ length is between min and max (inclusive), instead of by choosing branches and repeats at random.  -p has no effect
+ on them.  Such a pattern can't be saved with regen_cache_write.
+ @return REGEN_OK, REGEN_ESYNTAX, REGEN_EINVAL if min > max, REGEN_ENOMATCH if no string of those lengths matches, or
+ REGEN_ELIMIT if the tables needed are too big (they grow with max and with the size of the pattern's automaton).
+ */
+int regen_compile_uniform(regen_pattern ** pattern, const char * regex, size_t length, unsigned long min,
+                          unsigned long max, struct regen_error * error) {
+    struct parser ps;
+    struct phase parsed = {0, 0};
+    struct moment began;
+    struct uniform u;
+    if (min > max) {
+        if (error) {
+            error->status = REGEN_EINVAL;
+            error->position = -1;
+            snprintf(error->message, REGEN_MESSAGE_SIZE, "The shortest length is more than the longest.");
+        }
+        return REGEN_EINVAL;
+    }
+    struct token * tree = parse(&ps, regex, length, error, &parsed);
+    if (tree == NULL) {
+        arena_destroy(ps.arena);
+        return REGEN_ESYNTAX;
+    }
+    stats_start(&began);
+    int result = uniform_build(&u, optimize_tree(ps.arena, tree), min, max);
+    arena_destroy(ps.arena);
+    if (result != UNIFORM_OK) {
+        result = result == UNIFORM_ENOMATCH ? REGEN_ENOMATCH : REGEN_ELIMIT;
+        if (error) {
+            error->status = result;
+            error->position = -1;
+            snprintf(error->message, REGEN_MESSAGE_SIZE, "%s", regen_strerror(result));
+        }
+        return result;
+    }
+
+    *pattern = new_pattern(&parsed, &began);
+    (*pattern)->uniform = (struct uniform *)malloc(sizeof(struct uniform));
+    if ((*pattern)->uniform == NULL) { printf("malloc failure.\n"); exit(1); }
+    *(*pattern)->uniform = u;
+    no_error(error);
+    return REGEN_OK;
+}
+
+/*
+ Like regen_compile, but every string generated from the pattern is between min and max characters long (inclusive).
+ Branches and repeats are chosen at random as regen_compile's are, with the same odds between the choices that can
+ still end in that range.  Such a pattern can't be saved with regen_cache_write.
+ @return REGEN_OK, REGEN_ESYNTAX, REGEN_EINVAL if min > max, REGEN_ENOMATCH if no string of those lengths matches, or
+ REGEN_ELIMIT if the length sets needed are too big (they grow with max and with the size of the pattern).
+ */
+int regen_compile_bounded(regen_pattern ** pattern, const char * regex, size_t length, unsigned long min,
+                          unsigned long max, struct regen_error * error) {
+    struct parser ps;
+    struct phase parsed = {0, 0};
+    struct moment began;
+    struct window w;
+    if (min > max) {
+        if (error) {
+            error->status = REGEN_EINVAL;
+            error->position = -1;
+            snprintf(error->message, REGEN_MESSAGE_SIZE, "The shortest length is more than the longest.");
+        }
+        return REGEN_EINVAL;
+    }
+    struct token * tree = parse(&ps, regex, length, error, &parsed);
+    if (tree == NULL) {
+        arena_destroy(ps.arena);
+        return REGEN_ESYNTAX;
+    }
+    //The window keeps the tree, and the arena with it.
+    stats_start(&began);
+    int result = window_build(&w, ps.arena, optimize_tree(ps.arena, tree), min, max);
+    if (result != WINDOW_OK) {
+        result = result == WINDOW_ENOMATCH ? REGEN_ENOMATCH : REGEN_ELIMIT;
+        if (error) {
+            error->status = result;
+            error->position = -1;
+            snprintf(error->message, REGEN_MESSAGE_SIZE, "%s", regen_strerror(result));
+        }
+        return result;
+    }
+
+    *pattern = new_pattern(&parsed, &began);
+    (*pattern)->window = (struct window *)malloc(sizeof(struct window));
+    if ((*pattern)->window == NULL) { printf("malloc failure.\n"); exit(1); }
+    *(*pattern)->window = w;
+    no_error(error);
+    return REGEN_OK;
+}
+
+/*
+ Like regen_compile, but strings generated from the pattern are every string it matches, each once, in order: string k
+ of the list is line k of regen_write_lines, or what regen_generate returns after regen_state_seed(state, seed, k).
+ @param max the longest string to list, or -1 for no limit.
+ @param order REGEN_ORDER_LENGTH (shortest first, then byte order) or REGEN_ORDER_LEX (byte order).
+ @return REGEN_OK, REGEN_ESYNTAX, REGEN_EINFINITE if max is -1 but the pattern matches strings of every length, or
+ REGEN_ELIMIT if the tables needed are too big (they grow with the longest length and the size of the automaton).
+ */
+int regen_compile_enumerate(regen_pattern ** pattern, const char * regex, size_t length, long max, int order,
+                            struct regen_error * error) {
+    struct parser ps;
+    struct phase parsed = {0, 0};
+    struct moment began;
+    struct enumeration e;
+    if (max < -1 || (order != REGEN_ORDER_LENGTH && order != REGEN_ORDER_LEX)) {
+        if (error) {
+            error->status = REGEN_EINVAL;
+            error->position = -1;
+            snprintf(error->message, REGEN_MESSAGE_SIZE, "%s", regen_strerror(REGEN_EINVAL));
+        }
+        return REGEN_EINVAL;
+    }
+    struct token * tree = parse(&ps, regex, length, error, &parsed);
+    if (tree == NULL) {
+        arena_destroy(ps.arena);
+        return REGEN_ESYNTAX;
+    }
+    stats_start(&began);
+    int result = enumerate_build(&e, optimize_tree(ps.arena, tree), max,
+                                 order == REGEN_ORDER_LEX ? ENUMERATE_LEX : ENUMERATE_LENGTH);
+    arena_destroy(ps.arena);
+    if (result != ENUMERATE_OK) {
+        result = result == ENUMERATE_EINFINITE ? REGEN_EINFINITE : REGEN_ELIMIT;
+        if (error) {
+            error->status = result;
+            error->position = -1;
+            snprintf(error->message, REGEN_MESSAGE_SIZE, "%s", regen_strerror(result));
+        }
+        return result;
+    }
+
+    *pattern = new_pattern(&parsed, &began);
+    (*pattern)->enumeration = (struct enumeration *)malloc(sizeof(struct enumeration));
+    if ((*pattern)->enumeration == NULL) { printf("malloc failure.\n"); exit(1); }
+    *(*pattern)->enumeration = e;
+    (*pattern)->id = __sync_add_and_fetch(&last_id, 1);
+    no_error(error);
+    return REGEN_OK;
+}
+
+/*
+ @return how many strings an enumerated pattern lists (UINT64_MAX if at least that many), or 0 for other patterns.
+ */
+uint64_t regen_enumerate_count(const regen_pattern * pattern) {
+    return pattern->enumeration ? pattern->enumeration->total : 0;
+}
+
+void regen_pattern_free(regen_pattern * pattern) {
+    if (pattern) {
+        if (pattern->prog) {
+            free_program(pattern->prog);
+        }
+        if (pattern->uniform) {
+            uniform_free(pattern->uniform);
+            free(pattern->uniform);
+        }
+        if (pattern->enumeration) {
+            enumerate_free(pattern->enumeration);
+            free(pattern->enumeration);
+        }
+        if (pattern->window) {
+            window_free(pattern->window);
+            free(pattern->window);
+        }
+        free(pattern);
+    }
+}
+
+/*
+ @param state where the new state is stored on success.  Release it with regen_state_free.
+ @param p the probability that * and + repeat their subtree once more, in [0, MAX_DEC_CONT_VALUE].
+ @param seed the random seed.  The state starts on stream 0 of it (see regen_state_seed).
+ @return REGEN_OK, or REGEN_EINVAL if p is out of range.
+ */
+int regen_state_create(regen_state ** state, double p, uint64_t seed) {
+    if (!valid_p(p)) {
+        return REGEN_EINVAL;
+    }
+    *state = (regen_state *)malloc(sizeof(regen_state));
+    if (*state == NULL) { printf("malloc failure.\n"); exit(1); }
+    (*state)->pval = (float)p;
+    (*state)->buf.data = NULL;
+    (*state)->buf.length = 0;
+    (*state)->buf.size = 0;
+    strbuf_reserve(&(*state)->buf, STARTING_OUTPUT_STRING_ARRAY_SIZE);
+    (*state)->iterid = 0;
+    memset(&(*state)->budget, 0, sizeof((*state)->budget));
+    memset(&(*state)->counts, 0, sizeof((*state)->counts));
+    regen_state_seed(*state, seed, 0);
+    return REGEN_OK;
+}
+
+/*
+ Limits every string the state generates from then on, so that no string takes more than a bounded time and memory.
+ Patterns from regen_compile_uniform, regen_compile_enumerate and regen_compile_bounded are bounded by their lengths
+ already, and are not limited.
+ @param max_bytes the most characters in a string, or 0 for no limit.
+ @param max_steps the most passes through the pattern's repeats for one string, or 0 for no limit.
+ @param policy REGEN_BUDGET_TRUNCATE, REGEN_BUDGET_RESAMPLE or REGEN_BUDGET_FAIL.  A string given up on makes
+ regen_generate_into return REGEN_EBUDGET, and regen_generate NULL.
+ @return REGEN_OK, or REGEN_EINVAL if the policy is none of those.
+ */
+int regen_state_budget(regen_state * state, size_t max_bytes, unsigned long max_steps, int policy) {
+    if (!valid_policy(policy)) {
+        return REGEN_EINVAL;
+    }
+    state->budget.bytes = max_bytes;
+    state->budget.steps = max_steps;
+    state->budget.policy = policy;
+    return REGEN_OK;
+}
+
+/*
+ Sets counts to how often strings the state generated went over their budget, since it was created.
+ */
+void regen_state_counts(const regen_state * state, struct regen_budget_counts * counts) {
+    counts->truncated = state->counts.truncated;
+    counts->resampled = state->counts.resampled;
+    counts->failed = state->counts.failed;
+}
+
+/*
+ Moves the state to the start of a stream of seed.  Stream k gives the same strings as line k of the command line
+ tool run with -s seed, so many states (or processes) can split one run between them.  For an enumerated pattern,
+ the next string is string k of its list, whatever the seed.
+ */
+void regen_state_seed(regen_state * state, uint64_t seed, uint64_t stream) {
+    rng_seed_stream(&state->rng, seed, stream);
+    state->rank = stream;
+    state->pending = NULL;
+}
+
+void regen_state_free(regen_state * state) {
+    if (state) {
+        if (state->iterid) {
+            enum_iter_free(&state->iter);
+        }
+        strbuf_free(&state->buf);
+        free(state);
+    }
+}
+
+/*
+ Copies the next string of an enumerated pattern's list into the state's buffer.
+ @return REGEN_OK, or REGEN_EDONE if the list has ended.
+ */
+static int next_listed(const regen_pattern * pattern, regen_state * state) {
+    //Going on from the string before costs a few steps; starting anywhere else means finding the place again.
+    if (state->iterid != pattern->id) {
+        if (state->iterid) {
+            enum_iter_free(&state->iter);
+        }
+        enum_iter_init(&state->iter, pattern->enumeration);
+        state->iterid = pattern->id;
+    }
+    if (state->iter.rank != state->rank) {
+        enum_iter_seek(&state->iter, state->rank);
+    }
+    if (state->iter.done) {
+        return REGEN_EDONE;
+    }
+    memcpy(strbuf_reserve(&state->buf, state->iter.length), state->iter.string, state->iter.length);
+    state->buf.length = state->iter.length;
+    state->rank++;
+    enum_iter_next(&state->iter);
+    return REGEN_OK;
+}
+
+/*
+ Generates the next string into the state's buffer, unless one is still waiting to be handed out.
+ @return REGEN_OK, REGEN_EDONE if the pattern is enumerated and its list has ended, or REGEN_EBUDGET if the string
+ was given up on.
+ */
+static int next_string(const regen_pattern * pattern, regen_state * state) {
+    if (state->pending == pattern) {
+        return REGEN_OK;
+    }
+    state->buf.length = 0;
+    if (pattern->enumeration) {
+        if (next_listed(pattern, state) != REGEN_OK) {
+            return REGEN_EDONE;
+        }
+    } else if (pattern->uniform) {
+        uniform_generate(pattern->uniform, &state->rng, &state->buf);
+    } else if (pattern->window) {
+        window_generate(pattern->window, state->pval, &state->rng, &state->buf);
+    } else if (generate_budgeted(pattern->prog, state->pval, &state->rng, &state->buf, &state->budget,
+                                 &state->counts)) {
+        return REGEN_EBUDGET;
+    }
+    *strbuf_reserve(&state->buf, 1) = '\0';
+    state->pending = pattern;
+    return REGEN_OK;
+}
+
+/*
+ @param buffer where the string is written, NUL-terminated.
+ @param size of the buffer, including room for the NUL.
+ @param length if not NULL, set to the length of the string (without the NUL), whether it fit or not.
+ @return REGEN_OK, REGEN_ENOSPC if the string and its NUL don't fit in size bytes, REGEN_EDONE if the pattern is
+ enumerated and every string of it has been generated, or REGEN_EBUDGET if the string went over the state's budget
+ and was given up on.
+
+ A string that doesn't fit is kept, and the next call with the same pattern returns it again instead of a new one, so
+ a caller can grow its buffer to *length + 1 and try again without skipping a string.
+ */
+int regen_generate_into(const regen_pattern * pattern, regen_state * state, char * buffer, size_t size,
+                        size_t * length) {
+    int result = next_string(pattern, state);
+    if (result != REGEN_OK) {
+        return result;
+    }
+    if (length) {
+        *length = state->buf.length;
+    }
+    if (state->buf.length >= size) {
+        return REGEN_ENOSPC;
+    }
+    memcpy(buffer, state->buf.data, state->buf.length + 1);
+    state->pending = NULL;
+    return REGEN_OK;
+}
+
+/*
+ @return the next string, NUL-terminated, in memory owned by the state.  It stays valid until the next call with this
+ state.  If length is not NULL it is set to the string's length.  Returns NULL once an enumerated pattern has no
+ strings left, or if the string went over the state's budget and was given up on.
+ */
+const char * regen_generate(const regen_pattern * pattern, regen_state * state, size_t * length) {
+    if (next_string(pattern, state) != REGEN_OK) {
+        return NULL;
+    }
+    if (length) {
+        *length = state->buf.length;
+    }
+    state->pending = NULL;
+    return state->buf.data;
+}
+
+static struct regen_phase seconds(const struct phase * phase) {
+    struct regen_phase converted;
+    converted.wall = phase->wall / 1e9;
+    converted.cpu = phase->cpu / 1e9;
+    return converted;
+}
+
+/*
+ Fills in stats from what a run added up.  In a stats build, every instruction of the program that ran is listed, with
+ the place in the pattern it came from when the program was compiled rather than loaded.
+ */
+static void fill_stats(const regen_pattern * pattern, const struct run_stats * run, const struct phase * whole,
+                       struct regen_stats * stats) {
+    stats->parse = seconds(&pattern->parse);
+    stats->compile = seconds(&pattern->compile);
+    stats->generate = seconds(&run->generate);
+    stats->write = seconds(&run->write);
+    stats->wall = whole->wall / 1e9;
+    stats->lines = run->lines;
+    stats->bytes = run->bytes;
+    memcpy(stats->lengths, run->lengths, sizeof(stats->lengths));
+    stats->counted = STATS_COUNTED;
+    stats->allocs = 0;
+    stats->reallocs = 0;
+    stats->nnodes = 0;
+    stats->nodes = NULL;
+#ifdef REGEN_STATS
+    stats->allocs = stats_allocs;
+    stats->reallocs = stats_reallocs;
+    if (pattern->prog) {
+        const struct program * prog = pattern->prog;
+        unsigned long i = 0;
+        stats->nodes = (struct regen_node_stats *)malloc((prog->length ? prog->length : 1) * sizeof(struct regen_node_stats));
+        if (stats->nodes == NULL) { printf("malloc failure.\n"); exit(1); }
+        for (; i < prog->length; i++) {
+            if (run->vm.visits[i]) {
+                struct regen_node_stats * node = &stats->nodes[stats->nnodes++];
+                node->position = prog->positions ? prog->positions[i] : -1;
+                node->instruction = i;
+                node->op = opcode_name(prog->code[i]);
+                node->visits = run->vm.visits[i];
+                node->seconds = run->vm.nanos[i] / 1e9;
+            }
+        }
+    }
+#endif
+}
+
+/*
+ Writes lines->count lines to fd, each followed by a newline, exactly like the command line tool does.  For an
+ enumerated pattern, the lines stop early if its list ends first.  Lines given up on for going over their budget are
+ left out.
+ @param written if not NULL, set to the number of lines written.
+ @return REGEN_OK, REGEN_EINVAL if one of the settings is out of range (start + count must fit in an unsigned long,
+ unless the pattern is enumerated), or REGEN_EEXHAUSTED if a unique run stopped early because the pattern made no
+ more new lines: it had made lines->space of them, or UNIQUE_MAX_REPEATS repeats in a row.
+ */
+int regen_write_lines(const regen_pattern * pattern, const struct regen_lines * lines, int fd,
+                      unsigned long * written) {
+    if (written) {
+        *written = 0;
+    }
+    if (lines->counts) {
+        memset(lines->counts, 0, sizeof(*lines->counts));
+    }
+    if (lines->mismatches) {
+        memset(lines->mismatches, 0, sizeof(*lines->mismatches));
+    }
+    if (!valid_p(lines->p) || lines->count == 0 || lines->threads < 1 || lines->threads > MAX_THREADS
+        || (!pattern->enumeration && lines->start > ULONG_MAX - lines->count)
+        || (lines->unique && !(lines->false_positive >= 0 && lines->false_positive < 1))
+        || !valid_policy(lines->budget_policy)) {
+        return REGEN_EINVAL;
+    }
+    struct bulk_job job;
+    struct budget_counts counts;
+    struct regen_mismatches mismatches;
+    struct run_stats run;
+    struct phase whole = {0, 0};
+    struct moment began;
+    if (lines->stats) {
+        memset(lines->stats, 0, sizeof(*lines->stats));
+        memset(&run, 0, sizeof(run));
+#ifdef REGEN_STATS
+        if (pattern->prog) {
+            vm_stats_init(&run.vm, pattern->prog->code, pattern->prog->length);
+        }
+#endif
+        stats_start(&began);
+    }
+    job.prog = pattern->prog;
+    job.uniform = pattern->uniform;
+    job.enumeration = pattern->enumeration;
+    job.window = pattern->window;
+    job.pval = (float)lines->p;
+    job.seed = lines->seed;
+    job.start = lines->start;
+    job.lines = lines->count;
+    job.unique = lines->unique && !pattern->enumeration;  //A list never repeats itself.
+    job.false_positive = lines->false_positive;
+    job.space = lines->space;
+    job.budget.bytes = lines->max_bytes;
+    job.budget.steps = lines->max_steps;
+    job.budget.policy = lines->budget_policy;
+    job.counts = &counts;
+    job.stats = lines->stats ? &run : NULL;
+    job.verify = lines->verify ? &lines->verify->a : NULL;
+    job.mismatches = lines->mismatches ? lines->mismatches : &mismatches;
+    memset(job.mismatches, 0, sizeof(*job.mismatches));
+    if (pattern->enumeration) {
+        //The list may end before count lines.
+        uint64_t total = pattern->enumeration->total;
+        if (lines->start >= total) {
+            if (lines->stats) {
+                stats_stop(&began, &whole);
+                fill_stats(pattern, &run, &whole, lines->stats);
+                vm_stats_free(&run.vm);
+            }
+            return REGEN_OK;
+        }
+        if (job.lines > total - lines->start) {
+            job.lines = (unsigned long)(total - lines->start);
+        }
+    }
+    job.threads = lines->threads;
+    job.ordered = lines->ordered;
+    job.fd = fd;
+    job.preallocate = lines->preallocate;
+    unsigned long count = generate_bulk(&job);
+    if (written) {
+        *written = count;
+    }
+    if (lines->counts) {
+        lines->counts->truncated = counts.truncated;
+        lines->counts->resampled = counts.resampled;
+        lines->counts->failed = counts.failed;
+    }
+    if (lines->stats) {
+        stats_stop(&began, &whole);
+        fill_stats(pattern, &run, &whole, lines->stats);
+        vm_stats_free(&run.vm);
+    }
+    return job.unique && count < job.lines ? REGEN_EEXHAUSTED : REGEN_OK;
+}
+
+/*
+ @param matcher where the matcher is stored on success.  Release it with regen_matcher_free.
+ @param regex the pattern, which does not have to be NUL-terminated.
+ @return REGEN_OK, REGEN_ESYNTAX, or REGEN_ELIMIT if the pattern's automaton would be too big.
+
+ The matcher is built from the same parse tree as the strings regen_compile generates, so it checks the generator
+ against the pattern as the parser read it.
+ */
+int regen_matcher_create(regen_matcher ** matcher, const char * regex, size_t length, struct regen_error * error) {
+    struct parser ps;
+    struct phase parsed = {0, 0};
+    struct token * tree = parse(&ps, regex, length, error, &parsed);
+    if (tree == NULL) {
+        arena_destroy(ps.arena);
+        return REGEN_ESYNTAX;
+    }
+    regen_matcher * made = (regen_matcher *)malloc(sizeof(regen_matcher));
+    if (made == NULL) { printf("malloc failure.\n"); exit(1); }
+    int built = automaton_build(&made->a, optimize_tree(ps.arena, tree));
+    arena_destroy(ps.arena);
+    if (built < 0) {
+        free(made);
+        if (error) {
+            error->status = REGEN_ELIMIT;
+            error->position = -1;
+            snprintf(error->message, REGEN_MESSAGE_SIZE, "%s", regen_strerror(REGEN_ELIMIT));
+        }
+        return REGEN_ELIMIT;
+    }
+    matcher_init(&made->m, &made->a);
+    *matcher = made;
+    no_error(error);
+    return REGEN_OK;
+}
+
+/*
+ @return 1 if the pattern matches the whole string, otherwise 0.
+ */
+int regen_match(regen_matcher * matcher, const char * string, size_t length) {
+    return matcher_match(&matcher->m, string, length);
+}
+
+void regen_matcher_free(regen_matcher * matcher) {
+    if (matcher) {
+        matcher_free(&matcher->m);
+        automaton_free(&matcher->a);
+        free(matcher);
+    }
+}
+
+//Releases the node counts of stats filled in by regen_write_lines.
+void regen_stats_free(struct regen_stats * stats) {
+    free(stats->nodes);
+    stats->nodes = NULL;
+    stats->nnodes = 0;
+}
+
+/*
+ @param path the cache file to write.
+ @param patterns, sources, tags count compiled patterns, the text each was compiled from, and a number for each.
+ @param flags kept in the file, for regen_cache_flags.
+ @return REGEN_OK, REGEN_EIO if the file could not be written, or REGEN_EINVAL if a pattern came from
+ regen_compile_uniform, regen_compile_enumerate or regen_compile_bounded.
+
+ The file holds the compiled patterns as they are in memory, so regen_cache_open can use them without compiling.
+ */
+int regen_cache_write(const char * path, const regen_pattern * const * patterns, const char * const * sources,
+                      const unsigned long * tags, size_t count, unsigned long flags) {
+    size_t i = 0;
+    for (; i < count; i++) {
+        if (patterns[i]->prog == NULL) {
+            return REGEN_EINVAL;
+        }
+    }
+    const struct program ** programs = (const struct program **)malloc((count ? count : 1) * sizeof(struct program *));
+    if (programs == NULL) { printf("malloc failure.\n"); exit(1); }
+    for (i = 0; i < count; i++) {
+        programs[i] = patterns[i]->prog;
+    }
+    int result = cache_write(path, programs, sources, tags, count, flags);
+    free(programs);
+    return result == 0 ? REGEN_OK : REGEN_EIO;
+}
+
+/*
+ @param cache where the opened cache is stored on success.  Release it with regen_cache_close.
+ @return REGEN_OK, REGEN_EIO if the file can't be read, or REGEN_EFORMAT if it isn't a usable cache file.
+
+ The file is mapped, not read, and its patterns are used in place.  They belong to the cache: they stay valid until it
+ is closed and must not be passed to regen_pattern_free.
+ */
+int regen_cache_open(regen_cache ** cache, const char * path) {
+    regen_cache * opened = (regen_cache *)malloc(sizeof(regen_cache));
+    unsigned long i = 0;
+    if (opened == NULL) { printf("malloc failure.\n"); exit(1); }
+    int result = cache_open(&opened->c, path);
+    if (result != CACHE_OK) {
+        free(opened);
+        return result == CACHE_EIO ? REGEN_EIO : REGEN_EFORMAT;
+    }
+    opened->patterns = (regen_pattern *)malloc((opened->c.count ? opened->c.count : 1) * sizeof(regen_pattern));
+    if (opened->patterns == NULL) { printf("malloc failure.\n"); exit(1); }
+    for (; i < opened->c.count; i++) {
+        opened->patterns[i].prog = &opened->c.programs[i];
+        opened->patterns[i].uniform = NULL;
+        opened->patterns[i].enumeration = NULL;
+        opened->patterns[i].window = NULL;
+        opened->patterns[i].id = 0;
+        memset(&opened->patterns[i].parse, 0, sizeof(struct phase));
+        memset(&opened->patterns[i].compile, 0, sizeof(struct phase));
+    }
+    *cache = opened;
+    return REGEN_OK;
+}
+
+size_t regen_cache_count(const regen_cache * cache) {
+    return cache->c.count;
+}
+
+unsigned long regen_cache_flags(const regen_cache * cache) {
+    return (unsigned long)cache->c.flags;
+}
+
+const regen_pattern * regen_cache_pattern(const regen_cache * cache, size_t i) {
+    return &cache->patterns[i];
+}
+
+//The pattern that entry i was compiled from.
+const char * regen_cache_source(const regen_cache * cache, size_t i) {
+    return (const char *)cache->c.map + cache->c.entries[i].source;
+}
+
+unsigned long regen_cache_tag(const regen_cache * cache, size_t i) {
+    return (unsigned long)cache->c.entries[i].tag;
+}
+
+void regen_cache_close(regen_cache * cache) {
+    if (cache) {
+        cache_close(&cache->c);
+        free(cache->patterns);
+        free(cache);
+    }
+}
+
+/*
+ @return a seed from the system's entropy pool, different on every call.
+ */
+uint64_t regen_entropy_seed(void) {
+    return entropy_seed();
+}
+
+/*
+ @return a new seed for stream number stream of seed, for runs that need a whole seed of their own for each of
+ several parts (such as a pattern of a batch) rather than one stream.
+ */
+uint64_t regen_stream_seed(uint64_t seed, uint64_t stream) {
+    struct rng g;
+    rng_seed_stream(&g, seed, stream);
+    return rng_next(&g);
+}
+
+const char * regen_strerror(int status) {
+    switch (status) {
+        case REGEN_OK:
+            return "Success.";
+        case REGEN_ESYNTAX:
+            return "Invalid regular expression.";
+        case REGEN_EINVAL:
+            return "Invalid argument.";
+        case REGEN_ENOSPC:
+            return "Buffer too small.";
+        case REGEN_EIO:
+            return "Could not read or write the file.";
+        case REGEN_EFORMAT:
+            return "Not a cache file from this version of regen and this kind of machine, or a damaged one.";
+        case REGEN_ENOMATCH:
+            return "The pattern matches no string of that length.";
+        case REGEN_ELIMIT:
+            return "The pattern, or the length, is too large to count the strings it matches.";
+        case REGEN_EINFINITE:
+            return "The pattern matches strings of any length; give a longest length to list them.";
+        case REGEN_EDONE:
+            return "Every string has been listed.";
+        case REGEN_EEXHAUSTED:
+            return "The pattern made no more new strings.";
+        case REGEN_EBUDGET:
+            return "The string went over its budget.";
+        default:
+            return "Unknown error.";
+    }
+}
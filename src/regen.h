@@ -0,0 +1,200 @@
+//
+//  regen.h
+//  regen
+//  The public interface of libregen: compile a pattern once, then generate strings from it on any number of threads.
+//
+
+#ifndef regen_h
+#define regen_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ A compiled pattern is read-only once regen_compile returns, so any number of threads can generate from the same one
+ at once without locking.  Everything that changes while generating (the random number generator, the options and
+ the output buffer) lives in a regen_state, which belongs to one thread at a time.  A regen_matcher, which checks
+ strings against a pattern, learns as it goes, so it too belongs to one thread at a time; regen_write_lines only
+ reads the one it is given, and may be called from several threads with the same one.
+
+ Functions that can fail return one of the status codes below; none of them print anything or end the program.
+ Running out of memory is the exception: as everywhere else in regen, it prints a message and exits.
+ */
+
+enum regen_status {
+    REGEN_OK = 0,
+    REGEN_ESYNTAX,   //The pattern is not a valid regex.  The regen_error says where and why.
+    REGEN_EINVAL,    //An argument is out of range.
+    REGEN_ENOSPC,    //The buffer is too small for the string.
+    REGEN_EIO,       //A file could not be read or written.
+    REGEN_EFORMAT,   //A cache file is damaged, or was written by another version of regen or another kind of machine.
+    REGEN_ENOMATCH,  //The pattern matches no string of the lengths asked for.
+    REGEN_ELIMIT,    //The pattern's automaton, or its tables, would be too big.
+    REGEN_EINFINITE, //The pattern matches strings of every length, so they can't all be listed without a longest length.
+    REGEN_EDONE,     //Every string of an enumerated pattern has been generated.
+    REGEN_EEXHAUSTED, //A unique run found no more new strings before it had written all the lines asked for.
+    REGEN_EBUDGET    //The string went over its budget, and was given up on.
+};
+
+//regen_cache_write flags, for the caller's own use.  The command line tool marks caches built from --patterns.
+#define REGEN_CACHE_BATCH 1
+
+//Orders for regen_compile_enumerate: shortest strings first, or plain byte order.
+#define REGEN_ORDER_LENGTH 0
+#define REGEN_ORDER_LEX 1
+
+//What happens to a string that goes over its budget: it is cut short, generated again (up to 16 tries in all, then
+//given up on), or given up on.
+#define REGEN_BUDGET_TRUNCATE 0
+#define REGEN_BUDGET_RESAMPLE 1
+#define REGEN_BUDGET_FAIL 2
+
+//The seed used when none is given and the run should repeat exactly (-d).
+#ifndef REGEN_DEFAULT_SEED
+#define REGEN_DEFAULT_SEED 1
+#endif
+
+#ifndef REGEN_MAX_THREADS
+#define REGEN_MAX_THREADS 256
+#endif
+
+//A unique run (regen_lines.unique) ends once this many lines in a row have all been repeats.
+#ifndef REGEN_UNIQUE_MAX_REPEATS
+#define REGEN_UNIQUE_MAX_REPEATS (1 << 20)
+#endif
+
+//Buckets of regen_stats.lengths: bucket 0 counts empty lines, and bucket i lines of 2^(i-1) to 2^i - 1 characters.
+//The last bucket also counts every longer line.
+#ifndef REGEN_STATS_BUCKETS
+#define REGEN_STATS_BUCKETS 32
+#endif
+
+#ifndef REGEN_MESSAGE_SIZE
+#define REGEN_MESSAGE_SIZE 256
+#endif
+
+struct regen_error {
+    int status;
+    long position;                      //Index into the pattern of the syntax error, or -1.
+    char message[REGEN_MESSAGE_SIZE];
+};
+
+typedef struct regen_pattern regen_pattern;
+typedef struct regen_state regen_state;
+typedef struct regen_cache regen_cache;
+typedef struct regen_matcher regen_matcher;
+
+//How often strings went over their budget.
+struct regen_budget_counts {
+    unsigned long truncated;  //Strings cut short.
+    unsigned long resampled;  //Strings thrown away and generated again.
+    unsigned long failed;     //Strings given up on.  regen_write_lines leaves their lines out.
+};
+
+//Lines of a run that did not match the pattern, found by checking them (regen_lines.verify).
+struct regen_mismatches {
+    unsigned long count;
+    unsigned long first;                //Index in the run of the first line that did not match.
+    char line[REGEN_MESSAGE_SIZE];      //The start of that line, NUL-terminated.
+};
+
+//Time spent in one phase of a run, in seconds.  cpu is added up over every thread that took part.
+struct regen_phase {
+    double wall;
+    double cpu;
+};
+
+//How often one instruction of a pattern's program ran, and for how long.
+struct regen_node_stats {
+    long position;              //Index into the pattern of the part the instruction was compiled from, or -1.
+    unsigned long instruction;  //Index of the instruction in the program.
+    const char * op;            //Its name, such as "OP_LOOP".
+    unsigned long visits;
+    double seconds;
+};
+
+/*
+ Where the time of a run went.  The phases and the lines are always filled in.  The rest is counted only by a
+ libregen built with REGEN_STATS defined (make stats), which says so in counted; the counters are not compiled into
+ other builds at all.
+ */
+struct regen_stats {
+    struct regen_phase parse;     //Parsing the pattern, when it was compiled (not loaded from a cache).
+    struct regen_phase compile;   //Optimizing and compiling it, or building its tables.
+    struct regen_phase generate;  //Generating the lines.  wall is added up over threads too.
+    struct regen_phase write;     //Writing them out.
+    double wall;                  //The whole of regen_write_lines.
+    unsigned long lines;          //Lines written.
+    uint64_t bytes;               //Bytes written, newlines included.
+    unsigned long lengths[REGEN_STATS_BUCKETS];
+    int counted;                  //Whether the counts below were taken.
+    unsigned long allocs;         //Allocations libregen made, in this process so far.
+    unsigned long reallocs;       //Times it grew an allocation.
+    size_t nnodes;
+    struct regen_node_stats * nodes;  //Every instruction that ran.  Release them with regen_stats_free.
+};
+
+//Everything regen_write_lines needs to know about a run; the same settings as the command line options.
+struct regen_lines {
+    double p;             //Probability that * and + repeat once more (-p).
+    uint64_t seed;        //-s
+    unsigned long start;  //Index of the first line (--start).
+    unsigned long count;  //Number of lines (-l).
+    int threads;          //-j
+    int ordered;          //0 for --unordered.
+    int preallocate;      //Give a regular file its space up front, from the size the first lines suggest, and cut
+                          //it back to the lines written at the end (-f).  Pipes and terminals are written as usual.
+    int unique;           //-u: write only lines not written before.
+    double false_positive;  //With unique, 0 to remember lines exactly, or the false positive rate of a Bloom filter.
+    uint64_t space;       //With unique, how many different lines the pattern can make (see regen_enumerate_count), or 0.
+    size_t max_bytes;     //Most characters in a line, or 0 for no limit (--max-bytes).
+    unsigned long max_steps;  //Most passes through the pattern's repeats for one line, or 0 for no limit (--max-steps).
+    int budget_policy;    //REGEN_BUDGET_TRUNCATE, REGEN_BUDGET_RESAMPLE or REGEN_BUDGET_FAIL
+    struct regen_budget_counts * counts;  //If not NULL, set to how often lines went over their budget.
+    struct regen_stats * stats;  //If not NULL, set to where the run's time went.
+    const regen_matcher * verify;  //If not NULL, every line is checked against it as it is generated (--verify).
+    struct regen_mismatches * mismatches;  //With verify, set to the lines that did not match.
+};
+
+int regen_compile(regen_pattern ** pattern, const char * regex, size_t length, struct regen_error * error);
+int regen_compile_uniform(regen_pattern ** pattern, const char * regex, size_t length, unsigned long min,
+                          unsigned long max, struct regen_error * error);
+int regen_compile_bounded(regen_pattern ** pattern, const char * regex, size_t length, unsigned long min,
+                          unsigned long max, struct regen_error * error);
+int regen_compile_enumerate(regen_pattern ** pattern, const char * regex, size_t length, long max, int order,
+                            struct regen_error * error);
+uint64_t regen_enumerate_count(const regen_pattern * pattern);
+void regen_pattern_free(regen_pattern * pattern);
+
+int regen_state_create(regen_state ** state, double p, uint64_t seed);
+void regen_state_seed(regen_state * state, uint64_t seed, uint64_t stream);
+int regen_state_budget(regen_state * state, size_t max_bytes, unsigned long max_steps, int policy);
+void regen_state_counts(const regen_state * state, struct regen_budget_counts * counts);
+void regen_state_free(regen_state * state);
+
+int regen_generate_into(const regen_pattern * pattern, regen_state * state, char * buffer, size_t size,
+                        size_t * length);
+const char * regen_generate(const regen_pattern * pattern, regen_state * state, size_t * length);
+int regen_write_lines(const regen_pattern * pattern, const struct regen_lines * lines, int fd,
+                      unsigned long * written);
+void regen_stats_free(struct regen_stats * stats);
+
+int regen_matcher_create(regen_matcher ** matcher, const char * regex, size_t length, struct regen_error * error);
+int regen_match(regen_matcher * matcher, const char * string, size_t length);
+void regen_matcher_free(regen_matcher * matcher);
+
+int regen_cache_write(const char * path, const regen_pattern * const * patterns, const char * const * sources,
+                      const unsigned long * tags, size_t count, unsigned long flags);
+int regen_cache_open(regen_cache ** cache, const char * path);
+size_t regen_cache_count(const regen_cache * cache);
+unsigned long regen_cache_flags(const regen_cache * cache);
+const regen_pattern * regen_cache_pattern(const regen_cache * cache, size_t i);
+const char * regen_cache_source(const regen_cache * cache, size_t i);
+unsigned long regen_cache_tag(const regen_cache * cache, size_t i);
+void regen_cache_close(regen_cache * cache);
+
+uint64_t regen_entropy_seed(void);
+uint64_t regen_stream_seed(uint64_t seed, uint64_t stream);
+const char * regen_strerror(int status);
+
+#endif /* regen_h */
@@ -0,0 +1,118 @@
+//
+//  rng.c
+//  regen
+//  Random number generation.  Every generator carries its own state, so nothing is shared between callers.
+//
+
+#include "rng.h"
+#include <sys/random.h>
+#include <math.h>
+
+/*
+ libc's rand() keeps one 31 bit state for the whole process behind a lock, and rand() % n favors small values.
+ The generators here are a few shifts and multiplies on state owned by the caller, and bounded values use
+ Lemire's multiply-shift method with rejection, which is unbiased and almost never needs a second draw.
+ */
+
+/*
+ SplitMix64, used to spread a single 64 bit seed over the generator's whole state.
+ */
+static uint64_t splitmix64(uint64_t * x) {
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+#ifdef REGEN_RNG_PCG64
+
+void rng_seed(struct rng * g, uint64_t seed) {
+    uint64_t x = seed;
+    //One call per statement, so the order of the draws is fixed.
+    uint64_t a = splitmix64(&x);
+    uint64_t b = splitmix64(&x);
+    uint64_t c = splitmix64(&x);
+    uint64_t d = splitmix64(&x);
+    g->state = ((unsigned __int128)a << 64) | b;
+    g->inc = (((unsigned __int128)c << 64) | d) | 1;
+}
+
+#else
+
+void rng_seed(struct rng * g, uint64_t seed) {
+    uint64_t x = seed;
+    g->s[0] = splitmix64(&x);
+    g->s[1] = splitmix64(&x);
+    g->s[2] = splitmix64(&x);
+    g->s[3] = splitmix64(&x);
+}
+
+#endif
+
+/*
+ Seeds g with one of many independent streams derived from seed.  Streams with different numbers start from
+ unrelated points, so they can be handed to different threads (or lines) without overlapping in practice.  Any
+ stream can be reached directly; nothing before it has to be generated.
+ */
+void rng_seed_stream(struct rng * g, uint64_t seed, uint64_t stream) {
+    uint64_t x = stream;
+    rng_seed(g, seed ^ splitmix64(&x));
+}
+
+/*
+ Returns a uniformly distributed value in [0, n).  n must be greater than zero.
+ */
+uint64_t rng_bounded(struct rng * g, uint64_t n) {
+    unsigned __int128 m = (unsigned __int128)rng_next(g) * n;
+    uint64_t low = (uint64_t)m;
+    if (low < n) {
+        uint64_t threshold = -n % n;
+        while (low < threshold) {
+            m = (unsigned __int128)rng_next(g) * n;
+            low = (uint64_t)m;
+        }
+    }
+    return (uint64_t)(m >> 64);
+}
+
+/*
+ A seed from the kernel's entropy pool.  getrandom() doesn't block once the pool has been initialized, which is
+ always the case by the time a user can run regen.  If it fails anyway, the time and process id are used.
+ */
+uint64_t entropy_seed() {
+    uint64_t seed;
+    if (getrandom(&seed, sizeof(seed), 0) == sizeof(seed)) {
+        return seed;
+    }
+    return ((uint64_t)time(NULL) << 32) ^ (uint64_t)getpid();
+}
+
+/*
+ Generates a random value in [0, 1)
+ */
+double random_float(struct rng * g) {
+    return (rng_next(g) >> 11) * 0x1.0p-53;
+}
+
+/*
+ Returns a random value between low and high, inclusive to the lowwer bound but exclusive to the upper.
+ */
+unsigned long random_in(struct rng * g, unsigned long low, unsigned long high) {
+    return rng_bounded(g, high - low) + low;
+}
+
+/*
+ @param logp the natural log of p, the probability of repeating once more.  Passed as a log so callers can compute it
+ once for many draws.
+ @return the number of times a loop that repeats with probability p repeats, P(k) = p^k (1 - p), from a single draw.
+
+ Inverting the distribution's CDF gives floor(log(u) / log(p)) for u uniform in (0, 1].  This is the same
+ distribution as drawing random_float() < p again and again until it fails, without the repeated draws.
+ */
+unsigned long random_geometric(struct rng * g, double logp) {
+    if (logp == -HUGE_VAL) { //p == 0
+        return 0;
+    }
+    double u = 1.0 - random_float(g);
+    return (unsigned long)floor(log(u) / logp);
+}
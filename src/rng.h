@@ -0,0 +1,76 @@
+//
+//  rng.h
+//  regen
+//
+//  Random number generation.  Every generator carries its own state, so nothing is shared between callers.
+//
+
+#include "global.h"
+
+#ifndef rng_h
+#define rng_h
+
+#include <stdint.h>
+
+/*
+ The generator is xoshiro256** unless regen is built with -DREGEN_RNG_PCG64, which swaps in PCG64 (DXSM output).
+ Both produce the same stream on every platform for a given seed.
+ */
+struct rng {
+#ifdef REGEN_RNG_PCG64
+    unsigned __int128 state;
+    unsigned __int128 inc;
+#else
+    uint64_t s[4];
+#endif
+};
+
+void rng_seed(struct rng * g, uint64_t seed);
+void rng_seed_stream(struct rng * g, uint64_t seed, uint64_t stream);
+uint64_t rng_bounded(struct rng * g, uint64_t n);
+uint64_t entropy_seed(void);
+double random_float(struct rng * g);
+unsigned long random_in(struct rng * g, unsigned long low, unsigned long high);
+unsigned long random_geometric(struct rng * g, double logp);
+
+/*
+ The next 64 random bits.  Defined here so it can be inlined into the loops that call it for every character.
+ */
+#ifdef REGEN_RNG_PCG64
+
+//PCG64 with the DXSM output function.
+static inline uint64_t rng_next(struct rng * g) {
+    const uint64_t mul = 0xDA942042E4DD58B5ULL;
+    unsigned __int128 old = g->state;
+    g->state = old * mul + g->inc;
+    uint64_t hi = (uint64_t)(old >> 64);
+    uint64_t lo = (uint64_t)old | 1;
+    hi ^= hi >> 32;
+    hi *= mul;
+    hi ^= hi >> 48;
+    return hi * lo;
+}
+
+#else
+
+static inline uint64_t rng_rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+//xoshiro256**
+static inline uint64_t rng_next(struct rng * g) {
+    uint64_t * s = g->s;
+    uint64_t result = rng_rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rng_rotl(s[3], 45);
+    return result;
+}
+
+#endif
+
+#endif /* rng_h */
@@ -0,0 +1,203 @@
+//
+//  shard.c
+//  regen
+//  Splits one run's lines over many files, each with a seed of its own, and lists them in a manifest.
+//
+
+#include "shard.h"
+#include <pthread.h>
+#include <fcntl.h>
+#include <errno.h>
+
+/*
+ --shards N writes the run's -l lines to N files instead of one, named by --shard-pattern, so they can be loaded in
+ parallel.  Each shard is a run of its own: shard k has count / N lines (one more for the first count % N shards), the
+ run's --start, and the seed regen_stream_seed(seed, k), so the shards don't share a stream and don't depend on each
+ other.  That makes any one of them
+
+     regen -s SEED --start START -l LINES [the run's other options] PATTERN
+
+ with the numbers from its line of the manifest.
+
+ Workers claim shards one at a time and write each with regen_write_lines, straight into its file, which is given its
+ space up front as -f is.  With more threads than shards, each shard is written by threads / N of them; since its
+ lines come out in order, a shard is the same however many threads wrote it.
+
+ The manifest has a line per shard, in order, once all of them are written:
+     shard   file   seed   start   lines   written   bytes
+ separated by tabs, after a header line starting with #.  written is lines less any left out over their budget
+ (--on-budget fail).
+ */
+
+struct shard_entry {
+    uint64_t seed;
+    unsigned long lines;
+    unsigned long written;
+    unsigned long long bytes;
+};
+
+struct shard_state {
+    const struct shard_job * job;
+    struct shard_entry * entries;
+    int threads;              //Threads writing each shard.
+
+    pthread_mutex_t lock;
+    unsigned long next;       //Next shard to be claimed by a worker.
+    struct regen_budget_counts counts;
+};
+
+/*
+ @return 1 if name has exactly one integer conversion (d, i, u, x, X or o, with flags, width and precision but no *)
+ and no other conversions besides %%, so it can be given a shard's number and nothing else.
+ */
+int shard_name_valid(const char * name) {
+    int conversions = 0;
+    for (; *name; name++) {
+        if (*name != '%') {
+            continue;
+        }
+        name++;
+        if (*name == '%') {
+            continue;
+        }
+        while (*name && strchr("-+ #0", *name)) {
+            name++;
+        }
+        while (*name >= '0' && *name <= '9') {
+            name++;
+        }
+        if (*name == '.') {
+            name++;
+            while (*name >= '0' && *name <= '9') {
+                name++;
+            }
+        }
+        if (!*name || !strchr("diuxXo", *name)) {
+            return 0;
+        }
+        conversions++;
+    }
+    return conversions == 1;
+}
+
+//Writes the file name of shard k to path.  The pattern has been checked by shard_name_valid.
+static void shard_path(const struct shard_job * job, unsigned long k, char * path, size_t size) {
+    int length = snprintf(path, size, job->name, (int)k);
+    if (length < 0 || (size_t)length >= size) {
+        printf("The name of shard %lu is too long.\n", k);
+        exit(2);
+    }
+}
+
+static void write_shard(struct shard_state * st, unsigned long k) {
+    const struct shard_job * job = st->job;
+    struct shard_entry * entry = &st->entries[k];
+    char path[4096];
+    shard_path(job, k, path, sizeof(path));
+    int fd = open(path, O_WRONLY | O_CREAT | (job->overwrite ? O_TRUNC : O_EXCL), 0666);
+    if (fd == -1) {
+        printf("Could not open \"%s\": %s.\n", path, strerror(errno));
+        exit(1);
+    }
+
+    struct regen_lines run = *job->run;
+    struct regen_budget_counts counts;
+    memset(&counts, 0, sizeof(counts));
+    entry->seed = regen_stream_seed(job->run->seed, k);
+    entry->lines = job->run->count / job->shards + (k < job->run->count % job->shards);
+    entry->written = 0;
+    run.seed = entry->seed;
+    run.count = entry->lines;
+    run.threads = st->threads;
+    run.preallocate = 1;
+    run.counts = &counts;
+    run.stats = NULL;
+    run.verify = NULL;
+    run.mismatches = NULL;
+    if (entry->lines > 0) {
+        regen_write_lines(job->pattern, &run, fd, &entry->written);
+    }
+    off_t end = lseek(fd, 0, SEEK_END);
+    entry->bytes = end < 0 ? 0 : (unsigned long long)end;
+    if (close(fd) != 0) {
+        printf("write failure.\n");
+        exit(1);
+    }
+    pthread_mutex_lock(&st->lock);
+    st->counts.truncated += counts.truncated;
+    st->counts.resampled += counts.resampled;
+    st->counts.failed += counts.failed;
+    pthread_mutex_unlock(&st->lock);
+}
+
+static void * shard_worker(void * arg) {
+    struct shard_state * st = (struct shard_state *)arg;
+    unsigned long k;
+    for (;;) {
+        pthread_mutex_lock(&st->lock);
+        k = st->next++;
+        pthread_mutex_unlock(&st->lock);
+        if (k >= st->job->shards) {
+            break;
+        }
+        write_shard(st, k);
+    }
+    return NULL;
+}
+
+/*
+ @param job describes the run: the pattern, its settings, how many shards and what they are called.
+ Exits if a shard can't be written, or exists already and job->overwrite isn't set; that is checked for every shard
+ before any of them is written.
+ */
+void run_shards(const struct shard_job * job) {
+    struct shard_state st;
+    char path[4096];
+    unsigned long k = 0;
+    int workers = job->run->threads < job->shards ? job->run->threads : (int)job->shards;
+
+    for (; !job->overwrite && k < job->shards; k++) {
+        shard_path(job, k, path, sizeof(path));
+        if (access(path, F_OK) != -1) {
+            printf("\"%s\" already exists.  Use -o to overwrite the shards.\n", path);
+            exit(2);
+        }
+    }
+    st.job = job;
+    st.entries = (struct shard_entry *)malloc(job->shards * sizeof(struct shard_entry));
+    if (st.entries == NULL) { printf("malloc failure.\n"); exit(1); }
+    st.threads = job->run->threads / workers;
+    st.next = 0;
+    memset(&st.counts, 0, sizeof(st.counts));
+    pthread_mutex_init(&st.lock, NULL);
+
+    if (workers <= 1) {
+        shard_worker(&st);
+    } else {
+        pthread_t * threads = (pthread_t *)malloc(workers * sizeof(pthread_t));
+        if (threads == NULL) { printf("malloc failure.\n"); exit(1); }
+        for (k = 0; k < workers; k++) {
+            if (pthread_create(&threads[k], NULL, shard_worker, &st)) {
+                printf("Could not start worker thread.\n");
+                exit(1);
+            }
+        }
+        for (k = 0; k < workers; k++) {
+            pthread_join(threads[k], NULL);
+        }
+        free(threads);
+    }
+
+    fprintf(job->manifest, "#shard\tfile\tseed\tstart\tlines\twritten\tbytes\n");
+    for (k = 0; k < job->shards; k++) {
+        const struct shard_entry * entry = &st.entries[k];
+        shard_path(job, k, path, sizeof(path));
+        fprintf(job->manifest, "%lu\t%s\t%llu\t%lu\t%lu\t%lu\t%llu\n", k, path, (unsigned long long)entry->seed,
+                job->run->start, entry->lines, entry->written, entry->bytes);
+    }
+    if (job->counts) {
+        *job->counts = st.counts;
+    }
+    free(st.entries);
+    pthread_mutex_destroy(&st.lock);
+}
@@ -0,0 +1,36 @@
+//
+//  shard.h
+//  regen
+//  Splits one run's lines over many files, each with a seed of its own, and lists them in a manifest.
+//
+
+#include "global.h"
+#include "regen.h"
+
+#ifndef shard_h
+#define shard_h
+
+struct shard_job {
+    const regen_pattern * pattern;
+    const struct regen_lines * run;  //The whole run: its seed, start, count and threads are shared out over the shards.
+    unsigned long shards;
+    const char * name;      //printf format of the shards' file names, with one integer conversion (--shard-pattern).
+    int overwrite;          //Replace shard files that already exist (-o).
+    FILE * manifest;        //Where the manifest is written.
+    struct regen_budget_counts * counts;  //Set to how often lines went over their budget, over every shard.
+};
+
+int shard_name_valid(const char * name);
+void run_shards(const struct shard_job * job);
+
+#endif /* shard_h */
+
+//Most shards in one run.
+#ifndef SHARD_MAX
+#define SHARD_MAX 1000000
+#endif
+
+//File names of the shards when --shard-pattern isn't given.
+#ifndef SHARD_PATTERN
+#define SHARD_PATTERN "out-%04d.txt"
+#endif
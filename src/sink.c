@@ -0,0 +1,133 @@
+//
+//  sink.c
+//  regen
+//  Where a run's lines go: a regular file given its space up front, or anything else as the lines come.
+//
+
+#define _GNU_SOURCE
+#include "sink.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+/*
+ A run of a billion lines into a file is tens of gigabytes, written a few hundred kilobytes at a time, so the file
+ system never learns how big the file will be and hands out its space piece by piece.  So when a run is written to a
+ regular file (-f), the first lines written say how long a line is on average, and the file is given room for that
+ many bytes per line times the lines of the run, with a little to spare, in one fallocate().  If the estimate turns
+ out short, the file is given another eighth, or another SINK_GROWTH bytes, whichever is more.  The lines still go out
+ in large write() and writev() calls, now into space that is already the file's, and when the run ends the file is
+ cut back to exactly the bytes written.
+
+ Writing through a sliding memory map of the file instead was slower: every page of a shared file mapping faults the
+ first time it is written, which costs more than the copy write() makes.
+
+ Anything else (a pipe, a terminal, or a file opened for appending, where the offset isn't the caller's to keep) gets
+ its lines as they come, as does a file on a file system without fallocate().
+ */
+
+//Gives the file room up to end.  @return 0, or -1 if the file system can't set space aside.
+static int extend(struct sink * s, uint64_t end) {
+#ifdef __linux__
+    if (fallocate(s->fd, FALLOC_FL_KEEP_SIZE, (off_t)s->reserved, (off_t)(end - s->reserved)) == 0) {
+        s->reserved = end;
+        return 0;
+    }
+    if (errno != EOPNOTSUPP && errno != ENOSYS) {
+        printf("write failure.\n");
+        exit(1);
+    }
+#endif
+    return -1;
+}
+
+/*
+ Makes sure the file has room for length more bytes.  The first time, the whole run's size is estimated from sample,
+ the first samplelength bytes of them.
+ */
+static void reserve(struct sink * s, size_t length, const char * sample, size_t samplelength) {
+    uint64_t end = s->start + s->written + length;
+    if (end <= s->reserved) {
+        return;
+    }
+    uint64_t size = 0;
+    if (s->written == 0) {
+        unsigned long lines = 0;
+        const char * at = sample;
+        const char * stop = sample + samplelength;
+        while ((at = (const char *)memchr(at, '\n', stop - at)) != NULL) {
+            lines++;
+            at++;
+        }
+        if (lines > 0 && lines < s->lines) {
+            double estimate = (double)samplelength / lines * s->lines;
+            size = (uint64_t)(estimate + estimate / 64);
+        }
+    } else {
+        size = s->reserved - s->start;
+        size += size / 8 > SINK_GROWTH ? size / 8 : SINK_GROWTH;
+    }
+    if (s->start + size < end) {
+        size = end - s->start;
+    }
+    if (extend(s, s->start + size) < 0) {
+        s->reserving = 0;
+    }
+}
+
+/*
+ @param reserve whether a regular file should be given its space ahead of the lines.  It is written from its offset.
+ @param lines how many lines the run is to write.
+ */
+void sink_init(struct sink * s, int fd, int reserve, unsigned long lines) {
+    struct stat info;
+    int flags = fcntl(fd, F_GETFL);
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+
+    s->fd = fd;
+    s->reserving = 0;
+    s->lines = lines;
+    s->start = 0;
+    s->reserved = 0;
+    s->written = 0;
+    if (!reserve || flags < 0 || (flags & O_APPEND) || offset < 0 || fstat(fd, &info) != 0
+        || !S_ISREG(info.st_mode)) {
+        return;
+    }
+    s->reserving = 1;
+    s->start = (uint64_t)offset;
+    s->reserved = s->start;
+}
+
+void sink_write(struct sink * s, const char * data, size_t length) {
+    if (s->reserving) {
+        reserve(s, length, data, length);
+    }
+    write_all(s->fd, data, length);
+    s->written += length;
+}
+
+//Writes count buffers, as writev_all does.  iov is modified as they are written.
+void sink_writev(struct sink * s, struct iovec * iov, int count) {
+    size_t length = 0;
+    int i = 0;
+    for (; i < count; i++) {
+        length += iov[i].iov_len;
+    }
+    if (s->reserving && count > 0) {
+        reserve(s, length, (const char *)iov[0].iov_base, iov[0].iov_len);
+    }
+    writev_all(s->fd, iov, count);
+    s->written += length;
+}
+
+/*
+ Gives back the space set aside past the last line.  Only a file that was given space is touched: one written as the
+ lines came may not be the sink's alone past its end.  The space may have been given before reserving was turned off.
+ */
+void sink_close(struct sink * s) {
+    if (s->reserved > s->start && s->reserved > s->start + s->written && ftruncate(s->fd, (off_t)(s->start + s->written)) != 0) {
+        printf("write failure.\n");
+        exit(1);
+    }
+}
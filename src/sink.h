@@ -0,0 +1,34 @@
+//
+//  sink.h
+//  regen
+//  Where a run's lines go: a regular file given its space up front, or anything else as the lines come.
+//
+
+#include "global.h"
+#include "strbuf.h"
+
+#ifndef sink_h
+#define sink_h
+
+#include <stdint.h>
+
+struct sink {
+    int fd;
+    int reserving;          //Whether the file is given space ahead of the lines (see sink.c).
+    unsigned long lines;    //Lines the run is to write, which the first estimate of its size is made from.
+    uint64_t start;         //Offset in the file the run began at.
+    uint64_t reserved;      //End of the space the file has been given so far.
+    uint64_t written;       //Bytes written since start.
+};
+
+void sink_init(struct sink * s, int fd, int reserve, unsigned long lines);
+void sink_write(struct sink * s, const char * data, size_t length);
+void sink_writev(struct sink * s, struct iovec * iov, int count);
+void sink_close(struct sink * s);
+
+#endif /* sink_h */
+
+//Least space given to a file at a time, once the first estimate of its size has run out.
+#ifndef SINK_GROWTH
+#define SINK_GROWTH (1 << 26)
+#endif
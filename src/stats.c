@@ -0,0 +1,113 @@
+//
+//  stats.c
+//  regen
+//  Timers for the phases of a run, and the counters of a stats build (make stats).
+//
+
+#include "stats.h"
+#include "compile.h"
+
+#ifdef REGEN_STATS
+unsigned long stats_allocs = 0;
+unsigned long stats_reallocs = 0;
+__thread struct vm_stats * vm_counters = NULL;
+#endif
+
+static uint64_t nanoseconds(clockid_t clock) {
+    struct timespec t;
+    clock_gettime(clock, &t);
+    return (uint64_t)t.tv_sec * 1000000000 + (uint64_t)t.tv_nsec;
+}
+
+void stats_start(struct moment * m) {
+    m->wall = nanoseconds(CLOCK_MONOTONIC);
+    m->cpu = nanoseconds(CLOCK_THREAD_CPUTIME_ID);
+}
+
+/*
+ Adds the time since m was started to phase.  Must be called on the thread that started m.
+ */
+void stats_stop(const struct moment * m, struct phase * phase) {
+    __sync_fetch_and_add(&phase->cpu, nanoseconds(CLOCK_THREAD_CPUTIME_ID) - m->cpu);
+    __sync_fetch_and_add(&phase->wall, nanoseconds(CLOCK_MONOTONIC) - m->wall);
+}
+
+/*
+ @return the name of an instruction (see compile.h), as it is written there.
+ */
+const char * opcode_name(int op) {
+    static const char * names[OP_COUNT] = {
+        "OP_HALT", "OP_CLASS", "OP_CLASS_UNCHECKED", "OP_LIT", "OP_LIT_UNCHECKED", "OP_RESERVE", "OP_STAR", "OP_PLUS",
+        "OP_QUEST", "OP_REPEAT", "OP_BETWEEN", "OP_LOOP", "OP_RUN", "OP_OR", "OP_WOR", "OP_JMP"
+    };
+    return op >= 0 && op < OP_COUNT ? names[op] : "?";
+}
+
+void vm_stats_init(struct vm_stats * s, const int * code, unsigned long length) {
+    s->code = code;
+    s->length = length;
+    s->visits = (unsigned long *)calloc(length ? length : 1, sizeof(unsigned long));
+    s->nanos = (uint64_t *)calloc(length ? length : 1, sizeof(uint64_t));
+    if (s->visits == NULL || s->nanos == NULL) { printf("calloc failure.\n"); exit(1); }
+    s->last = -1;
+    s->since = 0;
+}
+
+//Adds the counts of from, which counted the same program, to those of to.
+void vm_stats_add(struct vm_stats * to, const struct vm_stats * from) {
+    unsigned long i = 0;
+    for (; i < to->length; i++) {
+        to->visits[i] += from->visits[i];
+        to->nanos[i] += from->nanos[i];
+    }
+}
+
+void vm_stats_free(struct vm_stats * s) {
+    free(s->visits);
+    free(s->nanos);
+    s->visits = NULL;
+    s->nanos = NULL;
+}
+
+/*
+ Counts the lines of data, which ends with a newline, and their lengths.
+ */
+void count_lines(struct run_stats * s, const char * data, size_t length) {
+    const char * end = data + length;
+    while (data < end) {
+        size_t line = (const char *)memchr(data, '\n', end - data) - data;
+        int bucket = 0;
+        while (bucket < REGEN_STATS_BUCKETS - 1 && line >> bucket) {
+            bucket++;
+        }
+        s->lengths[bucket]++;
+        s->lines++;
+        s->bytes += line + 1;
+        data += line + 1;
+    }
+}
+
+#ifdef REGEN_STATS
+
+/*
+ Counts a visit to the instruction at index at, and charges the instruction before it with the time since it started.
+ */
+void stats_visit(struct vm_stats * s, long at) {
+    uint64_t now = nanoseconds(CLOCK_MONOTONIC);
+    if (s->last >= 0) {
+        s->nanos[s->last] += now - s->since;
+    }
+    s->visits[at]++;
+    s->last = at;
+    s->since = now;
+}
+
+//Charges the last instruction of a string with its time; nothing runs until the next string starts.
+void stats_halt(struct vm_stats * s) {
+    if (s->last >= 0) {
+        s->nanos[s->last] += nanoseconds(CLOCK_MONOTONIC) - s->since;
+    }
+    s->last = -1;
+}
+
+#endif
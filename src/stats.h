@@ -0,0 +1,100 @@
+//
+//  stats.h
+//  regen
+//  Timers for the phases of a run, and the counters of a stats build (make stats).
+//
+
+#include "global.h"
+#include "regen.h"
+
+#ifndef stats_h
+#define stats_h
+
+#include <stdint.h>
+
+/*
+ Phase timers are always there, and cost two clock reads at each end of a phase; they only run when stats are asked
+ for.  Everything finer than that (allocations, and how often and how long each instruction of a program runs) is
+ counted only when regen is built with REGEN_STATS defined.  Otherwise the macros below are empty and the counters
+ are not compiled in at all, so an ordinary build pays nothing for them.
+ */
+
+//Time spent in a phase, in nanoseconds.  Added to atomically, so threads can share one.
+struct phase {
+    uint64_t wall;
+    uint64_t cpu;   //of the threads that ran it
+};
+
+//When a phase was started.
+struct moment {
+    uint64_t wall;
+    uint64_t cpu;
+};
+
+void stats_start(struct moment * m);
+void stats_stop(const struct moment * m, struct phase * phase);
+const char * opcode_name(int op);
+
+/*
+ How often each instruction of one program ran, and for how long, on one thread.  The time of an instruction runs
+ from when it is dispatched to when the next one is, so the time spent in OP_RUN's fill is OP_RUN's.
+ */
+struct vm_stats {
+    const int * code;         //The program counted.  Other programs run on the thread are not.
+    unsigned long length;     //of code
+    unsigned long * visits;   //Indexed by the instruction's place in code.
+    uint64_t * nanos;
+    long last;                //The instruction running, or -1 between strings.
+    uint64_t since;           //When it started.
+};
+
+void vm_stats_init(struct vm_stats * s, const int * code, unsigned long length);
+void vm_stats_add(struct vm_stats * to, const struct vm_stats * from);
+void vm_stats_free(struct vm_stats * s);
+
+//What a run of many lines adds up.
+struct run_stats {
+    struct phase generate;
+    struct phase write;
+    unsigned long lines;
+    uint64_t bytes;
+    unsigned long lengths[REGEN_STATS_BUCKETS];
+    struct vm_stats vm;       //Stats builds only: the counts of every thread that ran the program, added up.
+};
+
+void count_lines(struct run_stats * s, const char * data, size_t length);
+
+#ifdef REGEN_STATS
+
+extern unsigned long stats_allocs;
+extern unsigned long stats_reallocs;
+
+//The counters of the program being run on this thread, or NULL.
+extern __thread struct vm_stats * vm_counters;
+
+void stats_visit(struct vm_stats * s, long at);
+void stats_halt(struct vm_stats * s);
+
+#define STATS_ALLOC() __sync_fetch_and_add(&stats_allocs, 1)
+#define STATS_REALLOC() __sync_fetch_and_add(&stats_reallocs, 1)
+#define STATS_VISIT(start, pc) \
+    if (vm_counters && vm_counters->code == (start)) { \
+        stats_visit(vm_counters, (pc) - (start)); \
+    }
+#define STATS_HALT(start) \
+    if (vm_counters && vm_counters->code == (start)) { \
+        stats_halt(vm_counters); \
+    }
+#define STATS_COUNTED 1
+
+#else
+
+#define STATS_ALLOC()
+#define STATS_REALLOC()
+#define STATS_VISIT(start, pc)
+#define STATS_HALT(start)
+#define STATS_COUNTED 0
+
+#endif
+
+#endif /* stats_h */
@@ -0,0 +1,77 @@
+//
+//  strbuf.c
+//  regen
+//  A growable character buffer owned by the caller, reused from one string to the next.
+//
+
+#include "strbuf.h"
+#include "stats.h"
+#include <errno.h>
+
+/*
+ Makes sure there is room for n more characters after the ones in use, doubling the buffer as needed.
+ @return a pointer to the first free character.  The caller writes there and then adds to buf->length.
+ */
+char * strbuf_reserve(struct strbuf * buf, size_t n) {
+    if (buf->length + n > buf->size) {
+        size_t size = buf->size ? buf->size : STARTING_STRBUF_SIZE;
+        while (buf->length + n > size) {
+            size *= 2;
+        }
+        STATS_REALLOC();
+        buf->data = (char *)realloc(buf->data, size);
+        if (buf->data == NULL) { printf("realloc failure.\n"); exit(1); }
+        buf->size = size;
+    }
+    return buf->data + buf->length;
+}
+
+void strbuf_free(struct strbuf * buf) {
+    free(buf->data);
+    buf->data = NULL;
+    buf->length = 0;
+    buf->size = 0;
+}
+
+/*
+ Writes all of data to fd, retrying after short writes and interruptions.  Any other failure ends the program.
+ */
+void write_all(int fd, const char * data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("write failure.\n");
+            exit(1);
+        }
+        data += written;
+        length -= written;
+    }
+}
+
+/*
+ Writes count buffers to fd with as few system calls as possible.  iov is modified as the buffers are written.
+ */
+void writev_all(int fd, struct iovec * iov, int count) {
+    while (count > 0) {
+        ssize_t written = writev(fd, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("write failure.\n");
+            exit(1);
+        }
+        while (count > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+}
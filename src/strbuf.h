@@ -0,0 +1,35 @@
+//
+//  strbuf.h
+//  regen
+//
+//  A growable character buffer owned by the caller, reused from one string to the next.
+//
+
+#include "global.h"
+
+#ifndef strbuf_h
+#define strbuf_h
+
+#include <sys/uio.h>
+
+struct strbuf {
+    char * data;
+    size_t length;  //Characters in use.
+    size_t size;    //Characters allocated.
+};
+
+char * strbuf_reserve(struct strbuf * buf, size_t n);
+void strbuf_free(struct strbuf * buf);
+void write_all(int fd, const char * data, size_t length);
+void writev_all(int fd, struct iovec * iov, int count);
+
+#endif /* strbuf_h */
+
+#ifndef STARTING_STRBUF_SIZE
+#define STARTING_STRBUF_SIZE 4096
+#endif
+
+//The most buffers one writev() takes.  POSIX guarantees at least 16; Linux allows 1024.
+#ifndef IOV_MAX
+#define IOV_MAX 16
+#endif
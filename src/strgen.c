@@ -7,190 +7,355 @@
 //
 
 #include "strgen.h"
-
-float continue_value = .90;
+#include "stats.h"
+#include <math.h>
+#include <limits.h>
+#include <stdint.h>
 
 /*
- The functions in this file work together to create a string that matches the input regex.  The regex is represented
- as a parse tree where nodes in the tree ("tokens") represent either a charater class (one or more characters) or
- an operator on the subtree, which could consist of character classes or other operators.
- 
- The goal is to create a string, and to that end, the wrapper function generate_string prepares an initial array
- and sets up variables relating to its length and the next spot avaliable in the string.  A pointer to this string
- is passed back once a function is done working with it.
- 
- Characters are only added to the string through the charclass0 function; other operators simply specify which character
- classes get to add their characters then.
- 
+ The functions in this file create a string that matches the input regex.  The regex arrives as a program compiled
+ from the parse tree by compile_tree (see compile.h for the instruction set), and generate_into runs that program
+ from the first instruction to OP_HALT.
+
+ The string is appended to a buffer owned by the caller, and generate_into keeps track of the next spot avaliable in
+ it.  Characters are only added to the string by OP_CLASS and OP_LIT (and OP_RUN, a loop over OP_CLASS); the other
+ instructions only decide which of them get to add their characters, and how often.
+
  Because random values are used to generate the string, it's not possible to know exactly how big it'll be in the end.
- Thus, reallocation of the string in a vector-like fashion is required.
- 
- With the exception of the function generate_string, all functions have the same parameters and return values:
- @param subtree A pointer to the root of the subtree being parsed into the string
- @param string a pointer to the char array which holds the string the regex output is being written to
- @param next The next avaliable spot in the string
- @param arrlen The current length of the string array.  Will be increased as necessary.
- @return the pointer to the output string
- 
- The only function meant to be called by functions outside of this file is generate_string.
+ Thus, the buffer grows in a vector-like fashion when needed, and keeps its size for the next string.
+
+ Dispatch uses computed goto where the compiler supports it (one indirect jump per instruction, each with its own
+ branch history), and falls back to a switch statement otherwise.  In a stats build every dispatch is also counted,
+ and timed, for --stats.
+
+ A string can also be given a budget: a most number of characters, and a most number of passes through loops (each
+ character of an OP_RUN is a pass).  Neither costs the instructions that write characters anything.  The buffer's
+ usable size is cut down to the character budget, so going over it is found where the buffer would have grown; loop
+ passes are counted down where OP_LOOP goes back for another pass.  Other instructions run at most once per pass, so
+ the two together bound both the time and the memory one string can take.
+
+ A string that is to be truncated at the budget is written as far as the budget goes, even where a fixed length part
+ (an OP_RESERVE, or a loop making room up front) would go over it all at once: room is made up to the budget instead,
+ and from then on the unchecked instructions are dispatched to their checked versions, which stop at the budget.
  */
 
+#if defined(__GNUC__) && !defined(REGEN_NO_COMPUTED_GOTO)
+#define DISPATCH() STATS_VISIT(code, pc) goto *table[*pc]
+#define CASE(op) L_##op
+#else
+#define DISPATCH() STATS_VISIT(code, pc) continue
+#define CASE(op) case op
+#endif
+
 /*
- * Instruction code 0: element is a character class.  Select one element from the character class.
- * Instruction code 1: execute all elements in sequence.  Can be thought of as () as well.
- * Instruction code 2: *  Repeat everything in element until random stop point
- * Instruction code 3: +  Add one, then repeat until random stop point.
- * Instruction code 4: ?  50/50 shot of it being there.
- * Instruction code 5: {n} Repeat n of times.
- * Instruction code 6: {n:m} Repeat at least n but no more than m times.
- * Instruction code 7: | select one of element, at random.  Similar to 0, but not necessarily a character class.
+ Makes room for n more characters, or does full if they would go over the string's character budget.
  */
+#define GROW_ELSE(n, full) \
+    if ((size_t)(n) > arrlen - next) { \
+        if ((size_t)(n) > limit - next) { \
+            full; \
+        } \
+        out->length = next; \
+        strbuf_reserve(out, (n)); \
+        string = out->data; \
+        arrlen = out->size < limit ? out->size : limit; \
+    }
+
+#define GROW(n) GROW_ELSE(n, goto over)
 
 /*
- @param tree A parse tree representing a regex
- @return A string that regex could match
- 
- generate_string is a wrapper for the other functions in this file; it sets up the calls to subsequent functions.
- In particular, it allocates the starting character array and sets up its length variable
+ Called where the string is sure to reach its budget.  Unless it is to be truncated there, it stops; otherwise room is
+ made for the rest of the budget, and the instructions that follow are all checked against it.
  */
-char * generate_string(struct token * tree, float pval) {
-    char * string = (char *)calloc(STARTING_OUTPUT_STRING_ARRAY_SIZE, sizeof(char));
-    unsigned long arrlen = STARTING_OUTPUT_STRING_ARRAY_SIZE;
-    unsigned long next = 0;
-    
-    //Set up the continue value for * and +, which is a global variable.
-    continue_value = pval;
-    
-    string = registry(tree, string, &next, &arrlen);
-    
-    //Terminate string
-    string[next] = '\0';
-    
-    return string;
-}
+#define CLIP() \
+    if (!truncate) { \
+        goto over; \
+    } \
+    out->length = next; \
+    strbuf_reserve(out, limit - next); \
+    string = out->data; \
+    arrlen = limit; \
+    table = checked;
 
 /*
- @param subtree A pointer to the root of the subtree being parsed
- @param string a pointer to the char array which holds the string the regex output is being written to
- @param next The next avaliable spot in the string
- @param arrlen The current length of the string array.  Will be increased as necessary.
- @return the pointer to the output string
- 
- Determines the appropriate function to call based on the operator code of the current root of the subtree.
- All calls to subtrees are rounted through registry.
+ Once a loop's count is known, the loop writes at least count times the shortest pass through its body, so that much
+ room is made at once instead of one doubling at a time.  If that is already over the budget, the string is clipped
+ there, unless the body is an OP_RUN, which writes as much of itself as the budget allows.
  */
-char * registry(struct token * subtree, char * string, unsigned long * next, unsigned long * arrlen) {
-    int * code = subtree->code;
-    if (code[0] == 0) {
-        string = charclass0(subtree, string, next, arrlen);
-    } else if (code[0] == 1) {
-        string = doinorder1(subtree, string, next, arrlen);
-    } else if (code[0] == 2) {
-        string = star3(subtree, string, next, arrlen);
-    } else if (code[0] == 3) {
-        string = plus2(subtree, string, next, arrlen);
-    } else if (code[0] == 4) {
-        string = questionmark4(subtree, string, next, arrlen);
-    } else if (code[0] == 5) {
-        string = exactlyn5(subtree, string, next, arrlen);
-    } else if (code[0] == 6) {
-        string = betweennm6(subtree, string, next, arrlen);
-    } else if (code[0] == 7) {
-        string = or7(subtree, string, next, arrlen);
+#define PRESIZE(least, body) \
+    if ((least) > 0 && *top * (least) > arrlen - next) { \
+        if (*top <= (limit - next) / (least)) { \
+            GROW(*top * (least)); \
+        } else if (*(body) != OP_RUN) { \
+            CLIP(); \
+        } \
     }
-    
-    return string;
-}
 
 /*
- Selects one element from the character class and adds it to the string. arrlen is increased as needed.
- 
- This is the only function which actually writes to the string.
- 
- The function assumes that the current value of "next" is the value to write to in the string.  It increments
- "next" afterword.
+ @param prog A program compiled from a parse tree representing a regex
+ @param pval The probability that * and + repeat their subtree one more time
+ @param rng The random number generator to draw from.  It belongs to the caller and is advanced by the call.
+ @param out The buffer the string is appended to.  It is not terminated; the caller adds whatever comes next.
+ @param bytes the most characters the string may have, or 0 for no limit.
+ @param steps the most passes through loops the string may take, or 0 for no limit.
+ @param truncate whether a string going over bytes is to be written up to it.  Otherwise it may stop short of it.
+ @return 0, or 1 if the string went over its budget.  What had been written by then is left in out.
+
+ Appending into a buffer the caller keeps from one string to the next means generating a string normally allocates
+ nothing at all.
  */
-char * charclass0(struct token * subtree, char * string, unsigned long * next, unsigned long * arrlen) {
-    if (*next == *arrlen - 2) {
-        *arrlen *= 2;
-        string = (char *)realloc(string, *arrlen * sizeof(char));
-        if (string == NULL) { printf("realloc failure.\n"); exit(1); }
+int generate_limited(const struct program * prog, float pval, struct rng * rng, struct strbuf * out, size_t bytes,
+                     unsigned long steps, int truncate) {
+    //Kept in locals so they can live in registers; written back to out before returning.
+    char * string = out->data;
+    size_t next = out->length;
+    size_t limit = bytes ? next + bytes : SIZE_MAX;  //One past the last character the budget allows.
+    size_t arrlen = out->size < limit ? out->size : limit;
+    int result = 0;
+    if (steps == 0) {
+        steps = ULONG_MAX;
     }
-    
-    //Select a single random character from the character class and add it to the string.
-    string[*next] = ((char *)(subtree->element))[random_in(0, subtree->length)];
-    *next = *next + 1;
-    return string;
-}
 
+    //Loop counters for {n} and {n:m}.  The compiler knows how deeply they nest.
+    unsigned long small[STARTING_LOOP_STACK_SIZE];
+    unsigned long * counters = small;
+    if (prog->depth > STARTING_LOOP_STACK_SIZE) {
+        counters = (unsigned long *)malloc(prog->depth * sizeof(unsigned long));
+        if (counters == NULL) { printf("malloc failure.\n"); exit(1); }
+    }
+    unsigned long * top = counters - 1;
+
+    const int * code = prog->code;
+    const int * pc = code;
+
+    //log(pval), worked out the first time a * or + needs it.
+    double logp = 1.0;
+
+#if defined(__GNUC__) && !defined(REGEN_NO_COMPUTED_GOTO)
+    static void * dispatch[OP_COUNT] = {
+        &&L_OP_HALT, &&L_OP_CLASS, &&L_OP_CLASS_UNCHECKED, &&L_OP_LIT, &&L_OP_LIT_UNCHECKED, &&L_OP_RESERVE,
+        &&L_OP_STAR, &&L_OP_PLUS, &&L_OP_QUEST, &&L_OP_REPEAT, &&L_OP_BETWEEN, &&L_OP_LOOP, &&L_OP_RUN, &&L_OP_OR,
+        &&L_OP_WOR, &&L_OP_JMP
+    };
+    //The same, with the unchecked instructions run checked, for a string clipped at its budget.
+    static void * checked[OP_COUNT] = {
+        &&L_OP_HALT, &&L_OP_CLASS, &&L_OP_CLASS, &&L_OP_LIT, &&L_OP_LIT, &&L_OP_RESERVE,
+        &&L_OP_STAR, &&L_OP_PLUS, &&L_OP_QUEST, &&L_OP_REPEAT, &&L_OP_BETWEEN, &&L_OP_LOOP, &&L_OP_RUN, &&L_OP_OR,
+        &&L_OP_WOR, &&L_OP_JMP
+    };
+    void ** table = dispatch;
+    DISPATCH();
+#else
+    static const int dispatch[OP_COUNT] = {
+        OP_HALT, OP_CLASS, OP_CLASS_UNCHECKED, OP_LIT, OP_LIT_UNCHECKED, OP_RESERVE,
+        OP_STAR, OP_PLUS, OP_QUEST, OP_REPEAT, OP_BETWEEN, OP_LOOP, OP_RUN, OP_OR, OP_WOR, OP_JMP
+    };
+    static const int checked[OP_COUNT] = {
+        OP_HALT, OP_CLASS, OP_CLASS, OP_LIT, OP_LIT, OP_RESERVE,
+        OP_STAR, OP_PLUS, OP_QUEST, OP_REPEAT, OP_BETWEEN, OP_LOOP, OP_RUN, OP_OR, OP_WOR, OP_JMP
+    };
+    const int * table = dispatch;
+    STATS_VISIT(code, pc)
+    for (;;) switch (table[*pc]) {
+#endif
+
+    //Select a single random character from the class and add it to the string.
+    CASE(OP_CLASS):
+        GROW(1);
+        string[next] = ((const char *)(pc + 2))[random_in(rng, 0, pc[1])];
+        next++;
+        pc += 2 + CLASS_WORDS(pc[1]);
+        DISPATCH();
+
+    CASE(OP_CLASS_UNCHECKED):
+        string[next] = ((const char *)(pc + 2))[random_in(rng, 0, pc[1])];
+        next++;
+        pc += 2 + CLASS_WORDS(pc[1]);
+        DISPATCH();
+
+    //Copy a literal string in.
+    CASE(OP_LIT):
+        GROW_ELSE(pc[1], goto clip_literal);
+        memcpy(string + next, pc + 2, pc[1]);
+        next += pc[1];
+        pc += 2 + CLASS_WORDS(pc[1]);
+        DISPATCH();
+
+    CASE(OP_LIT_UNCHECKED):
+        memcpy(string + next, pc + 2, pc[1]);
+        next += pc[1];
+        pc += 2 + CLASS_WORDS(pc[1]);
+        DISPATCH();
+
+    //Make room for everything the unchecked instructions that follow will write.
+    CASE(OP_RESERVE):
+        GROW_ELSE(pc[1], CLIP());
+        pc += 2;
+        DISPATCH();
 
-char * doinorder1(struct token * subtree, char * string, unsigned long * next, unsigned long * arrlen) {
-    unsigned long i = 0;
-    for (; i < subtree->length; i++) {
-        string = registry(((struct token *(*))(subtree->element))[i], string, next, arrlen);
+    //Runs the body 0 or more times.
+    CASE(OP_STAR):
+        if (logp > 0) {
+            logp = log(pval);
+        }
+        *++top = random_geometric(rng, logp);
+        PRESIZE(pc[1], pc + 2);
+        pc += 2;
+        DISPATCH();
+
+    //Runs the body at least once.
+    CASE(OP_PLUS):
+        if (logp > 0) {
+            logp = log(pval);
+        }
+        *++top = 1 + random_geometric(rng, logp);
+        PRESIZE(pc[1], pc + 2);
+        pc += 2;
+        DISPATCH();
+
+    //Has a 50% chance of running the body.
+    CASE(OP_QUEST):
+        pc = (random_float(rng) > 0.5) ? pc + 2 : code + pc[1];
+        DISPATCH();
+
+    //Runs the body exactly n times.
+    CASE(OP_REPEAT):
+        *++top = pc[1];
+        PRESIZE(pc[2], pc + 3);
+        pc += 3;
+        DISPATCH();
+
+    //Runs the body between n and m times.
+    CASE(OP_BETWEEN):
+        *++top = random_in(rng, pc[1], pc[2] + 1);
+        PRESIZE(pc[3], pc + 4);
+        pc += 4;
+        DISPATCH();
+
+    CASE(OP_LOOP):
+        if (*top == 0) {
+            top--;
+            pc = code + pc[1];
+        } else {
+            if (steps-- == 0) {
+                goto over;
+            }
+            (*top)--;
+            pc += 2;
+        }
+        DISPATCH();
+
+    //Repeats a single character class; the whole run is written at once.  A run over the budget is written as far as
+    //the budget goes.
+    CASE(OP_RUN):
+        if (*top > arrlen - next || *top > steps) {
+            unsigned long most = limit - next < steps ? limit - next : steps;
+            if (*top > most) {
+                *top = most;
+                result = 1;
+            }
+            GROW(*top);
+        }
+        fill_run(rng, string + next, *top, (const char *)(pc + 3), pc[1], (uint16_t)pc[2]);
+        next += *top;
+        steps -= *top;
+        if (result) {
+            goto over;
+        }
+        top--;
+        pc += 3 + RUN_WORDS(pc[1]);
+        DISPATCH();
+
+    //Runs one of the branches.
+    CASE(OP_OR):
+        pc = code + pc[3 + random_in(rng, 0, pc[1])];
+        DISPATCH();
+
+    //Runs one of the branches, picked by weight: the first whose running total is above a number drawn below the
+    //total weight.
+    CASE(OP_WOR): {
+        int pick = (int)random_in(rng, 0, pc[2]);
+        const int * totals = pc + 4 + pc[1];
+        int low = 0;
+        int high = pc[1] - 1;
+        while (low < high) {
+            int mid = (low + high) / 2;
+            if (totals[mid] > pick) {
+                high = mid;
+            } else {
+                low = mid + 1;
+            }
+        }
+        pc = code + pc[4 + low];
+        DISPATCH();
     }
-    
-    return string;
-}
 
-/*
- Calls the subree at least once, then a random number of times
- */
-char * plus2(struct token * subtree, char * string, unsigned long * next, unsigned long * arrlen) {
-    do {
-        string = registry(((struct token *(*))(subtree->element))[0], string, next, arrlen);
-    } while(continue_value > random_float());
-    
-    return string;
-}
+    CASE(OP_JMP):
+        pc = code + pc[1];
+        DISPATCH();
 
-/*
- Calls the subtree 0 or more times.
- */
-char * star3(struct token * subtree, char * string, unsigned long * next, unsigned long * arrlen) {
-    while(continue_value > random_float()) {
-       string = registry(((struct token *(*))(subtree->element))[0], string, next, arrlen);
+    CASE(OP_HALT):
+        goto halt;
+#if !(defined(__GNUC__) && !defined(REGEN_NO_COMPUTED_GOTO))
     }
-    return string;
-}
+#endif
 
-/*
- Has a 50% chance of calling the subtree
- */
-char * questionmark4(struct token * subtree, char * string, unsigned long * next, unsigned long * arrlen) {
-    if (random_float() > 0.5) {
-        string = registry(((struct token *(*))(subtree->element))[0], string, next, arrlen);
+    //A literal that goes over the budget: as much of it as fits.
+clip_literal:
+    CLIP();
+    memcpy(string + next, pc + 2, limit - next);
+    next = limit;
+over:
+    result = 1;
+halt:
+    STATS_HALT(code)
+    if (counters != small) {
+        free(counters);
     }
-    return string;
+
+    out->length = next;
+    return result;
 }
 
-/*
- Calls the subtree exactly n times, as defined by the second element of the operator code
- */
-char * exactlyn5(struct token * subtree, char * string, unsigned long * next, unsigned long * arrlen) {
-    unsigned long i = 0;
-    for (; i < subtree->code[1]; i++) {
-        string = registry(((struct token *(*))(subtree->element))[0], string, next, arrlen);
-    }
-    return string;
+void generate_into(const struct program * prog, float pval, struct rng * rng, struct strbuf * out) {
+    generate_limited(prog, pval, rng, out, 0, 0, 0);
 }
 
 /*
- Calls the subtree between n and m times, as defined by the second and third elements of the operator code.
+ Generates a string within the budget, and deals with one that goes over it as the budget's policy says.
+ @param counts where the times the budget ran out are added up.
+ @return 0, or -1 if the string was given up on.  Nothing is left in out then.
  */
-char * betweennm6(struct token * subtree, char * string, unsigned long * next, unsigned long * arrlen) {
-    unsigned long i = 0;
-    unsigned long max = random_in(subtree->code[1], subtree->code[2] + 1);
-    for (; i < max; i++) {
-        string = registry(((struct token *(*))(subtree->element))[0], string, next, arrlen);
+int generate_budgeted(const struct program * prog, float pval, struct rng * rng, struct strbuf * out,
+                      const struct budget * budget, struct budget_counts * counts) {
+    size_t start = out->length;
+    int tries = 1;
+    while (generate_limited(prog, pval, rng, out, budget->bytes, budget->steps, budget->policy == BUDGET_TRUNCATE)) {
+        if (budget->policy == BUDGET_TRUNCATE) {
+            counts->truncated++;
+            return 0;
+        }
+        out->length = start;
+        if (budget->policy == BUDGET_RESAMPLE && tries < BUDGET_MAX_TRIES) {
+            counts->resampled++;
+            tries++;
+            continue;
+        }
+        counts->failed++;
+        return -1;
     }
-    return string;
+    return 0;
 }
 
 /*
- Calls one of the elements in the subtree
+ @return A newly allocated string that regex could match.  The caller frees it.
+
+ A convenience wrapper around generate_into for when only one string is needed.
  */
-char * or7(struct token * subtree, char * string, unsigned long * next, unsigned long * arrlen) {
-    string = registry(((struct token *(*))(subtree->element))[random_in(0, subtree->length)], string, next, arrlen);
-    return string;
+char * generate_string(const struct program * prog, float pval, struct rng * rng) {
+    struct strbuf buf = {NULL, 0, 0};
+    strbuf_reserve(&buf, STARTING_OUTPUT_STRING_ARRAY_SIZE);
+    generate_into(prog, pval, rng, &buf);
+    *strbuf_reserve(&buf, 1) = '\0';
+    return buf.data;
 }
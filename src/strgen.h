@@ -7,26 +7,50 @@
 //
 
 #include "global.h"
-#include "utils.h"
+#include "compile.h"
+#include "rng.h"
+#include "strbuf.h"
+#include "fill.h"
 
 #ifndef strgen_h
 #define strgen_h
 
 #include <stdio.h>
 
-char * generate_string(struct token *, float pval);
-char * registry(struct token *, char * string, unsigned long * next, unsigned long * arrlen);
-char * charclass0(struct token *, char * string, unsigned long * next, unsigned long * arrlen);
-char * doinorder1(struct token *, char * string, unsigned long * next, unsigned long * arrlen);
-char * plus2(struct token *, char * string, unsigned long * next, unsigned long * arrlen);
-char * star3(struct token *, char * string, unsigned long * next, unsigned long * arrlen);
-char * questionmark4(struct token *, char * string, unsigned long * next, unsigned long * arrlen);
-char * exactlyn5(struct token *, char * string, unsigned long * next, unsigned long * arrlen);
-char * betweennm6(struct token *, char * string, unsigned long * next, unsigned long * arrlen);
-char * or7(struct token *, char * string, unsigned long * next, unsigned long * arrlen);
+//What generate_budgeted does with a string that goes over its budget.
+#define BUDGET_TRUNCATE 0         //Keeps what was written before it ran out.
+#define BUDGET_RESAMPLE 1         //Starts over, up to BUDGET_MAX_TRIES times in all, then fails.
+#define BUDGET_FAIL 2             //Gives the string up.
+
+struct budget {
+    size_t bytes;                 //Most characters in a string, or 0 for no limit.
+    unsigned long steps;          //Most passes through loops, or 0 for no limit.
+    int policy;
+};
+
+struct budget_counts {
+    unsigned long truncated;      //Strings cut short.
+    unsigned long resampled;      //Strings thrown away and started over.
+    unsigned long failed;         //Strings given up on.
+};
+
+void generate_into(const struct program * prog, float pval, struct rng * rng, struct strbuf * out);
+int generate_limited(const struct program * prog, float pval, struct rng * rng, struct strbuf * out, size_t bytes,
+                     unsigned long steps, int truncate);
+int generate_budgeted(const struct program * prog, float pval, struct rng * rng, struct strbuf * out,
+                      const struct budget * budget, struct budget_counts * counts);
+char * generate_string(const struct program * prog, float pval, struct rng * rng);
 
 #endif /* strgen_h */
 
 #ifndef STARTING_OUTPUT_STRING_ARRAY_SIZE
 #define STARTING_OUTPUT_STRING_ARRAY_SIZE 32
 #endif
+
+#ifndef BUDGET_MAX_TRIES
+#define BUDGET_MAX_TRIES 16
+#endif
+
+#ifndef STARTING_LOOP_STACK_SIZE
+#define STARTING_LOOP_STACK_SIZE 32
+#endif
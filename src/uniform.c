@@ -0,0 +1,250 @@
+//
+//  uniform.c
+//  regen
+//  Picks strings of a given length uniformly from everything a pattern matches.
+//
+
+#include "uniform.h"
+#include "nfa.h"
+#include "dfa.h"
+#include <math.h>
+
+/*
+ generate_into picks each branch of a | with the same chance and stops a * with a fixed chance, so short branches
+ and short strings win far more often than their share of the matching strings.  To pick every matching string of a
+ length with the same chance instead, the pattern is turned into a DFA and the number of strings of each length that
+ lead from each state to a match is counted:
+
+    N(s, 0) = 1 if s accepts, else 0
+    N(s, r) = sum over the moves s -> t of (characters in the move's symbol) * N(t, r - 1)
+
+ A string is then written one character at a time, picking each move with chance (characters) * N(t, r - 1) / N(s, r),
+ and the length itself with chance N(start, length) over the total.  Each string comes out with chance 1 / total.
+
+ The counts outgrow any integer type quickly (there are 26^40 strings of [a-z]{40}), so they are kept as natural logs
+ and added with log-sum-exp.  Picking only ever needs ratios of counts, and each ratio is kept as a double, so the
+ result is uniform up to the rounding of a double.
+ */
+
+//log(exp(a) + exp(b)), with -INFINITY for a count of 0.
+static double log_add(double a, double b) {
+    if (a == -INFINITY) {
+        return b;
+    }
+    if (b == -INFINITY) {
+        return a;
+    }
+    return a > b ? a + log1p(exp(b - a)) : b + log1p(exp(a - b));
+}
+
+/*
+ Fills the move lists from the DFA, without moves to the states in dead.
+ */
+static void list_moves(struct uniform * u, const struct dfa * d, const unsigned char * dead) {
+    int s;
+    int sym;
+    u->ntrans = 0;
+    u->tstart = (int *)malloc((d->nstates + 1) * sizeof(int));
+    if (u->tstart == NULL) { printf("malloc failure.\n"); exit(1); }
+    for (s = 0; s < d->nstates; s++) {
+        for (sym = 0; sym < d->nsyms; sym++) {
+            int t = d->next[(size_t)s * d->nsyms + sym];
+            u->ntrans += t >= 0 && !(dead && dead[t]);
+        }
+    }
+    u->tsym = (int *)malloc((u->ntrans ? u->ntrans : 1) * sizeof(int));
+    u->tnext = (int *)malloc((u->ntrans ? u->ntrans : 1) * sizeof(int));
+    if (u->tsym == NULL || u->tnext == NULL) { printf("malloc failure.\n"); exit(1); }
+    u->ntrans = 0;
+    for (s = 0; s < d->nstates; s++) {
+        u->tstart[s] = (int)u->ntrans;
+        for (sym = 0; sym < d->nsyms; sym++) {
+            int t = d->next[(size_t)s * d->nsyms + sym];
+            if (t >= 0 && !(dead && dead[t])) {
+                u->tsym[u->ntrans] = sym;
+                u->tnext[u->ntrans] = t;
+                u->ntrans++;
+            }
+        }
+    }
+    u->tstart[d->nstates] = (int)u->ntrans;
+}
+
+static void free_moves(struct uniform * u) {
+    free(u->tstart);
+    free(u->tsym);
+    free(u->tnext);
+    u->tstart = NULL;
+    u->tsym = NULL;
+    u->tnext = NULL;
+}
+
+/*
+ @param u filled in with the tables.  Release them with uniform_free.
+ @param tree the parse tree of the pattern.
+ @param min, max the lengths to pick from, inclusive.
+ @return UNIFORM_OK, UNIFORM_ENOMATCH if no string of those lengths matches, or UNIFORM_ELIMIT if the tables would be
+ bigger than MAX_UNIFORM_TABLE doubles (or the automaton bigger than MAX_NFA_STATES or MAX_DFA_STATES states).
+ */
+int uniform_build(struct uniform * u, struct token * tree, unsigned long min, unsigned long max) {
+    struct nfa n;
+    struct dfa d;
+    unsigned long r;
+    unsigned long j;
+    int s;
+
+    memset(u, 0, sizeof(*u));
+    if (nfa_build(&n, tree) < 0) {
+        nfa_free(&n);
+        return UNIFORM_ELIMIT;
+    }
+    int built = dfa_build(&d, &n);
+    nfa_free(&n);
+    if (built < 0) {
+        return UNIFORM_ELIMIT;
+    }
+    if ((max + 1) > MAX_UNIFORM_TABLE / (unsigned long)d.nstates) {
+        dfa_free(&d);
+        return UNIFORM_ELIMIT;
+    }
+
+    //Log counts for every remaining length up to max, from every state.
+    u->nstates = d.nstates;
+    u->start = d.start;
+    list_moves(u, &d, NULL);
+    double * logcount = (double *)malloc((max + 1) * d.nstates * sizeof(double));
+    double * logsize = (double *)malloc((d.nsyms ? d.nsyms : 1) * sizeof(double));
+    unsigned char * dead = (unsigned char *)malloc(d.nstates);
+    if (logcount == NULL || logsize == NULL || dead == NULL) { printf("malloc failure.\n"); exit(1); }
+    for (s = 0; s < d.nsyms; s++) {
+        logsize[s] = log((double)(d.symstart[s + 1] - d.symstart[s]));
+    }
+    for (s = 0; s < d.nstates; s++) {
+        logcount[s] = d.accepting[s] ? 0 : -INFINITY;
+        dead[s] = !d.accepting[s];
+    }
+    for (r = 1; r <= max; r++) {
+        double * row = logcount + r * d.nstates;
+        double * prev = row - d.nstates;
+        for (s = 0; s < d.nstates; s++) {
+            double total = -INFINITY;
+            int k = u->tstart[s];
+            for (; k < u->tstart[s + 1]; k++) {
+                if (prev[u->tnext[k]] != -INFINITY) {
+                    total = log_add(total, logsize[u->tsym[k]] + prev[u->tnext[k]]);
+                }
+            }
+            row[s] = total;
+            dead[s] &= total == -INFINITY;
+        }
+    }
+
+    //States that can't reach a match within max characters are never entered, so their moves are left out.
+    free_moves(u);
+    list_moves(u, &d, dead);
+    memcpy(u->symstart, d.symstart, sizeof(u->symstart));
+    memcpy(u->symchars, d.symchars, sizeof(u->symchars));
+    dfa_free(&d);
+
+    int result = UNIFORM_OK;
+    if (max > 0 && u->ntrans > MAX_UNIFORM_TABLE / max) {
+        result = UNIFORM_ELIMIT;
+        goto done;
+    }
+
+    //Lengths, picked by their share of the strings.
+    double largest = -INFINITY;
+    for (r = min; r <= max; r++) {
+        largest = logcount[r * u->nstates + u->start] > largest ? logcount[r * u->nstates + u->start] : largest;
+    }
+    if (largest == -INFINITY) {
+        result = UNIFORM_ENOMATCH;
+        goto done;
+    }
+    u->min = min;
+    u->max = max;
+    u->lengths = (double *)malloc((max - min + 1) * sizeof(double));
+    if (u->lengths == NULL) { printf("malloc failure.\n"); exit(1); }
+    double sum = 0;
+    for (r = min; r <= max; r++) {
+        sum += exp(logcount[r * u->nstates + u->start] - largest);
+        u->lengths[r - min] = sum;
+    }
+
+    //Moves, picked by their share of the strings left from each state.
+    u->cumulative = (double *)malloc((max * u->ntrans + 1) * sizeof(double));
+    if (u->cumulative == NULL) { printf("malloc failure.\n"); exit(1); }
+    for (r = 1; r <= max; r++) {
+        double * row = u->cumulative + (r - 1) * u->ntrans;
+        double * prev = logcount + (r - 1) * u->nstates;
+        for (s = 0; s < u->nstates; s++) {
+            double here = logcount[r * u->nstates + s];
+            sum = 0;
+            for (j = u->tstart[s]; j < (unsigned long)u->tstart[s + 1]; j++) {
+                if (here != -INFINITY && prev[u->tnext[j]] != -INFINITY) {
+                    sum += exp(logsize[u->tsym[j]] + prev[u->tnext[j]] - here);
+                }
+                row[j] = sum;
+            }
+        }
+    }
+
+done:
+    free(logcount);
+    free(logsize);
+    free(dead);
+    if (result != UNIFORM_OK) {
+        uniform_free(u);
+    }
+    return result;
+}
+
+/*
+ @return the index of the first of the count running totals that is above pick, skipping any that add nothing.
+ */
+static unsigned long find(const double * totals, unsigned long count, double pick) {
+    unsigned long low = 0;
+    unsigned long high = count - 1;
+    while (low < high) {
+        unsigned long mid = (low + high) / 2;
+        if (totals[mid] > pick) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
+    //Rounding can leave pick at the very top; step back to the last entry that can be picked.
+    while (low > 0 && totals[low] == totals[low - 1]) {
+        low--;
+    }
+    return low;
+}
+
+/*
+ Appends a string to out, picked uniformly from every string of the lengths u was built for that the pattern matches.
+ */
+void uniform_generate(const struct uniform * u, struct rng * rng, struct strbuf * out) {
+    unsigned long count = u->max - u->min + 1;
+    unsigned long length = u->min + find(u->lengths, count, random_float(rng) * u->lengths[count - 1]);
+    char * string = strbuf_reserve(out, length);
+    int state = u->start;
+    unsigned long r = length;
+
+    for (; r > 0; r--) {
+        const double * row = u->cumulative + (r - 1) * u->ntrans + u->tstart[state];
+        unsigned long moves = u->tstart[state + 1] - u->tstart[state];
+        unsigned long j = u->tstart[state] + find(row, moves, random_float(rng) * row[moves - 1]);
+        int sym = u->tsym[j];
+        *string++ = (char)u->symchars[u->symstart[sym] + random_in(rng, 0, u->symstart[sym + 1] - u->symstart[sym])];
+        state = u->tnext[j];
+    }
+    out->length += length;
+}
+
+void uniform_free(struct uniform * u) {
+    free_moves(u);
+    free(u->cumulative);
+    free(u->lengths);
+    u->cumulative = NULL;
+    u->lengths = NULL;
+}
@@ -0,0 +1,48 @@
+//
+//  uniform.h
+//  regen
+//  Picks strings of a given length uniformly from everything a pattern matches.
+//
+
+#include "global.h"
+#include "rng.h"
+#include "strbuf.h"
+
+#ifndef uniform_h
+#define uniform_h
+
+/*
+ The tables are built once and only read while sampling, so any number of threads can share one.
+ */
+struct uniform {
+    unsigned long min;            //Shortest and longest length sampled.
+    unsigned long max;
+    int nstates;
+    int start;
+    unsigned long ntrans;         //Moves between states that can still reach a match.
+    int * tstart;                 //The moves out of state s are tstart[s] to tstart[s + 1] - 1,
+    int * tsym;                   //each reading a character of symbol tsym[j]
+    int * tnext;                  //and going to state tnext[j].
+    double * cumulative;          //cumulative[(r - 1) * ntrans + j]: chance of taking move j or an earlier one of its state
+                                  //with r characters left to write.
+    double * lengths;             //Chance of a length from min up to min + i, for each i.
+    int symstart[257];
+    unsigned char symchars[256];
+};
+
+enum uniform_result {
+    UNIFORM_OK = 0,
+    UNIFORM_ENOMATCH,             //The pattern matches no string of those lengths.
+    UNIFORM_ELIMIT                //The automaton or its tables would be too big.
+};
+
+int uniform_build(struct uniform * u, struct token * tree, unsigned long min, unsigned long max);
+void uniform_generate(const struct uniform * u, struct rng * rng, struct strbuf * out);
+void uniform_free(struct uniform * u);
+
+#endif /* uniform_h */
+
+//Most doubles the tables may hold, counting both the counts built along the way and the ones kept.
+#ifndef MAX_UNIFORM_TABLE
+#define MAX_UNIFORM_TABLE (1 << 24)
+#endif
@@ -0,0 +1,159 @@
+//
+//  uniqset.c
+//  regen
+//  Remembers which lines have been written, for -u.
+//
+
+#include "uniqset.h"
+#include <math.h>
+
+/*
+ A line's 64-bit hash picks its shard (top bits) and its slot or filter bits (the rest).  The exact set probes
+ linearly and compares the hash before the line itself, so a line that is new usually costs one hash and one probe.
+ It keeps a copy of every line in a pool that only grows, and doubles its slots at half full.
+
+ The Bloom filter is sized for the number of lines expected and the chance of a false positive asked for,
+ m = -n ln(p) / ln(2)^2 bits and k = (m / n) ln(2) bits per line, picked by double hashing.  A false positive only
+ means a new line is taken for a repeat and skipped, never that a repeat is written.
+ */
+
+#define EXACT_START_SLOTS 64
+
+static uint64_t hash_line(const char * line, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ULL ^ length;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, line + i, 8);
+        hash = (hash ^ word) * 0x100000001b3ULL;
+        hash ^= hash >> 29;
+    }
+    for (; i < length; i++) {
+        hash = (hash ^ (unsigned char)line[i]) * 0x100000001b3ULL;
+    }
+    //The MurmurHash3 finalizer, so every bit depends on every other.
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash ? hash : 1; //0 marks an empty slot.
+}
+
+/*
+ @param false_positive 0 for an exact set, or the chance that a Bloom filter takes a new line for one it has seen.
+ @param expected how many lines the filter should hold at that chance.  Unused by the exact set.
+ */
+void uniqset_init(struct uniqset * set, double false_positive, unsigned long expected) {
+    int i = 0;
+    memset(set, 0, sizeof(*set));
+    set->bloom = false_positive > 0;
+    if (set->bloom) {
+        double bits = -(double)(expected ? expected : 1) * log(false_positive) / (M_LN2 * M_LN2);
+        set->nbits = ((uint64_t)(bits / UNIQSET_SHARDS) + 64) & ~(uint64_t)63;
+        set->nhashes = (int)lround(bits / (expected ? expected : 1) * M_LN2);
+        set->nhashes = set->nhashes < 1 ? 1 : set->nhashes;
+    }
+    for (; i < UNIQSET_SHARDS; i++) {
+        struct uniqshard * shard = &set->shards[i];
+        pthread_mutex_init(&shard->lock, NULL);
+        if (set->bloom) {
+            shard->bits = (uint64_t *)calloc(set->nbits / 64, sizeof(uint64_t));
+            if (shard->bits == NULL) { printf("calloc failure.\n"); exit(1); }
+        }
+    }
+}
+
+//Adds the line to a Bloom shard.  @return 1 if any of its bits was clear.
+static int bloom_add(const struct uniqset * set, struct uniqshard * shard, uint64_t hash) {
+    uint64_t h1 = hash;
+    uint64_t h2 = (hash >> 32 | hash << 32) | 1;
+    int added = 0;
+    int i = 0;
+    for (; i < set->nhashes; i++) {
+        uint64_t bit = (h1 + i * h2) % set->nbits;
+        uint64_t mask = (uint64_t)1 << (bit & 63);
+        added |= !(shard->bits[bit >> 6] & mask);
+        shard->bits[bit >> 6] |= mask;
+    }
+    return added;
+}
+
+static void exact_grow(struct uniqshard * shard) {
+    unsigned long oldslots = shard->slots;
+    uint64_t * oldhashes = shard->hashes;
+    size_t * oldoffsets = shard->offsets;
+    unsigned long i = 0;
+
+    shard->slots = oldslots ? oldslots * 2 : EXACT_START_SLOTS;
+    shard->hashes = (uint64_t *)calloc(shard->slots, sizeof(uint64_t));
+    shard->offsets = (size_t *)malloc(shard->slots * sizeof(size_t));
+    if (shard->hashes == NULL || shard->offsets == NULL) { printf("malloc failure.\n"); exit(1); }
+    for (; i < oldslots; i++) {
+        if (oldhashes[i]) {
+            unsigned long slot = oldhashes[i] & (shard->slots - 1);
+            while (shard->hashes[slot]) {
+                slot = (slot + 1) & (shard->slots - 1);
+            }
+            shard->hashes[slot] = oldhashes[i];
+            shard->offsets[slot] = oldoffsets[i];
+        }
+    }
+    free(oldhashes);
+    free(oldoffsets);
+}
+
+//Adds the line to an exact shard.  @return 1 if it was not there yet.
+static int exact_add(struct uniqshard * shard, uint64_t hash, const char * line, size_t length) {
+    if (2 * (shard->used + 1) > shard->slots) {
+        exact_grow(shard);
+    }
+    unsigned long slot = hash & (shard->slots - 1);
+    for (; shard->hashes[slot]; slot = (slot + 1) & (shard->slots - 1)) {
+        if (shard->hashes[slot] == hash) {
+            size_t kept;
+            memcpy(&kept, shard->pool + shard->offsets[slot] - sizeof(size_t), sizeof(size_t));
+            if (kept == length && !memcmp(shard->pool + shard->offsets[slot], line, length)) {
+                return 0;
+            }
+        }
+    }
+    while (shard->poollength + sizeof(size_t) + length > shard->poolsize) {
+        shard->poolsize = shard->poolsize ? shard->poolsize * 2 : 4096;
+        shard->pool = (char *)realloc(shard->pool, shard->poolsize);
+        if (shard->pool == NULL) { printf("realloc failure.\n"); exit(1); }
+    }
+    memcpy(shard->pool + shard->poollength, &length, sizeof(size_t));
+    memcpy(shard->pool + shard->poollength + sizeof(size_t), line, length);
+    shard->hashes[slot] = hash;
+    shard->offsets[slot] = shard->poollength + sizeof(size_t);
+    shard->poollength += sizeof(size_t) + length;
+    shard->used++;
+    return 1;
+}
+
+/*
+ Adds a line to the set.  Safe to call from several threads at once.
+ @return 1 if the line is new, 0 if it has been added before (or, with a Bloom filter, seems to have been).
+ */
+int uniqset_add(struct uniqset * set, const char * line, size_t length) {
+    uint64_t hash = hash_line(line, length);
+    struct uniqshard * shard = &set->shards[(hash >> 40) & (UNIQSET_SHARDS - 1)];
+    int added;
+    pthread_mutex_lock(&shard->lock);
+    added = set->bloom ? bloom_add(set, shard, hash) : exact_add(shard, hash, line, length);
+    pthread_mutex_unlock(&shard->lock);
+    return added;
+}
+
+void uniqset_free(struct uniqset * set) {
+    int i = 0;
+    for (; i < UNIQSET_SHARDS; i++) {
+        struct uniqshard * shard = &set->shards[i];
+        pthread_mutex_destroy(&shard->lock);
+        free(shard->hashes);
+        free(shard->offsets);
+        free(shard->pool);
+        free(shard->bits);
+    }
+}
@@ -0,0 +1,48 @@
+//
+//  uniqset.h
+//  regen
+//  Remembers which lines have been written, for -u.
+//
+
+#include "global.h"
+
+#ifndef uniqset_h
+#define uniqset_h
+
+#include <pthread.h>
+#include <stdint.h>
+
+//Must be a power of 2.
+#ifndef UNIQSET_SHARDS
+#define UNIQSET_SHARDS 64
+#endif
+
+/*
+ The set is split into shards by hash, each with its own lock, so threads adding lines rarely wait on each other.
+ Each shard is either an exact hash set that keeps a copy of every line, or a Bloom filter of fixed size that keeps a
+ few bits per line and sometimes mistakes a new line for one already seen.
+ */
+struct uniqshard {
+    pthread_mutex_t lock;
+    uint64_t * hashes;        //Exact: hash of each slot's line, or 0 for an empty slot.
+    size_t * offsets;         //Exact: where the slot's line starts in pool, after its length.
+    unsigned long slots;
+    unsigned long used;
+    char * pool;              //Exact: every line kept, each after its length.
+    size_t poollength;
+    size_t poolsize;
+    uint64_t * bits;          //Bloom: the filter.
+};
+
+struct uniqset {
+    struct uniqshard shards[UNIQSET_SHARDS];
+    int bloom;
+    uint64_t nbits;           //Bloom: bits per shard.
+    int nhashes;              //Bloom: bits set per line.
+};
+
+void uniqset_init(struct uniqset * set, double false_positive, unsigned long expected);
+int uniqset_add(struct uniqset * set, const char * line, size_t length);
+void uniqset_free(struct uniqset * set);
+
+#endif /* uniqset_h */
@@ -7,6 +7,8 @@
 //
 
 #include "utils.h"
+#include <errno.h>
+#include <fcntl.h>
 
 void print_tree(struct token * root) {
     printf("address = %p\n", root);
@@ -14,13 +16,15 @@ void print_tree(struct token * root) {
     printf("  address of opcode = %p\n", root->code);
     if (root->code[0] == 5) {
         printf("n = %d\n", root->code[1]);
+    } else if (root->code[0] == 9) {
+        printf("total weight = %d\n", root->code[1]);
     } else if (root->code[0] == 6) {
         printf("n = %d\n", root->code[1]);
         printf("m = %d\n", root->code[2]);
     }
     printf("length = %lu\n", root->length);
-    if (root->code[0] == 0) {
-        printf("character class = %s\n", (char *)(root->element));
+    if (root->code[0] == 0 || root->code[0] == 8) {
+        printf("%s = %.*s\n", root->code[0] == 0 ? "character class" : "literal", (int)root->length, (char *)(root->element));
         printf("  address of character class = %p\n", root->element);
         printf("-----------------------------\n");
     } else {
@@ -30,6 +34,9 @@ void print_tree(struct token * root) {
         for (; i < root->length; i++) {
             printf("From %p\n", root);
             struct token * temp = ((struct token **)(root->element))[i];
+            if (root->code[0] == 9) {
+                printf("weight = %d\n", root->code[2 + i]);
+            }
             print_tree(temp);
         }
     }
@@ -37,92 +44,208 @@ void print_tree(struct token * root) {
 }
 
 /*
- * Checks that the grouping symbols (), {}, and [] are equal in number and open and close in the right
- * order (ie. there is always a ( before there is a ).
- * Terminates program execution upon discovery of an error.
+ @param file the file to read, or "-" for stdin.
+ @return the whole file as one string, without the line ending at its end.  The caller frees it.
  */
-void grpSymChk(const char * regex, unsigned long length) {
-    int paren = 0;   //()
-    int cbrace = 0;  //{}
-    int bracket = 0; //[]
-    
-    short notincc = 1; //Non-bracket grouping symbols don't count if they're inside a character class
-    
-    unsigned long i = 0;
-    for (; i < length; i++) {
-        //Skip escaped characters
-        if (regex[i] == '\\' && i + 2 <= length) {
-            i += 2;
-        }
-        
-        //Count grouping symbols
-        if (regex[i] == '(' && notincc) { paren++; }
-        if (regex[i] == '{' && notincc) { cbrace++; }
-        if (regex[i] == '[') { bracket++; notincc = 0; }
-        if (regex[i] == ')' && notincc) { paren--;  }
-        if (regex[i] == '}' && notincc) { cbrace--; }
-        if (regex[i] == ']') { bracket--; notincc = 1;}
-        
-        //If any grouping symbol is negative, a closing symbol comes before an opening.
-        if (paren < 0) {
-            printf("Closing parenthesis comes before opening parenthesis.\n");
-            exit(4);  //Indicates syntax error in regex.
-        }
-        if (cbrace < 0) {
-            printf("Closing curly brace comes before opening curly brace.\n");
-            exit(4);
-        }
-        if (bracket < 0) {
-            printf("Closing bracket comes before opening bracket.\n");
-            exit(4);
-        }
-    }
-    
-    //Make sure all pairs of parenthesis are closed.
-    if (paren > 0) {
-        printf("Opening parenthesis not closed.\n");
-        exit(4);
+char * read_regex_file(const char * file) {
+    FILE * in = strcmp(file, "-") ? fopen(file, "r") : stdin;
+    struct strbuf buf = {NULL, 0, 0};
+    size_t n;
+
+    if (in == NULL) {
+        printf("Could not open regex file \"%s\".\n", file);
+        exit(2);
     }
-    if (cbrace > 0) {
-        printf("Opening curly brace not closed.\n");
-        exit(4);
+    do {
+        n = fread(strbuf_reserve(&buf, STARTING_STRBUF_SIZE), 1, STARTING_STRBUF_SIZE, in);
+        buf.length += n;
+    } while (n > 0);
+    if (in != stdin) {
+        fclose(in);
     }
-    if (bracket > 0) {
-        printf("Opening bracket not closed (character class not closed).\n");
-        exit(4);
+    while (buf.length > 0 && (buf.data[buf.length - 1] == '\n' || buf.data[buf.length - 1] == '\r')) {
+        buf.length--;
     }
-    //Good to go.
+    *strbuf_reserve(&buf, 1) = '\0';
+    return buf.data;
 }
 
 /*
- Generates a random value between 0 and 1
+ Writes the lines of file (- for stdin) that the pattern matches as a whole to fd, each followed by a newline.
+ @return how many lines were written.
  */
-float random_float() {
-    return (float)rand() / (float)RAND_MAX;
+unsigned long filter_lines(regen_matcher * matcher, const char * file, int fd) {
+    int in = strcmp(file, "-") ? open(file, O_RDONLY) : STDIN_FILENO;
+    struct strbuf buf = {NULL, 0, 0};
+    struct strbuf out = {NULL, 0, 0};
+    unsigned long kept = 0;
+    ssize_t n;
+
+    if (in < 0) {
+        printf("Could not open \"%s\".\n", file);
+        exit(2);
+    }
+    do {
+        n = read(in, strbuf_reserve(&buf, FILTER_READ_SIZE), FILTER_READ_SIZE);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("read failure.\n");
+            exit(1);
+        }
+        buf.length += n;
+
+        //Every whole line read so far is matched; a line without its newline waits for more, unless the file ended.
+        char * line = buf.data;
+        char * end = buf.data + buf.length;
+        char * newline;
+        while ((newline = (char *)memchr(line, '\n', end - line)) != NULL || (n == 0 && line < end)) {
+            size_t length = (newline ? newline : end) - line;
+            if (regen_match(matcher, line, length)) {
+                char * at = strbuf_reserve(&out, length + 1);
+                memcpy(at, line, length);
+                at[length] = '\n';
+                out.length += length + 1;
+                kept++;
+            }
+            line += newline ? length + 1 : length;
+        }
+        buf.length = end - line;
+        memmove(buf.data, line, buf.length);
+        if (out.length >= FILTER_WRITE_SIZE || n == 0) {
+            write_all(fd, out.data, out.length);
+            out.length = 0;
+        }
+    } while (n != 0);
+
+    if (in != STDIN_FILENO) {
+        close(in);
+    }
+    strbuf_free(&buf);
+    strbuf_free(&out);
+    return kept;
 }
 
 /*
- Returns a random value between low and high, inclusive to the lowwer bound but exclusive to the upper.
+ Reports on stderr how often lines went over their budget, if they ever did.
  */
-unsigned long random_in(unsigned long low, unsigned long high) {
-    return ((unsigned long)rand() % (high - low)) + low;
+void print_budget_counts(const struct regen_budget_counts * counts) {
+    if (counts->truncated || counts->resampled || counts->failed) {
+        fprintf(stderr, "Over budget: %lu line%s truncated, %lu resampled, %lu left out.\n", counts->truncated,
+                counts->truncated == 1 ? "" : "s", counts->resampled, counts->failed);
+    }
+}
+
+//Writes up to STATS_SNIPPET_LENGTH characters of the pattern from position on, escaped for a JSON string.
+static void print_snippet(const char * regex, long position) {
+    size_t length = strlen(regex);
+    size_t i = (size_t)position;
+    if (position < 0 || i >= length) {
+        return;
+    }
+    for (; i < length && i < position + STATS_SNIPPET_LENGTH; i++) {
+        unsigned char c = (unsigned char)regex[i];
+        if (c == '"' || c == '\\') {
+            fprintf(stderr, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(stderr, "\\u%04x", c);
+        } else {
+            fputc(c, stderr);
+        }
+    }
+}
+
+static void print_phase_json(const char * name, const struct regen_phase * phase, int last) {
+    fprintf(stderr, "\"%s\": {\"wall\": %.9f, \"cpu\": %.9f}%s", name, phase->wall, phase->cpu, last ? "" : ", ");
 }
 
 /*
- Frees a tree and all elements associated with it, recursively.
+ Reports on stderr where the time of a run went, as text or as one JSON object.
+ @param regex the pattern, to show the part each instruction came from.
  */
-void free_tree(struct token * subtree) {
+void print_stats(const struct regen_stats * stats, const char * regex, int json) {
+    double rate = stats->wall > 0 ? 1 / stats->wall : 0;
     unsigned long i = 0;
-    if (subtree->code[0] == 0) {
-        free(subtree->element);
-    } else {
-        for (; i < subtree->length; i++) {
-            free_tree(((struct token **)(subtree->element))[i]);
+    int bucket = 0;
+    int first = 1;
+
+    if (json) {
+        fprintf(stderr, "{\"phases\": {");
+        print_phase_json("parse", &stats->parse, 0);
+        print_phase_json("compile", &stats->compile, 0);
+        print_phase_json("generate", &stats->generate, 0);
+        print_phase_json("write", &stats->write, 1);
+        fprintf(stderr, "}, \"wall\": %.9f, \"lines\": %lu, \"bytes\": %llu, \"lines_per_second\": %.1f, "
+                "\"bytes_per_second\": %.1f, \"lengths\": [", stats->wall, stats->lines,
+                (unsigned long long)stats->bytes, stats->lines * rate, stats->bytes * rate);
+        for (; bucket < REGEN_STATS_BUCKETS; bucket++) {
+            if (stats->lengths[bucket]) {
+                fprintf(stderr, "%s{\"from\": %llu, \"count\": %lu}", first ? "" : ", ",
+                        bucket ? 1ULL << (bucket - 1) : 0ULL, stats->lengths[bucket]);
+                first = 0;
+            }
+        }
+        fprintf(stderr, "], \"counted\": %s", stats->counted ? "true" : "false");
+        if (stats->counted) {
+            fprintf(stderr, ", \"allocs\": %lu, \"reallocs\": %lu, \"nodes\": [", stats->allocs, stats->reallocs);
+            for (; i < stats->nnodes; i++) {
+                const struct regen_node_stats * node = &stats->nodes[i];
+                fprintf(stderr, "%s{\"instruction\": %lu, \"op\": \"%s\", \"position\": %ld, \"pattern\": \"",
+                        i ? ", " : "", node->instruction, node->op, node->position);
+                print_snippet(regex, node->position);
+                fprintf(stderr, "\", \"visits\": %lu, \"seconds\": %.9f}", node->visits, node->seconds);
+            }
+            fprintf(stderr, "]");
+        }
+        fprintf(stderr, "}\n");
+        return;
+    }
+
+    fprintf(stderr, "Phase          wall (s)      cpu (s)\n");
+    fprintf(stderr, "parse      %12.6f %12.6f\n", stats->parse.wall, stats->parse.cpu);
+    fprintf(stderr, "compile    %12.6f %12.6f\n", stats->compile.wall, stats->compile.cpu);
+    fprintf(stderr, "generate   %12.6f %12.6f  (added up over threads)\n", stats->generate.wall, stats->generate.cpu);
+    fprintf(stderr, "write      %12.6f %12.6f\n", stats->write.wall, stats->write.cpu);
+    fprintf(stderr, "run        %12.6f\n\n", stats->wall);
+    fprintf(stderr, "%lu lines, %llu bytes: %.0f lines/s, %.0f bytes/s\n\n", stats->lines,
+            (unsigned long long)stats->bytes, stats->lines * rate, stats->bytes * rate);
+    fprintf(stderr, "Line length          lines\n");
+    for (; bucket < REGEN_STATS_BUCKETS; bucket++) {
+        char range[48];
+        if (stats->lengths[bucket] == 0) {
+            continue;
+        }
+        if (bucket == 0) {
+            snprintf(range, sizeof(range), "0");
+        } else if (bucket == REGEN_STATS_BUCKETS - 1) {
+            snprintf(range, sizeof(range), "%llu and up", 1ULL << (bucket - 1));
+        } else {
+            snprintf(range, sizeof(range), "%llu-%llu", 1ULL << (bucket - 1), (1ULL << bucket) - 1);
+        }
+        fprintf(stderr, "%-16s %10lu\n", range, stats->lengths[bucket]);
+    }
+    if (!stats->counted) {
+        fprintf(stderr, "\nBuild with 'make stats' to count allocations and instructions too.\n");
+        return;
+    }
+    fprintf(stderr, "\n%lu allocations, %lu reallocations\n", stats->allocs, stats->reallocs);
+    if (stats->nnodes) {
+        fprintf(stderr, "\nInstruction             pattern               visits  seconds\n");
+    }
+    for (; i < stats->nnodes; i++) {
+        const struct regen_node_stats * node = &stats->nodes[i];
+        fprintf(stderr, "%5lu %-18s", node->instruction, node->op);
+        if (node->position >= 0 && node->position < (long)strlen(regex)) {
+            fprintf(stderr, "%4ld ", node->position);
+            int width = (int)strlen(regex + node->position);
+            width = width < STATS_SNIPPET_LENGTH ? width : STATS_SNIPPET_LENGTH;
+            fprintf(stderr, "%-16.*s", width, regex + node->position);
+        } else {
+            fprintf(stderr, "%21s", "");
         }
-        free(subtree->element);
+        fprintf(stderr, " %10lu %8.6f\n", node->visits, node->seconds);
     }
-    free(subtree->code);
-    free(subtree);
 }
 
 void help_message() {
@@ -132,17 +255,57 @@ void help_message() {
     printf("match.\n\n");
     printf("Examples can be written out to a file, specified by a second argument or with the flag -f.\n\n");
     printf("Options\n\n");
-    printf("  -d By default, regen uses the current time as a seed for random number generation to give seemingly\n");
-    printf("     more random results.  -d turns this feature off.\n\n");
+    printf("  -d By default, regen seeds its random number generator from the system's entropy pool to give\n");
+    printf("     different results on every run.  -d uses a fixed seed instead, so runs repeat exactly.\n\n");
     printf("  -f must be followed by a file name.  It specifies the file name the output is to be written to.\n");
     printf("     If a second argument provides a file name and -f is used in addition, -f overrides.\n\n");
+    printf("  -j must be followed by an integer, the number of threads generating lines.  The output is the same\n");
+    printf("     for any number of threads.\n\n");
     printf("  -l indicates the number of example strings that should be written out.  The argument must be\n");
-    printf("     followed by an integer.\n\n");
+    printf("     followed by an integer.  --count is another name for -l.\n\n");
     printf("  -o if a file is being written and a file with the provided name already exists, overwrite it\n");
     printf("     without asking.\n\n");
+    printf("  --patterns must be followed by a file name (- for stdin).  Every line of the file is a pattern,\n");
+    printf("     and -l samples of each are written as 'line number<TAB>sample'.  Patterns with errors are reported\n");
+    printf("     on stderr and skipped.  --out-dir DIR writes the samples of line n to DIR/n.txt instead.\n\n");
+    printf("  --regex-file must be followed by a file name (- for stdin), whose contents are the pattern.  Use it\n");
+    printf("     for patterns too long for the command line, such as large word lists.\n\n");
+    printf("  --compile-to must be followed by a file name.  The pattern (or the --patterns file) is compiled and\n");
+    printf("     saved there, and nothing is generated.  --load FILE then uses the saved patterns without parsing them.\n\n");
     printf("  -p the * and + operators use random numbers to determine how many times to reproduce the\n");
     printf("     given segment.  Choose a number between 0 and 1.  A value closer to 1 will result in more\n");
     printf("     characters for * and +.  The devault value is .90 and the maximum value is %f.\n\n", MAX_DEC_CONT_VALUE);
+    printf("  -s must be followed by an integer, which is used as the random seed.  The same seed gives the same\n");
+    printf("     output on every platform.\n\n");
+    printf("  --start must be followed by an integer k.  Output begins at line k (counting from 0) of the run, as if\n");
+    printf("     the first k lines had been generated and thrown away, but without the cost of generating them.\n");
+    printf("     With -d or -s, 'regen -s 7 --start 500 --count 10 ...' repeats lines 500 to 509 of any run with seed 7.\n\n");
+    printf("  --uniform with --length n (or n:m), picks every line uniformly from all the strings of n (to m)\n");
+    printf("     characters that the pattern matches, instead of favoring short branches and short repeats.\n\n");
+    printf("  --max-len n writes only lines of at most n characters, and --min-len n only lines of at least n.  Choices\n");
+    printf("     that can't end in that range are never made, so no line is thrown away.\n\n");
+    printf("  --max-bytes n cuts every line off at n characters, and --max-steps n after n passes through repeats, so\n");
+    printf("     no line can take long.  --on-budget says what happens to such a line: resample (the default) starts\n");
+    printf("     it over, up to 16 tries before leaving it out; truncate keeps it cut short; fail leaves it out.  How\n");
+    printf("     often each happened is reported on stderr.\n\n");
+    printf("  --stats reports on stderr how long parsing, compiling, generating and writing took, lines and bytes per\n");
+    printf("     second, and how long the lines were.  --stats-json writes it as JSON.  A build made with 'make stats'\n");
+    printf("     also counts allocations, and how often each part of the pattern ran and for how long.\n\n");
+    printf("  --verify checks every line against the pattern as it is generated; if any does not match, it says how\n");
+    printf("     many did not and which was first, and regen exits with status 3.\n\n");
+    printf("  --match file writes the lines of file that the pattern matches in full, instead of generating any.\n\n");
+    printf("  --enumerate writes every string the pattern matches, each once, shortest first.  --max-length n leaves\n");
+    printf("     out strings longer than n (needed when there is no longest one), and --order lex writes them in byte\n");
+    printf("     order instead.  -l, --start and -j work on the list as they do on samples.\n\n");
+    printf("  -u writes only lines that differ from every line before them, stopping early if the pattern has no more.\n");
+    printf("     --bloom RATE remembers lines in a Bloom filter of bounded size instead, which skips about RATE of\n");
+    printf("     the new lines as if they were repeats.\n\n");
+    printf("  --shards N splits the lines evenly over N files, written side by side, each with a seed of its own\n");
+    printf("     derived from the run's.  --shard-pattern names them, with one integer conversion for the shard's\n");
+    printf("     number (out-%%04d.txt by default).  The output gets a manifest of each shard's file, seed, start,\n");
+    printf("     lines and bytes; 'regen -s SEED --start START -l LINES ...' makes any one of them again.\n\n");
+    printf("  --unordered with -j, write each block of lines as soon as it is done instead of in order.  This is\n");
+    printf("     faster, but the order of the lines is no longer reproducible.\n\n");
     printf("Examples\n\n");
     printf("$ regen '([a-z]+.)*' -d -o -f out.txt\n");
     printf("$ regen '[0-9]*' out.txt -l 20\n\n");
@@ -153,5 +316,5 @@ void help_message() {
     printf("The ^ symbol can be used to negate a character class.  Character classes with the ^ symbol (eg [^ab])\n");
     printf("will include all of the following characters:\n\n");
     printf("   %s\n\n", NOT_BASE_CHARACTER_SET);
-    printf("except those included within the [].  The a-z, A-Z, and 0-9 shortcuts may be used in conjunction with ^.\n");
+    printf("except those included within the [].  Ranges such as a-z and escapes such as \\d may be used in conjunction with ^.\n");
 }
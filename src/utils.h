@@ -6,15 +6,31 @@
 //  Copyright © 2018 Luke  Dramko. All rights reserved.
 //
 #include "global.h"
+#include "strbuf.h"
+#include "regen.h"
 
 #ifndef utils_h
 #define utils_h
 
 void print_tree(struct token *);
-void grpSymChk(const char *, unsigned long length);
-float random_float(void);
-unsigned long random_in(unsigned long low, unsigned long high);
-void free_tree(struct token *);
+char * read_regex_file(const char * file);
 void help_message(void);
+void print_budget_counts(const struct regen_budget_counts * counts);
+void print_stats(const struct regen_stats * stats, const char * regex, int json);
+unsigned long filter_lines(regen_matcher * matcher, const char * file, int fd);
 
 #endif /* utils_h */
+
+//Bytes read at a time by filter_lines, and bytes of matching lines it collects before writing them.
+#ifndef FILTER_READ_SIZE
+#define FILTER_READ_SIZE (1 << 20)
+#endif
+
+#ifndef FILTER_WRITE_SIZE
+#define FILTER_WRITE_SIZE (1 << 18)
+#endif
+
+//Characters of the pattern shown for each instruction by print_stats.
+#ifndef STATS_SNIPPET_LENGTH
+#define STATS_SNIPPET_LENGTH 16
+#endif
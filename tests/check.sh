@@ -0,0 +1,97 @@
+#!/bin/sh
+# Checks regen's output byte for byte in cases that are easy to get wrong.  Run from the top of the tree, after
+# building, with "make check".  Prints each failed check and exits 1 if there were any.
+
+regen=./regen
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+failures=0
+
+fail() {
+    echo "FAIL: $*"
+    failures=$((failures + 1))
+}
+
+# Every line of file must be exactly length characters long.
+check_lengths() {
+    awk -v n="$2" 'length($0) != n { bad = 1 } END { exit bad }' "$1" || fail "$3: lines are not $2 characters"
+}
+
+# --on-budget truncate writes fixed length parts as far as the budget goes.
+"$regen" -s 1 -l 20 --max-bytes 100 --on-budget truncate '[a-z]{1000}' > "$tmp/run" 2> /dev/null \
+    || fail "[a-z]{1000} truncated: exit status $?"
+check_lengths "$tmp/run" 100 "[a-z]{1000} truncated at 100"
+"$regen" -s 1 -l 20 --max-bytes 101 --on-budget truncate '(ab){1000}' > "$tmp/run" 2> /dev/null \
+    || fail "(ab){1000} truncated: exit status $?"
+check_lengths "$tmp/run" 101 "(ab){1000} truncated at 101"
+grep -qv '^\(ab\)*a$' "$tmp/run" && fail "(ab){1000} truncated at 101: not a prefix"
+"$regen" -s 1 -l 1 --max-bytes 7 --on-budget truncate 'hello world' > "$tmp/run" 2> /dev/null
+[ "$(cat "$tmp/run")" = "hello w" ] || fail "hello world truncated at 7: \"$(cat "$tmp/run")\""
+
+# The same lines, byte for byte, whether they go to a regular file that is given its space up front (-f), one that
+# isn't (stdout, written after other output, and --out-dir), or a pipe.  Repeated, since a file can be cut short at a
+# different spot each time.
+for letter in A B C; do
+    for digits in 0 1 2 3 4 5 6 7 8 9; do
+        for digit in 0 1 2 3 4 5 6 7 8 9; do
+            echo "$letter$digits$digit"
+        done
+    done
+done > "$tmp/expected"
+printf '[A-C][0-9]{2}\n' > "$tmp/patterns"
+mkdir "$tmp/dir"
+for attempt in 1 2 3 4 5 6 7 8 9 10; do
+    "$regen" --enumerate '[A-C][0-9]{2}' > "$tmp/stdout" || fail "stdout to a file: exit status $?"
+    cmp -s "$tmp/stdout" "$tmp/expected" || fail "stdout to a file: wrong bytes"
+    { echo first; "$regen" --enumerate '[A-C][0-9]{2}' || fail "stdout after other output: exit status $?"; } \
+        > "$tmp/after"
+    { echo first; cat "$tmp/expected"; } | cmp -s - "$tmp/after" || fail "stdout after other output: wrong bytes"
+    "$regen" --enumerate '[A-C][0-9]{2}' -o -f "$tmp/file" || fail "-f: exit status $?"
+    cmp -s "$tmp/file" "$tmp/expected" || fail "-f: wrong bytes"
+    "$regen" --enumerate --patterns "$tmp/patterns" --out-dir "$tmp/dir" || fail "--out-dir: exit status $?"
+    cmp -s "$tmp/dir/1.txt" "$tmp/expected" || fail "--out-dir: wrong bytes"
+    status=$( { "$regen" --enumerate '[A-C][0-9]{2}'; echo $? > "$tmp/status"; } | cmp -s - "$tmp/expected"; echo $?)
+    [ "$status" = 0 ] || fail "pipe: wrong bytes"
+    [ "$(cat "$tmp/status")" = 0 ] || fail "pipe: exit status $(cat "$tmp/status")"
+done
+
+# --uniform picks from every string of the lengths asked for, each as often as the others, and nothing else.
+"$regen" -s 1 -l 9000 --uniform --length 1:2 '[ab]*c?' > "$tmp/uniform" || fail "--uniform: exit status $?"
+sort "$tmp/uniform" | uniq -c | awk '{ print $2 }' | tr '\n' ' ' > "$tmp/strings"
+[ "$(cat "$tmp/strings")" = "a aa ab ac b ba bb bc c " ] || fail "--uniform [ab]*c?: strings are $(cat "$tmp/strings")"
+sort "$tmp/uniform" | uniq -c | awk '$1 < 800 || $1 > 1200 { bad = 1 } END { exit bad }' \
+    || fail "--uniform [ab]*c?: counts far from 1000 each"
+for pattern in '[ab]*c?' '(a|bc)*d{1:2}' '([a-c]x|y)+z?'; do
+    "$regen" -s 2 -l 5000 --uniform --length 1:8 "$pattern" > "$tmp/uniform" \
+        || fail "--uniform $pattern: exit status $?"
+    "$regen" --match "$tmp/uniform" "$pattern" | cmp -s - "$tmp/uniform" \
+        || fail "--uniform $pattern: --match rejects lines"
+done
+
+# A cache written by --compile-to gives the same lines as the patterns it was built from.  A pattern that doesn't
+# compile is left out of both, keeping the line numbers of the others.
+printf '[a-z]{3}\n(ab\n(x|yz)+[0-9]?\n\n' > "$tmp/patterns"
+"$regen" -s 7 -l 50 --patterns "$tmp/patterns" > "$tmp/batch" 2> /dev/null
+[ $? = 4 ] || fail "--patterns with a broken line: exit status not 4"
+"$regen" --patterns "$tmp/patterns" --compile-to "$tmp/cache" 2> /dev/null
+[ $? = 4 ] || fail "--compile-to with a broken line: exit status not 4"
+"$regen" -s 7 -l 50 --load "$tmp/cache" > "$tmp/loaded" || fail "--load: exit status $?"
+cmp -s "$tmp/batch" "$tmp/loaded" || fail "--load: not the lines --patterns writes"
+tags=$(cut -f 1 "$tmp/loaded" | sort -u | tr '\n' ' ')
+[ "$tags" = "1 3 " ] || fail "--load: lines of patterns $tags, not 1 3"
+
+# Each shard is the run its manifest line describes: -s SEED --start START -l LINES gives the same bytes again.
+"$regen" -s 42 --start 5 -l 1000 -j 4 --shards 3 --shard-pattern "$tmp/shard-%d.txt" '[a-z]{2:9}(-[0-9]+)?' \
+    > "$tmp/manifest" || fail "--shards: exit status $?"
+[ "$(grep -vc '^#' "$tmp/manifest")" = 3 ] || fail "--shards: manifest doesn't list 3 shards"
+grep -v '^#' "$tmp/manifest" | while IFS="$(printf '\t')" read -r shard file seed start lines written bytes; do
+    "$regen" -s "$seed" --start "$start" -l "$lines" '[a-z]{2:9}(-[0-9]+)?' > "$tmp/again"
+    cmp -s "$tmp/again" "$file" || echo "shard $shard"
+done > "$tmp/differ"
+[ -s "$tmp/differ" ] && fail "--shards: not reproduced from the manifest: $(tr "\n" " " < "$tmp/differ")"
+
+if [ $failures -gt 0 ]; then
+    echo "$failures check(s) failed."
+    exit 1
+fi
+echo "All checks passed."